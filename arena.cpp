@@ -0,0 +1,137 @@
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "arena.hpp"
+
+/*!
+ * \file arena.cpp
+ */
+
+std::atomic<size_t> Arena::live_(0);
+std::atomic<size_t> Arena::peak_(0);
+
+/**********************************************************************/
+Arena::Arena(size_t blockSize)
+	: head_(NULL), cur_(NULL), end_(NULL), blockSize_(blockSize),
+	  used_(0), reserved_(0), blocks_(0)
+{
+} /* Arena::Arena */
+
+/**********************************************************************/
+/*!
+ * fn Arena::~Arena()
+ * \brief Gives all blocks back at once. Block sizes double, so
+ * this is a handful of free() calls whatever the size of the tree.
+ */
+Arena::~Arena()
+{
+	while (head_) {
+		Block *next = head_->next;
+		free(head_);
+		head_ = next;
+	}
+	live_ -= reserved_;
+} /* Arena::~Arena */
+
+/**********************************************************************/
+/*!
+ * fn void Arena::newBlock(size_t minSize)
+ * \brief Starts a new block big enough for minSize bytes. Throws
+ * std::bad_alloc if there is no memory for it, as new does.
+ */
+void Arena::newBlock(size_t minSize)
+{
+	size_t size = blockSize_;
+	while (size < minSize + sizeof(Block) + alignof(std::max_align_t)) {
+		size *= 2;
+	}
+
+	Block *block = static_cast<Block *>(malloc(size));
+	if (!block) {
+		throw std::bad_alloc();
+	}
+	block->next = head_;
+	block->size = size;
+	head_ = block;
+
+	cur_ = reinterpret_cast<char *>(block) + sizeof(Block);
+	end_ = reinterpret_cast<char *>(block) + size;
+
+	reserved_ += size;
+	blocks_++;
+	blockSize_ *= 2;
+
+	size_t live = live_ += size;
+	size_t peak = peak_.load();
+	while (live > peak && !peak_.compare_exchange_weak(peak, live)) {
+	}
+} /* Arena::newBlock */
+
+/**********************************************************************/
+/*!
+ * fn void *Arena::allocate(size_t size, size_t align)
+ * \brief Bumps the current pointer by size bytes.
+ */
+void *Arena::allocate(size_t size, size_t align)
+{
+	size_t pad = (align - reinterpret_cast<size_t>(cur_) % align) % align;
+	if (!cur_ || cur_ + pad + size > end_) {
+		newBlock(size + align);
+		pad = (align - reinterpret_cast<size_t>(cur_) % align) % align;
+	}
+
+	char *p = cur_ + pad;
+	cur_ = p + size;
+	used_ += size;
+	return p;
+} /* Arena::allocate */
+
+/**********************************************************************/
+/*!
+ * fn const char *Arena::copyString(const char *str, size_t length)
+ * \brief Copies length characters of str into the arena, '\0' terminated.
+ */
+const char *Arena::copyString(const char *str, size_t length)
+{
+	char *p = static_cast<char *>(allocate(length + 1, 1));
+	memcpy(p, str, length);
+	p[length] = '\0';
+	return p;
+} /* Arena::copyString */
+
+/**********************************************************************/
+/*!
+ * fn void Arena::adopt(Arena *other)
+ * \brief Takes over the blocks of other, which is left empty. Nodes
+ * made on another thread, in an arena of its own, so live as long as
+ * the tree they were made for.
+ */
+void Arena::adopt(Arena *other)
+{
+	if (!other->head_) {
+		return;
+	}
+	Block *last = other->head_;
+	while (last->next) {
+		last = last->next;
+	}
+	if (head_) {
+		/* Behind the current block, which allocate() goes on filling */
+		last->next = head_->next;
+		head_->next = other->head_;
+	} else {
+		last->next = NULL;
+		head_ = other->head_;
+		cur_ = other->cur_;
+		end_ = other->end_;
+	}
+	used_     += other->used_;
+	reserved_ += other->reserved_;
+	blocks_   += other->blocks_;
+
+	other->head_ = NULL;
+	other->cur_  = NULL;
+	other->end_  = NULL;
+	other->used_ = other->reserved_ = other->blocks_ = 0;
+} /* Arena::adopt */
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <atomic>
+#include <vector>
+
+/*!
+ * \file arena.hpp
+ * \brief A bump allocator that owns everything the Parser creates.
+ */
+
+/**
+ * An Arena class.
+ * Memory is handed out from large blocks by moving a pointer forward.
+ * Nothing is freed on its own: the whole arena goes away at once, without
+ * running any destructor, so only trivially destructible objects may live
+ * in it.
+ */
+class Arena
+{
+	public:
+		Arena(size_t blockSize = 64 * 1024);
+		~Arena();
+
+		void *allocate(size_t size, size_t align = alignof(std::max_align_t));
+		const char *copyString(const char *str, size_t length);
+		void adopt(Arena *other);
+
+		size_t bytesUsed()     { return used_; }
+		size_t bytesReserved() { return reserved_; }
+		size_t blocks()        { return blocks_; }
+
+		static size_t peakBytes() { return peak_; }
+	private:
+		Arena(const Arena &);
+		Arena &operator=(const Arena &);
+
+		void newBlock(size_t minSize);
+
+		/*!< Header at the start of every block */
+		struct Block
+		{
+			Block *next;
+			size_t size;
+		};
+
+		Block *head_;
+		char  *cur_;
+		char  *end_;
+		size_t blockSize_;
+		size_t used_;
+		size_t reserved_;
+		size_t blocks_;
+
+		static std::atomic<size_t> live_;  /*!< Bytes reserved by all live arenas */
+		static std::atomic<size_t> peak_;  /*!< The highest live_ seen            */
+}; /* Arena */
+
+/**********************************************************************/
+/**
+ * An ArenaArray class.
+ * A fixed size array whose elements live in an Arena.
+ */
+template <typename T>
+class ArenaArray
+{
+	public:
+		typedef T *iterator;
+
+		ArenaArray() : data_(NULL), size_(0) {}
+		ArenaArray(Arena &arena, const std::vector<T> &items) : data_(NULL), size_(items.size())
+		{
+			if (size_) {
+				data_ = static_cast<T *>(arena.allocate(size_ * sizeof(T), alignof(T)));
+				for (size_t i = 0; i < size_; i++) {
+					data_[i] = items[i];
+				}
+			}
+		}
+
+		iterator begin() { return data_; }
+		iterator end()   { return data_ + size_; }
+		size_t size()    { return size_; }
+		T &operator[](size_t i) { return data_[i]; }
+	private:
+		T *data_;
+		size_t size_;
+}; /* ArenaArray */
+
+/**********************************************************************/
+inline void *operator new(size_t size, Arena &arena)
+{
+	return arena.allocate(size);
+}
+
+/**********************************************************************/
+/*!
+ * Only called if a constructor throws; the memory stays with the arena.
+ */
+inline void operator delete(void *, Arena &)
+{
+}
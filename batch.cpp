@@ -0,0 +1,180 @@
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "batch.hpp"
+#include "clog.hpp"
+#include "source.hpp"
+
+/*!
+ * \file batch.cpp
+ */
+
+/**********************************************************************/
+/*!
+ *  \brief The latency at or below which a fraction of the sorted ones are
+ *  (nearest rank)
+ */
+static double percentile(const std::vector<double> &sorted, double fraction)
+{
+	if (sorted.empty()) {
+		return 0;
+	}
+	size_t rank = (size_t)(fraction * sorted.size() + 0.999999);
+	return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+} /* percentile */
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                        Batch methods                               */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*!
+ * fn bool Batch::add(const char *path)
+ * \brief Adds a program file, or every .pas file under a directory, in
+ * the order of their names
+ * \return false if there is no such file or directory
+ */
+bool Batch::add(const char *path)
+{
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		return false;
+	}
+	if (S_ISDIR(st.st_mode)) {
+		addDirectory(path);
+	} else {
+		Program program = { path, "", 0, false, false };
+		programs_.push_back(program);
+	}
+	return true;
+} /* Batch::add */
+
+/**********************************************************************/
+void Batch::addDirectory(const std::string &path)
+{
+	DIR *dir = opendir(path.c_str());
+	if (!dir) {
+		return;
+	}
+	std::vector<std::string> names;
+	while (struct dirent *entry = readdir(dir)) {
+		if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..")) {
+			names.push_back(entry->d_name);
+		}
+	}
+	closedir(dir);
+	std::sort(names.begin(), names.end());
+
+	for (size_t i = 0; i < names.size(); i++) {
+		std::string name = path + "/" + names[i];
+		struct stat st;
+		if (stat(name.c_str(), &st) != 0) {
+			continue;
+		}
+		if (S_ISDIR(st.st_mode)) {
+			addDirectory(name);
+		} else if (name.size() > 4 && !name.compare(name.size() - 4, 4, ".pas")) {
+			Program program = { name, "", 0, false, false };
+			programs_.push_back(program);
+		}
+	}
+} /* Batch::addDirectory */
+
+/**********************************************************************/
+/*!
+ * fn void Batch::run(const Job &job)
+ * \brief Calls job on every program, threads_ at a time: the calling
+ * thread and threads_ - 1 more. Returns when all are done and written.
+ */
+void Batch::run(const Job &job)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (unsigned i = 1; i < threads_ && i < programs_.size(); i++) {
+		workers.push_back(std::thread(&Batch::work, this, std::cref(job)));
+	}
+	work(job);
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	summarize(std::chrono::duration<double>(end - begin).count());
+} /* Batch::run */
+
+/**********************************************************************/
+/*!
+ * fn void Batch::work(const Job &job)
+ * \brief Runs programs until none is left to start
+ */
+void Batch::work(const Job &job)
+{
+	for (size_t index = next_++; index < programs_.size(); index = next_++) {
+		Program &program = programs_[index];
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		std::string *previous = CLog::capture(&program.log);
+		CLog::write(CLog::RELEASE, "==> %s <==\n", program.path.c_str()); /* Also heads the log written if it aborts */
+		SourceFile source;
+		program.readable = source.open(program.path.c_str());
+		if (program.readable) {
+			job(source);
+		} else {
+			CLog::write(CLog::RELEASE, "Can not read %s\n", program.path.c_str());
+		}
+		CLog::capture(previous);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		program.ms = std::chrono::duration<double, std::milli>(end - begin).count();
+		finish(index);
+	}
+} /* Batch::work */
+
+/**********************************************************************/
+/*!
+ * fn void Batch::finish(size_t index)
+ * \brief Marks a program done and writes the logs of the programs that
+ * are done with all the ones before them
+ */
+void Batch::finish(size_t index)
+{
+	std::lock_guard<std::mutex> writing(writeLock_);
+	programs_[index].done = true;
+	while (written_ < programs_.size() && programs_[written_].done) {
+		Program &program = programs_[written_];
+		CLog::write(CLog::RELEASE, "%s", program.log.c_str());
+		std::string().swap(program.log);
+		written_++;
+	}
+} /* Batch::finish */
+
+/**********************************************************************/
+/*!
+ * fn void Batch::summarize(double seconds)
+ * \brief Writes how many programs ran in how long, and the median and
+ * 99th percentile of their latencies
+ */
+void Batch::summarize(double seconds)
+{
+	std::vector<double> latencies;
+	size_t unreadable = 0;
+	for (size_t i = 0; i < programs_.size(); i++) {
+		if (programs_[i].readable) {
+			latencies.push_back(programs_[i].ms);
+		} else {
+			unreadable++;
+		}
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	CLog::write(CLog::RELEASE, "Batch: %zu programs in %.3f s on %u threads, %.1f programs/s\n",
+			latencies.size(), seconds, threads_, seconds > 0 ? latencies.size() / seconds : 0);
+	CLog::write(CLog::RELEASE, "Latency: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+			percentile(latencies, 0.50), percentile(latencies, 0.99), latencies.empty() ? 0 : latencies.back());
+	if (unreadable) {
+		CLog::write(CLog::RELEASE, "Batch: %zu files could not be read\n", unreadable);
+	}
+} /* Batch::summarize */
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*!
+ * \file batch.hpp
+ * \brief Running many programs in one process.
+ */
+
+class SourceFile;
+
+/**********************************************************************/
+/**
+ * A Batch class.
+ * Runs a list of program files on a number of threads, each thread
+ * taking the next file not yet started. A program is lexed, parsed,
+ * analysed and run on one thread, and what it logs is captured apart
+ * from the others. The logs are written in the order of the list, each
+ * under a "==> file <==" line, as soon as every program before it is
+ * done. A summary of throughput and latency ends the batch.
+ * A program with an error ends the batch as it ends a run; its log is
+ * written up to the error.
+ */
+class Batch
+{
+	public:
+		typedef std::function<void(SourceFile &source)> Job;
+
+		Batch(unsigned threads) : threads_(threads ? threads : 1), next_(0), written_(0) {}
+
+		bool add(const char *path);
+		size_t size() { return programs_.size(); }
+		void run(const Job &job);
+	private:
+		/**
+		 * A Program struct.
+		 * One file of the batch and what running it gave
+		 */
+		struct Program
+		{
+			std::string path;
+			std::string log;
+			double ms;         /*!< From opening the file to the end of the run */
+			bool readable;
+			bool done;
+		};
+
+		void addDirectory(const std::string &path);
+		void work(const Job &job);
+		void finish(size_t index);
+		void summarize(double seconds);
+
+		unsigned threads_;
+		std::vector<Program> programs_;
+		std::atomic<size_t> next_;     /*!< The next program to start */
+		std::mutex writeLock_;
+		size_t written_;               /*!< Programs whose log is written */
+}; /* Batch */
@@ -0,0 +1,19 @@
+PROGRAM Fib;
+{ Procedure calls: Fib(25) makes 242785 calls. }
+VAR
+   sum : INTEGER;
+
+PROCEDURE Fib(k : INTEGER);
+BEGIN
+   IF k < 2 THEN
+      sum := sum + k
+   ELSE
+   BEGIN
+      Fib(k - 1);
+      Fib(k - 2)
+   END
+END;
+
+BEGIN
+   Fib(25)
+END.
@@ -0,0 +1,13 @@
+PROGRAM ForLoop;
+{ Overhead of a counted loop: 10000000 iterations of s := s + i. The
+  sum ends in memory, so no pass can drop the loop. The execution time
+  reported by --time divided by 10000000 is the cost of one iteration,
+  body included. Compare with while.pas. }
+VAR
+   i, n, s : INTEGER;
+BEGIN
+   n := 10000000;
+   s := 0;
+   FOR i := 1 TO n DO
+      s := s + i
+END.
@@ -0,0 +1,16 @@
+PROGRAM WhileLoop;
+{ The loop of for.pas written as a WHILE: a comparison, a branch, the
+  body s := s + i, then an addition and a store to step i. Compare with
+  for.pas. }
+VAR
+   i, n, s : INTEGER;
+BEGIN
+   n := 10000000;
+   s := 0;
+   i := 1;
+   WHILE i <= n DO
+   BEGIN
+      s := s + i;
+      i := i + 1
+   END
+END.
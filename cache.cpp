@@ -0,0 +1,306 @@
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cache.hpp"
+#include "vm.hpp"
+#include "trace.hpp"
+
+/*!
+ * \file cache.cpp
+ */
+
+/*!
+ *  \brief "PPBC" read as a little endian word; a file from a machine of
+ *  the other byte order does not match it
+ */
+static const uint32_t CACHE_MAGIC = 0x43425050;
+
+/**
+ * A CacheHeader struct.
+ * Starts every file. The sections follow in this order, each at an
+ * offset that is a multiple of 8: the code words, the constants, their
+ * types (one byte each), the CacheGlobal records, and the names of the
+ * globals.
+ */
+struct CacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t textHash;
+	uint64_t textSize;
+	uint64_t checksum;  /*!< Hash of everything after the header */
+	uint32_t optimized;
+	uint32_t valueSize; /*!< sizeof(Value) */
+	int32_t  maxStack;
+	int32_t  frameSize;
+	uint32_t codeWords;
+	uint32_t constants;
+	uint32_t globals;
+	uint32_t namesSize;
+}; /* CacheHeader */
+
+/**
+ * A CacheGlobal struct.
+ * A GlobalVariable, with its name as an offset into the names section
+ */
+struct CacheGlobal
+{
+	int32_t  slot;
+	int32_t  type;
+	uint32_t name;
+	uint32_t length;
+}; /* CacheGlobal */
+
+/**********************************************************************/
+static size_t align8(size_t size)
+{
+	return (size + 7) & ~(size_t)7;
+} /* align8 */
+
+/**********************************************************************/
+/*!
+ *  \brief Offsets of the sections of a file with the counts of header,
+ *  and its total size
+ */
+static void layout(const CacheHeader &header, size_t *code, size_t *constants, size_t *types,
+		size_t *globals, size_t *names, size_t *total)
+{
+	*code      = align8(sizeof(CacheHeader));
+	*constants = align8(*code + (size_t)header.codeWords * sizeof(int32_t));
+	*types     = align8(*constants + (size_t)header.constants * sizeof(Value));
+	*globals   = align8(*types + header.constants);
+	*names     = align8(*globals + (size_t)header.globals * sizeof(CacheGlobal));
+	*total     = *names + header.namesSize;
+} /* layout */
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                   BytecodeCache methods                            */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*!
+ * fn uint64_t BytecodeCache::hash(const void *data, size_t size, uint64_t seed)
+ * \brief 64 bit FNV-1a of size bytes, continuing from seed
+ */
+uint64_t BytecodeCache::hash(const void *data, size_t size, uint64_t seed)
+{
+	const unsigned char *p = static_cast<const unsigned char *>(data);
+	uint64_t h = seed;
+	for (size_t i = 0; i < size; i++) {
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+} /* BytecodeCache::hash */
+
+/**********************************************************************/
+/*!
+ * fn std::string BytecodeCache::defaultDirectory()
+ * \brief $PASCAL_CACHE_DIR, else $HOME/.cache/pascal_interpreter, else
+ * .pascal_cache in the working directory
+ */
+std::string BytecodeCache::defaultDirectory()
+{
+	const char *dir = getenv("PASCAL_CACHE_DIR");
+	if (dir && *dir) {
+		return dir;
+	}
+	const char *home = getenv("HOME");
+	if (home && *home) {
+		return std::string(home) + "/.cache/pascal_interpreter";
+	}
+	return ".pascal_cache";
+} /* BytecodeCache::defaultDirectory */
+
+/**********************************************************************/
+/*!
+ * fn std::string BytecodeCache::pathOf(const char *text, size_t size, bool optimized, uint64_t *textHash)
+ * \brief The file of a program text. Bytecode compiled with and without
+ * the Optimizer differs, so the flag is part of the name, as is the
+ * format version.
+ */
+std::string BytecodeCache::pathOf(const char *text, size_t size, bool optimized, uint64_t *textHash)
+{
+	*textHash = hash(text, size);
+	uint32_t variant[2] = { VERSION, optimized };
+	uint64_t key = hash(variant, sizeof(variant), *textHash);
+
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.pbc", (unsigned long long)key);
+	return directory_ + name;
+} /* BytecodeCache::pathOf */
+
+/**********************************************************************/
+/*!
+ * fn Bytecode *BytecodeCache::load(const char *text, size_t size, bool optimized)
+ * \brief The compiled form of a program text, if the cache has a valid one
+ * \return A new Bytecode the caller owns, or NULL
+ */
+Bytecode *BytecodeCache::load(const char *text, size_t size, bool optimized)
+{
+	uint64_t textHash;
+	path_ = pathOf(text, size, optimized, &textHash);
+
+	int fd = open(path_.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CacheHeader)) {
+		close(fd);
+		return NULL;
+	}
+	size_t fileSize = st.st_size;
+	void *map = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+
+	const char *base = static_cast<const char *>(map);
+	CacheHeader header;
+	memcpy(&header, base, sizeof(header));
+	size_t codeAt, constantsAt, typesAt, globalsAt, namesAt, total;
+	layout(header, &codeAt, &constantsAt, &typesAt, &globalsAt, &namesAt, &total);
+	if (header.magic != CACHE_MAGIC || header.version != VERSION || header.textHash != textHash ||
+			header.textSize != size || header.optimized != (uint32_t)optimized ||
+			header.valueSize != sizeof(Value) || total != fileSize) {
+		TRACE(TRACE_EVAL, "Cache: %s does not match\n", path_.c_str());
+		munmap(map, fileSize);
+		return NULL;
+	}
+	if (hash(base + codeAt, fileSize - codeAt) != header.checksum) {
+		TRACE(TRACE_EVAL, "Cache: %s is corrupt\n", path_.c_str());
+		munmap(map, fileSize);
+		return NULL;
+	}
+
+	Bytecode *code = new Bytecode();
+	const int32_t *words = reinterpret_cast<const int32_t *>(base + codeAt);
+	code->code().assign(words, words + header.codeWords);
+	const Value *values = reinterpret_cast<const Value *>(base + constantsAt);
+	code->constants().assign(values, values + header.constants);
+	for (uint32_t i = 0; i < header.constants; i++) {
+		code->constantTypes().push_back((SymbolType)(unsigned char)base[typesAt + i]);
+	}
+	const CacheGlobal *globals = reinterpret_cast<const CacheGlobal *>(base + globalsAt);
+	bool ok = true;
+	for (uint32_t i = 0; i < header.globals; i++) {
+		if ((uint64_t)globals[i].name + globals[i].length > header.namesSize) {
+			ok = false;
+			break;
+		}
+		GlobalVariable global;
+		global.name.assign(base + namesAt + globals[i].name, globals[i].length);
+		global.type = (SymbolType)globals[i].type;
+		global.slot = globals[i].slot;
+		code->globals().push_back(global);
+	}
+	code->noteStackDepth(header.maxStack);
+	code->setFrameSize(header.frameSize);
+	munmap(map, fileSize);
+
+	if (!ok || !code->verify()) {
+		TRACE(TRACE_EVAL, "Cache: %s is corrupt\n", path_.c_str());
+		delete code;
+		return NULL;
+	}
+	return code;
+} /* BytecodeCache::load */
+
+/**********************************************************************/
+/*!
+ * fn bool BytecodeCache::store(const char *text, size_t size, bool optimized, Bytecode *code)
+ * \brief Saves code as the compiled form of a program text. The file is
+ * written under a temporary name and renamed, so a concurrent run never
+ * maps half of it. The directory is created if needed.
+ * \return false if the file could not be written
+ */
+bool BytecodeCache::store(const char *text, size_t size, bool optimized, Bytecode *code)
+{
+	uint64_t textHash;
+	path_ = pathOf(text, size, optimized, &textHash);
+
+	std::vector<GlobalVariable> &variables = code->globals();
+	std::string names;
+	std::vector<CacheGlobal> globals;
+	for (size_t i = 0; i < variables.size(); i++) {
+		CacheGlobal global = { variables[i].slot, variables[i].type, (uint32_t)names.size(), (uint32_t)variables[i].name.size() };
+		globals.push_back(global);
+		names += variables[i].name;
+	}
+
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic     = CACHE_MAGIC;
+	header.version   = VERSION;
+	header.textHash  = textHash;
+	header.textSize  = size;
+	header.optimized = optimized;
+	header.valueSize = sizeof(Value);
+	header.maxStack  = code->maxStack();
+	header.frameSize = code->frameSize();
+	header.codeWords = code->code().size();
+	header.constants = code->constants().size();
+	header.globals   = globals.size();
+	header.namesSize = names.size();
+
+	size_t codeAt, constantsAt, typesAt, globalsAt, namesAt, total;
+	layout(header, &codeAt, &constantsAt, &typesAt, &globalsAt, &namesAt, &total);
+	std::vector<char> file(total, 0);
+	if (header.codeWords) {
+		memcpy(&file[codeAt], &code->code()[0], header.codeWords * sizeof(int32_t));
+	}
+	if (header.constants) {
+		memcpy(&file[constantsAt], &code->constants()[0], header.constants * sizeof(Value));
+	}
+	for (uint32_t i = 0; i < header.constants; i++) {
+		file[typesAt + i] = (char)code->constantTypes()[i];
+	}
+	if (header.globals) {
+		memcpy(&file[globalsAt], &globals[0], header.globals * sizeof(CacheGlobal));
+	}
+	if (header.namesSize) {
+		memcpy(&file[namesAt], names.data(), header.namesSize);
+	}
+	header.checksum = hash(&file[codeAt], total - codeAt);
+	memcpy(&file[0], &header, sizeof(header));
+
+	/* mkdir -p */
+	for (size_t at = 1; at <= directory_.size(); at++) {
+		if (at == directory_.size() || directory_[at] == '/') {
+			std::string dir = directory_.substr(0, at);
+			if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+				return false;
+			}
+		}
+	}
+
+	/* Threads of a batch may store the same text at once */
+	static std::atomic<unsigned> stores(0);
+	char suffix[48];
+	snprintf(suffix, sizeof(suffix), ".%d.%u.tmp", (int)getpid(), stores++);
+	std::string temporary = path_ + suffix;
+	FILE *out = fopen(temporary.c_str(), "wb");
+	if (!out) {
+		return false;
+	}
+	bool ok = fwrite(&file[0], 1, file.size(), out) == file.size();
+	ok = fclose(out) == 0 && ok;
+	if (!ok || rename(temporary.c_str(), path_.c_str()) != 0) {
+		unlink(temporary.c_str());
+		return false;
+	}
+	TRACE(TRACE_EVAL, "Cache: stored %s, %zu bytes\n", path_.c_str(), file.size());
+	return true;
+} /* BytecodeCache::store */
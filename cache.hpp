@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*!
+ * \file cache.hpp
+ * \brief Compiled programs kept on disk between runs.
+ */
+
+class Bytecode;
+
+/**********************************************************************/
+/**
+ * A BytecodeCache class.
+ * A directory of compiled programs, one file per program text. The
+ * file of a text is named by a hash of it, FNV-1a, so editing a program
+ * simply misses; its header repeats the hash and the length of the text
+ * and names the format version, and a file that does not match them in
+ * every way is ignored and replaced.
+ * A file holds the Bytecode and the global variables it prints at the
+ * end: enough to run the program without the Lexer, Parser and
+ * SemanticAnalyzer. It is mapped with mmap, and its checksum and
+ * Bytecode::verify() are checked before it is used.
+ */
+class BytecodeCache
+{
+	public:
+		enum { VERSION = 3 }; /*!< Of the file format; change it with the Bytecode */
+
+		BytecodeCache(const std::string &directory) : directory_(directory) {}
+
+		static uint64_t hash(const void *data, size_t size, uint64_t seed = 14695981039346656037ULL);
+		static std::string defaultDirectory();
+
+		Bytecode *load(const char *text, size_t size, bool optimized);
+		bool      store(const char *text, size_t size, bool optimized, Bytecode *code);
+		const std::string &lastPath() { return path_; }
+	private:
+		std::string pathOf(const char *text, size_t size, bool optimized, uint64_t *textHash);
+
+		std::string directory_;
+		std::string path_; /*!< Of the file last loaded or stored */
+}; /* BytecodeCache */
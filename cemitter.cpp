@@ -0,0 +1,631 @@
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+
+#include "cemitter.hpp"
+#include "interpreter.hpp"
+#include "intern.hpp"
+
+/*!
+ * \file cemitter.cpp
+ */
+
+/**********************************************************************/
+/*!
+ *  \brief Start of every generated file: the runtime error and the
+ *  INTEGER kernels of applyKernel that C does not have as operators
+ */
+static const char *prelude =
+	"#include <stdint.h>\n"
+	"#include <stdio.h>\n"
+	"#include <stdlib.h>\n"
+	"#include <math.h>\n"
+	"\n"
+	"static inline void divisionByZero(void)\n"
+	"{\n"
+	"\tprintf(\"Error: Division by zero!\\n\");\n"
+	"\tfflush(stdout);\n"
+	"\tabort();\n"
+	"}\n"
+	"\n"
+	"static inline int64_t add_i(int64_t a, int64_t b) { return (int64_t)((uint64_t)a + (uint64_t)b); }\n"
+	"static inline int64_t sub_i(int64_t a, int64_t b) { return (int64_t)((uint64_t)a - (uint64_t)b); }\n"
+	"static inline int64_t mul_i(int64_t a, int64_t b) { return (int64_t)((uint64_t)a * (uint64_t)b); }\n"
+	"static inline int64_t neg_i(int64_t a) { return (int64_t)(0 - (uint64_t)a); }\n"
+	"\n"
+	"static inline int64_t div_i(int64_t a, int64_t b)\n"
+	"{\n"
+	"\tif (b == 0) {\n"
+	"\t\tdivisionByZero();\n"
+	"\t}\n"
+	"\treturn b == -1 ? neg_i(a) : a / b;\n"
+	"}\n"
+	"\n";
+
+/**********************************************************************/
+/*!
+ *  \brief The call depth limit, for a program with procedures
+ */
+static const char *callPrelude =
+	"#define MAX_DEPTH %d\n"
+	"\n"
+	"static int depth = 1; /* Activation records alive, the program included */\n"
+	"\n"
+	"static void stackOverflow(void)\n"
+	"{\n"
+	"\tprintf(\"Error: Stack overflow!\\n\");\n"
+	"\tfflush(stdout);\n"
+	"\tabort();\n"
+	"}\n"
+	"\n";
+
+/**********************************************************************/
+/*!
+ *  \brief The C type of a variable of type type
+ */
+static const char *cType(SymbolType type)
+{
+	return type == REAL ? "double" : "int64_t";
+} /* cType */
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                      CEmitter methods                              */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*!
+ * fn std::string CEmitter::emit(Program *program)
+ * \brief Translates program, analysed and possibly optimized
+ * \return The text of the C file
+ */
+std::string CEmitter::emit(Program *program)
+{
+	ScopedSymbolTable *scope = program->getScope();
+	std::vector<VarSymbol *> &variables = scope->variables();
+
+	globals_.clear();
+	structs_.clear();
+	prototypes_.clear();
+	functions_.clear();
+	names_.clear();
+	bodies_.assign(1, "int main(void)\n{\n");
+	indent_ = 1;
+	level_  = scope->getLevel();
+	loops_  = 0;
+
+	for (size_t i = 0; i < variables.size(); i++) {
+		globals_ += std::string("static ") + cType(variables[i]->valueType()) + " v_" + variables[i]->name() + ";\n";
+	}
+
+	program->visitCEmitter(*this);
+
+	line("printf(\"Memory:\\n\");");
+	for (size_t i = 0; i < variables.size(); i++) {
+		if (variables[i]->valueType() == INTEGER) {
+			line("printf(\"%s = %%lld\\n\", (long long)v_%s);", variables[i]->spelling(), variables[i]->name());
+		} else {
+			line("printf(\"%s = %%g\\n\", v_%s);", variables[i]->spelling(), variables[i]->name());
+		}
+	}
+	line("return 0;");
+	text("}\n");
+
+	std::string result = "/* PROGRAM " + program->getName() + ", translated by interpreter --emit-c */\n";
+	result += prelude;
+	if (!names_.empty()) {
+		char limit[512];
+		snprintf(limit, sizeof(limit), callPrelude, (int)CallStack::MAX_DEPTH);
+		result += limit;
+	}
+	result += globals_;
+	if (!globals_.empty()) {
+		result += "\n";
+	}
+	result += structs_;
+	result += prototypes_;
+	if (!prototypes_.empty()) {
+		result += "\n";
+	}
+	result += functions_;
+	result += out();
+	bodies_.clear();
+	return result;
+} /* CEmitter::emit */
+
+/**********************************************************************/
+/*!
+ * fn bool CEmitter::write(Program *program, const char *path)
+ * \brief Translates program into the file at path
+ * \return false if the file can not be written
+ */
+bool CEmitter::write(Program *program, const char *path)
+{
+	std::string code = emit(program);
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		return false;
+	}
+	bool ok = fwrite(code.data(), 1, code.size(), file) == code.size();
+	return fclose(file) == 0 && ok;
+} /* CEmitter::write */
+
+/**********************************************************************/
+/*!
+ * fn void CEmitter::text(const char *format, ...)
+ * \brief Appends to the function being written
+ */
+void CEmitter::text(const char *format, ...)
+{
+	char small[256];
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(small, sizeof(small), format, args);
+	va_end(args);
+	if (length < (int)sizeof(small)) {
+		out() += small;
+		return;
+	}
+	std::vector<char> large(length + 1);
+	va_start(args, format);
+	vsnprintf(&large[0], large.size(), format, args);
+	va_end(args);
+	out() += &large[0];
+} /* CEmitter::text */
+
+/**********************************************************************/
+/*!
+ * fn void CEmitter::line(const char *format, ...)
+ * \brief Appends an indented line to the function being written.
+ * An empty format only indents, for a line that text() completes.
+ */
+void CEmitter::line(const char *format, ...)
+{
+	out().append(indent_, '\t');
+	if (!*format) {
+		return;
+	}
+	char small[256];
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(small, sizeof(small), format, args);
+	va_end(args);
+	if (length < (int)sizeof(small)) {
+		out() += small;
+	} else {
+		std::vector<char> large(length + 1);
+		va_start(args, format);
+		vsnprintf(&large[0], large.size(), format, args);
+		va_end(args);
+		out() += &large[0];
+	}
+	out() += "\n";
+} /* CEmitter::line */
+
+/**********************************************************************/
+/*!
+ * fn std::string CEmitter::variable(int level, const char *name)
+ * \brief The C lvalue of the variable name of scope level, seen from the
+ * function being written: a static for a global, a member of f for a
+ * local, and a member of a frame up the chain of static links otherwise
+ */
+std::string CEmitter::variable(int level, const char *name)
+{
+	if (level == 1) {
+		return std::string("v_") + name;
+	}
+	if (level == level_) {
+		return std::string("f.v_") + name;
+	}
+	std::string path = "f.up->";
+	for (int l = level_ - 1; l > level; l--) {
+		path += "up->";
+	}
+	return path + "v_" + name;
+} /* CEmitter::variable */
+
+/**********************************************************************/
+std::string CEmitter::variable(Var *var)
+{
+	return variable(var->level(), InternTable::name(var->getId()));
+} /* CEmitter::variable */
+
+/**********************************************************************/
+/*!
+ * fn std::string CEmitter::literal(Value value, SymbolType type)
+ * \brief A C constant that is exactly value. Negative ones are
+ * parenthesized, so they can follow any operator.
+ */
+std::string CEmitter::literal(Value value, SymbolType type)
+{
+	char text[64];
+	if (type == INTEGER) {
+		if (value.i == INT64_MIN) {
+			return "INT64_MIN";
+		}
+		snprintf(text, sizeof(text), value.i < 0 ? "(INT64_C(%lld))" : "INT64_C(%lld)", (long long)value.i);
+		return text;
+	}
+	if (std::isnan(value.r)) {
+		return "NAN";
+	}
+	if (std::isinf(value.r)) {
+		return value.r < 0 ? "(-HUGE_VAL)" : "HUGE_VAL";
+	}
+	snprintf(text, sizeof(text), "%.17g", value.r);
+	std::string result = text;
+	if (result.find_first_of(".e") == std::string::npos) {
+		result += ".0";
+	}
+	return value.r < 0 || std::signbit(value.r) ? "(" + result + ")" : result;
+} /* CEmitter::literal */
+
+/**********************************************************************/
+/*!
+ * fn std::string CEmitter::staticLink(ProcedureDecl *procedure)
+ * \brief The frame a call from the function being written passes to
+ * procedure: that of the scope procedure is declared in. Empty for a
+ * procedure declared by the program, which has no frame.
+ */
+std::string CEmitter::staticLink(ProcedureDecl *procedure)
+{
+	int parent = procedure->getScope()->getLevel() - 1;
+	if (parent == 1) {
+		return "";
+	}
+	if (parent == level_) {
+		return "&f";
+	}
+	std::string path = "f.up";
+	for (int l = level_ - 1; l > parent; l--) {
+		path += "->up";
+	}
+	return path;
+} /* CEmitter::staticLink */
+
+/**********************************************************************/
+/*!
+ * fn std::string CEmitter::functionName(ProcedureDecl *procedure)
+ * \brief The C function of procedure. Procedures of different scopes
+ * may have the same name, so each gets a number too.
+ */
+std::string CEmitter::functionName(ProcedureDecl *procedure)
+{
+	std::map<ProcedureDecl *, std::string>::iterator it = names_.find(procedure);
+	if (it != names_.end()) {
+		return it->second;
+	}
+	char number[16];
+	snprintf(number, sizeof(number), "_%zu", names_.size() + 1);
+	std::string name = std::string("p_") + InternTable::name(procedure->getId()) + number;
+	names_[procedure] = name;
+	return name;
+} /* CEmitter::functionName */
+
+/**********************************************************************/
+/*!
+ * fn std::string CEmitter::frame(ScopedSymbolTable *scope)
+ * \brief The members of the frame struct of scope, in slot order
+ */
+std::string CEmitter::frame(ScopedSymbolTable *scope)
+{
+	std::string members;
+	std::vector<VarSymbol *> &variables = scope->variables();
+	for (size_t i = 0; i < variables.size(); i++) {
+		members += std::string("\t") + cType(variables[i]->valueType()) + " v_" + variables[i]->name() + ";\n";
+	}
+	return members;
+} /* CEmitter::frame */
+
+/**********************************************************************/
+/*!
+ * fn void CEmitter::beginProcedure(ProcedureDecl *procedure)
+ * \brief Starts the function of procedure: its frame struct, its
+ * prototype, and the code that fills the frame and counts the call.
+ * The function is not static, so a procedure the program never calls
+ * does not draw a warning.
+ * Until endProcedure, statements go to its body.
+ */
+void CEmitter::beginProcedure(ProcedureDecl *procedure)
+{
+	ScopedSymbolTable *scope = procedure->getScope();
+	std::string name = functionName(procedure);
+	std::string parent;
+	if (scope->getLevel() > 2) {
+		parent = "struct " + functionName(enclosing_.back()) + "_frame";
+	}
+
+	structs_ += "/* PROCEDURE " + procedure->getName() + " */\n";
+	structs_ += "struct " + name + "_frame {\n";
+	structs_ += (parent.empty() ? std::string("\tvoid") : "\t" + parent) + " *up;\n";
+	structs_ += frame(scope);
+	structs_ += "};\n\n";
+
+	std::string signature = "void " + name + "(";
+	std::string separator = "";
+	if (!parent.empty()) {
+		signature += parent + " *up";
+		separator = ", ";
+	}
+	std::vector<VarSymbol *> &variables = scope->variables();
+	for (size_t i = 0; i < procedure->size(); i++) {
+		signature += separator + cType(variables[i]->valueType()) + " v_" + variables[i]->name();
+		separator = ", ";
+	}
+	signature += separator.empty() ? "void)" : ")";
+	prototypes_ += signature + ";\n";
+
+	State state = { indent_, level_, loops_ };
+	states_.push_back(state);
+	enclosing_.push_back(procedure);
+	bodies_.push_back(signature + "\n{\n");
+	indent_ = 1;
+	level_  = scope->getLevel();
+	loops_  = 0;
+
+	line("struct %s_frame f = { 0 };", name.c_str());
+	line("f.up = %s;", parent.empty() ? "NULL" : "up");
+	line("(void)f;");
+	for (size_t i = 0; i < procedure->size(); i++) {
+		line("f.v_%s = v_%s;", variables[i]->name(), variables[i]->name());
+	}
+	line("if (depth >= MAX_DEPTH) {");
+	line("\tstackOverflow();");
+	line("}");
+	line("depth++;");
+} /* CEmitter::beginProcedure */
+
+/**********************************************************************/
+void CEmitter::endProcedure(ProcedureDecl *procedure)
+{
+	line("depth--;");
+	text("}\n\n");
+	functions_ += out();
+	bodies_.pop_back();
+	enclosing_.pop_back();
+
+	indent_ = states_.back().indent;
+	level_  = states_.back().level;
+	loops_  = states_.back().loops;
+	states_.pop_back();
+} /* CEmitter::endProcedure */
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                  Node::visitCEmitter methods                       */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+void Program::visitCEmitter(CEmitter &emitter)
+{
+	getBlock()->visitCEmitter(emitter);
+} /* Program::visitCEmitter */
+
+/**********************************************************************/
+void Block::visitCEmitter(CEmitter &emitter)
+{
+	Block::iterator it;
+	for (it = this->begin(); it != this->end(); it++) {
+		(*it)->visitCEmitter(emitter);
+	}
+	getCompound()->visitCEmitter(emitter);
+} /* Block::visitCEmitter */
+
+/**********************************************************************/
+void VarDecl::visitCEmitter(CEmitter &emitter)
+{
+	return;
+} /* VarDecl::visitCEmitter */
+
+/**********************************************************************/
+void Type::visitCEmitter(CEmitter &emitter)
+{
+	return;
+} /* Type::visitCEmitter */
+
+/**********************************************************************/
+void Compound::visitCEmitter(CEmitter &emitter)
+{
+	Compound::iterator it;
+	for (it = this->begin(); it != this->end(); it++) {
+		(*it)->visitCEmitter(emitter);
+	}
+} /* Compound::visitCEmitter */
+
+/**********************************************************************/
+void NoOp::visitCEmitter(CEmitter &emitter)
+{
+	return;
+} /* NoOp::visitCEmitter */
+
+/**********************************************************************/
+void Assign::visitCEmitter(CEmitter &emitter)
+{
+	emitter.line("");
+	emitter.text("%s = %s", emitter.variable(getLhs()).c_str(), toReal() ? "(double)" : "");
+	getRhs()->visitCEmitter(emitter);
+	emitter.text(";\n");
+} /* Assign::visitCEmitter */
+
+/**********************************************************************/
+void Var::visitCEmitter(CEmitter &emitter)
+{
+	emitter.text("%s", emitter.variable(this).c_str());
+} /* Var::visitCEmitter */
+
+/**********************************************************************/
+/*!
+ * fn void BinOp::visitCEmitter(CEmitter &emitter)
+ * \brief INTEGER arithmetic calls the wrapping kernels of the prelude;
+ * everything else is the C operator, with the INTEGER side of a mixed
+ * pair cast to double.
+ */
+void BinOp::visitCEmitter(CEmitter &emitter)
+{
+	static const char *operators[] = { "+", "-", "*", "/", "==", "!=", "<", "<=", ">", ">=" };
+	Kernel kernel = getKernel();
+
+	const char *call = NULL;
+	switch (kernel)
+	{
+		case K_ADD_II: call = "add_i"; break;
+		case K_SUB_II: call = "sub_i"; break;
+		case K_MUL_II: call = "mul_i"; break;
+		case K_INT_DIV_II: call = "div_i"; break;
+		default:
+			break;
+	}
+	if (call) {
+		emitter.text("%s(", call);
+		getLhs()->visitCEmitter(emitter);
+		emitter.text(", ");
+		getRhs()->visitCEmitter(emitter);
+		emitter.text(")");
+		return;
+	}
+
+	const char *op;
+	if (kernel == K_DIV_II) {
+		op = "/";
+	} else if (kernel <= K_GE_II) {
+		op = operators[4 + kernel - K_EQ_II];
+	} else if (kernel <= K_GE_RR) {
+		op = operators[kernel - K_ADD_RR];
+	} else if (kernel <= K_GE_IR) {
+		op = operators[kernel - K_ADD_IR];
+	} else {
+		op = operators[kernel - K_ADD_RI];
+	}
+	bool lhsToReal = kernel == K_DIV_II || (kernel >= K_ADD_IR && kernel <= K_GE_IR);
+	bool rhsToReal = kernel == K_DIV_II || (kernel >= K_ADD_RI && kernel <= K_GE_RI);
+
+	emitter.text(lhsToReal ? "((double)" : "(");
+	getLhs()->visitCEmitter(emitter);
+	emitter.text(rhsToReal ? " %s (double)" : " %s ", op);
+	getRhs()->visitCEmitter(emitter);
+	emitter.text(")");
+} /* BinOp::visitCEmitter */
+
+/**********************************************************************/
+void UnaryOp::visitCEmitter(CEmitter &emitter)
+{
+	if (getKernel() == K_NEG_I) {
+		emitter.text("neg_i(");
+	} else if (getKernel() == K_NEG_R) {
+		emitter.text("(-");
+	} else {
+		emitter.text("(");
+	}
+	getExpr()->visitCEmitter(emitter);
+	emitter.text(")");
+} /* UnaryOp::visitCEmitter */
+
+/**********************************************************************/
+void Number::visitCEmitter(CEmitter &emitter)
+{
+	emitter.text("%s", emitter.literal(value(), valueType()).c_str());
+} /* Number::visitCEmitter */
+
+/**********************************************************************/
+void Param::visitCEmitter(CEmitter &emitter)
+{
+	return;
+} /* Param::visitCEmitter */
+
+/**********************************************************************/
+void ProcedureDecl::visitCEmitter(CEmitter &emitter)
+{
+	emitter.beginProcedure(this);
+	getBlock()->visitCEmitter(emitter);
+	emitter.endProcedure(this);
+} /* ProcedureDecl::visitCEmitter */
+
+/**********************************************************************/
+void ProcedureCall::visitCEmitter(CEmitter &emitter)
+{
+	std::string link = emitter.staticLink(getProcedure());
+	emitter.line("");
+	emitter.text("%s(%s", emitter.functionName(getProcedure()).c_str(), link.c_str());
+	for (size_t i = 0; i < size(); i++) {
+		emitter.text(i == 0 && link.empty() ? "%s" : ", %s", toReal(i) ? "(double)" : "");
+		arg(i)->visitCEmitter(emitter);
+	}
+	emitter.text(");\n");
+} /* ProcedureCall::visitCEmitter */
+
+/**********************************************************************/
+void If::visitCEmitter(CEmitter &emitter)
+{
+	emitter.line("");
+	emitter.text("if (");
+	getCondition()->visitCEmitter(emitter);
+	emitter.text(") {\n");
+	emitter.indent();
+	getThen()->visitCEmitter(emitter);
+	emitter.outdent();
+	if (getElse()) {
+		emitter.line("} else {");
+		emitter.indent();
+		getElse()->visitCEmitter(emitter);
+		emitter.outdent();
+	}
+	emitter.line("}");
+} /* If::visitCEmitter */
+
+/**********************************************************************/
+void While::visitCEmitter(CEmitter &emitter)
+{
+	emitter.line("");
+	emitter.text("while (");
+	getCondition()->visitCEmitter(emitter);
+	emitter.text(") {\n");
+	emitter.indent();
+	getBody()->visitCEmitter(emitter);
+	emitter.outdent();
+	emitter.line("}");
+} /* While::visitCEmitter */
+
+/**********************************************************************/
+/*!
+ * fn void For::visitCEmitter(CEmitter &emitter)
+ * \brief Both bounds are evaluated first and the counter is assigned
+ * only if the loop runs. The loop ends once the counter is not below the
+ * bound (above it, for DOWNTO), as in the VM: a called procedure may
+ * have moved it past the bound. The bounds are locals of a block of
+ * their own, numbered by how deep the loop is nested.
+ */
+void For::visitCEmitter(CEmitter &emitter)
+{
+	std::string counter = emitter.variable(getVar());
+	int loop = emitter.beginLoop();
+
+	emitter.line("{");
+	emitter.indent();
+	emitter.line("");
+	emitter.text("int64_t start%d = ", loop);
+	getStart()->visitCEmitter(emitter);
+	emitter.text(";\n");
+	emitter.line("");
+	emitter.text("int64_t bound%d = ", loop);
+	getBound()->visitCEmitter(emitter);
+	emitter.text(";\n");
+	emitter.line("if (start%d %s bound%d) {", loop, isDown() ? ">=" : "<=", loop);
+	emitter.indent();
+	emitter.line("%s = start%d;", counter.c_str(), loop);
+	emitter.line("for (;;) {");
+	emitter.indent();
+	getBody()->visitCEmitter(emitter);
+	emitter.line("if (%s %s bound%d) {", counter.c_str(), isDown() ? "<=" : ">=", loop);
+	emitter.line("\tbreak;");
+	emitter.line("}");
+	emitter.line("%s%s;", counter.c_str(), isDown() ? "--" : "++");
+	emitter.outdent();
+	emitter.line("}");
+	emitter.outdent();
+	emitter.line("}");
+	emitter.outdent();
+	emitter.line("}");
+	emitter.endLoop();
+} /* For::visitCEmitter */
@@ -0,0 +1,71 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include "value.hpp"
+
+/*!
+ * \file cemitter.hpp
+ * \brief Translation of an analysed program to a C translation unit.
+ */
+
+class Node;
+class Var;
+class Program;
+class ProcedureDecl;
+class ScopedSymbolTable;
+
+/**********************************************************************/
+/**
+ * A CEmitter class.
+ * Walks a Program tree after the SemanticAnalyzer (through
+ * Node::visitCEmitter) and writes a self-contained C file that runs the
+ * program and prints its memory as the Evaluator does.
+ * Global variables become static variables. Each procedure becomes a C
+ * function whose parameters and locals live in a frame struct,
+ * f; a nested procedure gets a pointer to the frame of the procedure
+ * around it, and reaches outer variables along those up pointers.
+ * Arithmetic follows applyKernel: INTEGERs wrap around and DIV by zero
+ * is the same runtime error, as is a call deeper than
+ * CallStack::MAX_DEPTH.
+ */
+class CEmitter
+{
+	public:
+		CEmitter() : indent_(0), level_(1), loops_(0) {}
+
+		std::string emit(Program *program);
+		bool write(Program *program, const char *path);
+
+		/* For the Node::visitCEmitter methods */
+		void text(const char *format, ...);
+		void line(const char *format, ...);
+		void indent()  { indent_++; }
+		void outdent() { indent_--; }
+		std::string variable(Var *var);
+		std::string variable(int level, const char *name);
+		std::string literal(Value value, SymbolType type);
+		std::string staticLink(ProcedureDecl *procedure);
+		std::string functionName(ProcedureDecl *procedure);
+		int  beginLoop() { return loops_++; }
+		void endLoop()   { loops_--; }
+		void beginProcedure(ProcedureDecl *procedure);
+		void endProcedure(ProcedureDecl *procedure);
+	private:
+		std::string frame(ScopedSymbolTable *scope);
+		std::string &out() { return bodies_.back(); }
+
+		struct State { int indent, level, loops; }; /*!< Of a function whose writing a nested procedure interrupts */
+
+		std::string globals_;
+		std::string structs_;
+		std::string prototypes_;
+		std::string functions_;
+		std::vector<std::string> bodies_; /*!< The functions being written, innermost last */
+		std::vector<State> states_;
+		std::vector<ProcedureDecl *> enclosing_; /*!< The procedures being written */
+		std::map<ProcedureDecl *, std::string> names_;
+		int indent_;
+		int level_; /*!< Scope level of the function being written */
+		int loops_; /*!< FOR loops open in it, to name their bounds */
+}; /* CEmitter */
@@ -1,30 +1,509 @@
 #include "clog.hpp"
 #include <iostream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <unistd.h>
 
+/*!
+ * \file clog.cpp
+ */
+
+/**********************************************************************/
+/**
+ * An AsyncSink class.
+ * A bounded ring of fixed size slots shared by any number of producers
+ * and one writer thread. A producer claims as many consecutive slots as
+ * its message needs with a single compare and swap on tail_, formats into
+ * them and publishes each slot through its sequence number, so a message
+ * is never interleaved with another one. When the ring is full the
+ * message is counted in dropped_ instead of blocking the producer.
+ * The writer copies published slots into a batch and writes the batch
+ * with one fwrite().
+ */
+class AsyncSink
+{
+	public:
+		AsyncSink(FILE *out, size_t slots);
+		~AsyncSink();
+
+		void push(const char *szFormat, va_list args);
+		void stop();
+		void flush();
+		void writeRing();
+		unsigned long dropped() { return dropped_.load(std::memory_order_relaxed); }
+	private:
+		enum { SLOT_SIZE = 256, BATCH_SIZE = 64 * 1024 };
+
+		struct Slot
+		{
+			std::atomic<size_t> seq;
+			unsigned short length;
+			char text[SLOT_SIZE - sizeof(std::atomic<size_t>) - sizeof(unsigned short)];
+		};
+
+		bool claim(size_t count, size_t &pos);
+		void pushLong(const char *szFormat, va_list args);
+		bool drain();
+		void write();
+		void run();
+
+		FILE  *out_;
+		int    fd_;                                 /*!< fileno(out_), for writeRing() */
+		Slot  *slots_;
+		size_t mask_;
+
+		alignas(64) std::atomic<size_t> tail_;      /*!< next position to claim   */
+		alignas(64) size_t head_;                   /*!< next position to write   */
+		std::atomic<size_t> written_;               /*!< head_ after the last fflush() */
+		std::atomic<unsigned long> dropped_;
+		std::atomic<bool> stop_;
+		std::thread writer_;
+		size_t used_;                               /*!< bytes waiting in batch_ */
+		char batch_[BATCH_SIZE];
+}; /* AsyncSink */
+
+static AsyncSink *asyncSink = NULL;
+static thread_local std::string *captured = NULL; /*!< See CLog::capture() */
+static thread_local int threadLevel = -1;          /*!< See CLog::setThreadLevel() */
+static void (*previousAbortHandler)(int) = SIG_DFL;
+
+/**********************************************************************/
+AsyncSink::AsyncSink(FILE *out, size_t slots)
+	: out_(out), fd_(fileno(out)), slots_(NULL), mask_(0), tail_(0), head_(0), written_(0), dropped_(0), stop_(false), used_(0)
+{
+	size_t capacity = 16;
+	while (capacity < slots) {
+		capacity *= 2;
+	}
+	slots_ = new Slot[capacity];
+	mask_ = capacity - 1;
+	for (size_t i = 0; i < capacity; i++) {
+		slots_[i].seq.store(i, std::memory_order_relaxed);
+	}
+	writer_ = std::thread(&AsyncSink::run, this);
+} /* AsyncSink::AsyncSink */
+
+/**********************************************************************/
+AsyncSink::~AsyncSink()
+{
+	stop();
+	if (out_ != stdout) {
+		fclose(out_);
+	}
+	delete [] slots_;
+} /* AsyncSink::~AsyncSink */
+
+/**********************************************************************/
+/*!
+ * fn bool AsyncSink::claim(size_t count, size_t &pos)
+ * \brief Reserves count consecutive slots starting at pos.
+ * The writer frees slots in order, so if the last one is free all of
+ * them are.
+ * \return false if the ring has no room for them
+ */
+bool AsyncSink::claim(size_t count, size_t &pos)
+{
+	pos = tail_.load(std::memory_order_relaxed);
+	for (;;) {
+		Slot &last = slots_[(pos + count - 1) & mask_];
+		size_t seq = last.seq.load(std::memory_order_acquire);
+		ptrdiff_t dif = (ptrdiff_t)seq - (ptrdiff_t)(pos + count - 1);
+		if (dif == 0) {
+			if (tail_.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+				return true;
+			}
+		} else if (dif < 0) {
+			return false;
+		} else {
+			pos = tail_.load(std::memory_order_relaxed);
+		}
+	}
+} /* AsyncSink::claim */
+
+/**********************************************************************/
+/*!
+ * fn void AsyncSink::push(const char *szFormat, va_list args)
+ * \brief Formats a message straight into the ring. Never blocks.
+ */
+void AsyncSink::push(const char *szFormat, va_list args)
+{
+	size_t pos;
+	if (!claim(1, pos)) {
+		dropped_.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	Slot &slot = slots_[pos & mask_];
+	va_list copy;
+	va_copy(copy, args);
+	int length = vsnprintf(slot.text, sizeof(slot.text), szFormat, copy);
+	va_end(copy);
+
+	bool fits = length >= 0 && (size_t)length < sizeof(slot.text);
+	slot.length = fits ? length : 0;
+	slot.seq.store(pos + 1, std::memory_order_release);
+	if (!fits && length > 0) {
+		pushLong(szFormat, args);
+	}
+} /* AsyncSink::push */
+
+/**********************************************************************/
+/*!
+ * fn void AsyncSink::pushLong(const char *szFormat, va_list args)
+ * \brief Spreads a message too long for one slot over consecutive ones.
+ */
+void AsyncSink::pushLong(const char *szFormat, va_list args)
+{
+	va_list copy;
+	va_copy(copy, args);
+	int length = vsnprintf(NULL, 0, szFormat, copy);
+	va_end(copy);
+	char *text = static_cast<char *>(malloc(length + 1));
+	va_copy(copy, args);
+	vsnprintf(text, length + 1, szFormat, copy);
+	va_end(copy);
+
+	const size_t perSlot = sizeof(slots_[0].text);
+	size_t count = (length + perSlot - 1) / perSlot;
+	size_t pos;
+	if (count > (mask_ + 1) / 4 || !claim(count, pos)) {
+		dropped_.fetch_add(1, std::memory_order_relaxed);
+	} else {
+		size_t done = 0;
+		for (size_t i = 0; i < count; i++) {
+			Slot &slot = slots_[(pos + i) & mask_];
+			size_t n = length - done < perSlot ? length - done : perSlot;
+			memcpy(slot.text, text + done, n);
+			slot.length = n;
+			done += n;
+			slot.seq.store(pos + i + 1, std::memory_order_release);
+		}
+	}
+	free(text);
+} /* AsyncSink::pushLong */
+
+/**********************************************************************/
+/*!
+ * fn bool AsyncSink::drain()
+ * \brief Moves every published slot into the batch, writing the batch
+ * out whenever it fills up.
+ * \return true if there was anything to move
+ */
+bool AsyncSink::drain()
+{
+	bool any = false;
+	for (;;) {
+		Slot &slot = slots_[head_ & mask_];
+		if (slot.seq.load(std::memory_order_acquire) != head_ + 1) {
+			break;
+		}
+		if (used_ + slot.length > sizeof(batch_)) {
+			fwrite(batch_, 1, used_, out_);
+			used_ = 0;
+		}
+		memcpy(batch_ + used_, slot.text, slot.length);
+		used_ += slot.length;
+		slot.seq.store(head_ + mask_ + 1, std::memory_order_release);
+		head_++;
+		any = true;
+	}
+	return any;
+} /* AsyncSink::drain */
+
+/**********************************************************************/
+/*!
+ * fn void AsyncSink::write()
+ * \brief Writes out the batch. Called once the ring is empty, so a busy
+ * producer costs one write() per BATCH_SIZE bytes.
+ */
+void AsyncSink::write()
+{
+	if (used_) {
+		fwrite(batch_, 1, used_, out_);
+		used_ = 0;
+	}
+	fflush(out_);
+	written_.store(head_, std::memory_order_release);
+} /* AsyncSink::write */
+
+/**********************************************************************/
+/*!
+ * fn void AsyncSink::run()
+ * \brief The writer thread. Polls the ring until stop() is called, then
+ * writes whatever is left.
+ */
+void AsyncSink::run()
+{
+	for (;;) {
+		bool stopping = stop_.load(std::memory_order_acquire);
+		if (drain()) {
+			continue;
+		}
+		if (written_.load(std::memory_order_relaxed) != head_) {
+			write();
+		}
+		if (stopping) {
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+} /* AsyncSink::run */
+
+/**********************************************************************/
+/*!
+ * fn void AsyncSink::flush()
+ * \brief Waits, at most a second, until everything pushed so far has
+ * been written.
+ */
+void AsyncSink::flush()
+{
+	size_t target = tail_.load(std::memory_order_acquire);
+	for (int i = 0; i < 10000; i++) {
+		if ((ptrdiff_t)(written_.load(std::memory_order_acquire) - target) >= 0) {
+			return;
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+} /* AsyncSink::flush */
+
+/**********************************************************************/
+/*!
+ * fn void AsyncSink::writeRing()
+ * \brief Writes the messages published in the ring and not yet taken by
+ * the writer straight to the file with write(2). It takes no lock and
+ * allocates nothing, so the SIGABRT handler may call it; what the writer
+ * already took into its batch may be lost, or a message written twice.
+ */
+void AsyncSink::writeRing()
+{
+	size_t end = tail_.load(std::memory_order_acquire);
+	for (size_t pos = written_.load(std::memory_order_acquire); pos != end; pos++) {
+		Slot &slot = slots_[pos & mask_];
+		if (slot.seq.load(std::memory_order_acquire) == pos + 1) {
+			ssize_t done = ::write(fd_, slot.text, slot.length);
+			(void)done;
+		}
+	}
+} /* AsyncSink::writeRing */
+
+/**********************************************************************/
+void AsyncSink::stop()
+{
+	if (writer_.joinable()) {
+		stop_.store(true, std::memory_order_release);
+		writer_.join();
+	}
+} /* AsyncSink::stop */
+
+/**********************************************************************/
+/*!
+ * \brief An abort() that did not go through CLog::flushForAbort(), such
+ * as a failed assert(): writes what is still in the ring of the async
+ * sink, then lets the default action run. Only write(2) is used here,
+ * since the aborting thread may hold the lock of malloc or of a FILE.
+ */
+static void flushOnAbort(int sig)
+{
+	if (asyncSink) {
+		asyncSink->writeRing();
+	}
+	signal(sig, previousAbortHandler);
+	raise(sig);
+} /* flushOnAbort */
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                        CLog methods                                */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
 void CLog::write(int nLevel, const char *szFormat, ...)
+{
+	va_list args;
+	va_start(args, szFormat);
+	vwrite(nLevel, szFormat, args);
+	va_end(args);
+}
+
+void CLog::vwrite(int nLevel, const char *szFormat, va_list args)
 {
 	checkInit();
-	if ((m_nLevel == DEBUG) || (m_nLevel == RELEASE && nLevel == RELEASE))
+	int level = CLog::level();
+	if ((level == DEBUG) || (level == RELEASE && nLevel == RELEASE))
 	{
-		va_list args;
-		va_start(args, szFormat);
-		vprintf(szFormat, args);
-		va_end(args);
+		if (captured) {
+			va_list copy;
+			va_copy(copy, args);
+			int length = vsnprintf(NULL, 0, szFormat, copy);
+			va_end(copy);
+			if (length > 0) {
+				size_t at = captured->size();
+				captured->resize(at + length + 1);
+				vsnprintf(&(*captured)[at], length + 1, szFormat, args);
+				captured->resize(at + length);
+			}
+		} else if (asyncSink) {
+			asyncSink->push(szFormat, args);
+		} else {
+			vprintf(szFormat, args);
+		}
+	}
+}
+
+/**********************************************************************/
+/*!
+ * fn bool CLog::startAsync(const char *szPath, size_t nSlots)
+ * \brief From now on messages go through a ring of nSlots slots to a
+ * background writer, to stdout or to szPath if given. The writer is
+ * drained at exit and by flushForAbort(); on any other abort() what is
+ * left in the ring is written.
+ * \return false if szPath can not be opened
+ */
+bool CLog::startAsync(const char *szPath, size_t nSlots)
+{
+	if (asyncSink) {
+		return true;
+	}
+	FILE *out = stdout;
+	if (szPath) {
+		out = fopen(szPath, "w");
+		if (!out) {
+			return false;
+		}
+	}
+	fflush(stdout);
+	/* the writer flushes after every batch, line buffering would only split it up */
+	setvbuf(out, NULL, _IOFBF, 64 * 1024);
+	checkInit();
+	asyncSink = new AsyncSink(out, nSlots);
+	atexit(stopAsync);
+	return true;
+}
+
+/**********************************************************************/
+/*!
+ * fn void CLog::stopAsync()
+ * \brief Writes what is left, stops the writer and goes back to
+ * writing synchronously. Dropped messages are reported on stderr.
+ */
+void CLog::stopAsync()
+{
+	AsyncSink *sink = asyncSink;
+	if (!sink) {
+		return;
 	}
+	sink->stop();
+	asyncSink = NULL;
+
+	if (sink->dropped()) {
+		fprintf(stderr, "CLog: %lu messages dropped\n", sink->dropped());
+	}
+	fflush(stdout);
+	delete sink;
+}
+
+/**********************************************************************/
+void CLog::flush()
+{
+	if (asyncSink) {
+		asyncSink->flush();
+	}
+	fflush(stdout);
 }
 
+/**********************************************************************/
+/*!
+ * fn void CLog::flushForAbort()
+ * \brief Called before an abort() the program chooses: writes the
+ * messages the calling thread was capturing, as they would have been
+ * without capture(), then everything still queued.
+ */
+void CLog::flushForAbort()
+{
+	std::string *buffer = captured;
+	if (buffer) {
+		captured = NULL;
+		write(RELEASE, "%s", buffer->c_str());
+	}
+	flush();
+} /* CLog::flushForAbort */
+
+/**********************************************************************/
+unsigned long CLog::dropped()
+{
+	return asyncSink ? asyncSink->dropped() : 0;
+}
+
+/**********************************************************************/
+/*!
+ * fn void CLog::setLevel(int nLevel)
+ * \brief Sets the level of every thread that has not set one of its own
+ */
 void CLog::setLevel(int nLevel)
 {
 	m_nLevel = nLevel;
 	m_bInitialised = true;
 }
 
+/**********************************************************************/
+/*!
+ * fn int CLog::setThreadLevel(int nLevel)
+ * \brief Sets the level of the calling thread only, so runs on different
+ * threads log at levels of their own, as capture() gives them logs of
+ * their own; -1 follows setLevel() again. Work a run hands to other
+ * threads passes level() on to them.
+ * \return The level the thread had, to give back
+ */
+int CLog::setThreadLevel(int nLevel)
+{
+	int previous = threadLevel;
+	threadLevel = nLevel;
+	return previous;
+} /* CLog::setThreadLevel */
+
+/**********************************************************************/
+/*!
+ * fn int CLog::level()
+ * \brief The level messages of the calling thread are filtered by
+ */
+int CLog::level()
+{
+	return threadLevel >= 0 ? threadLevel : m_nLevel.load();
+} /* CLog::level */
+
+/**********************************************************************/
+/*!
+ * fn std::string *CLog::capture(std::string *buffer)
+ * \brief From now on the messages of the calling thread are appended
+ * to buffer instead of written; NULL writes them again. Work done on
+ * several threads collects its messages this way and writes them in
+ * a fixed order.
+ * \return The buffer the thread captured into until now, to give back
+ */
+std::string *CLog::capture(std::string *buffer)
+{
+	std::string *previous = captured;
+	captured = buffer;
+	return previous;
+} /* CLog::capture */
+
 void CLog::checkInit()
 {
-	if (!m_bInitialised)
-	{
-		init();
-	}
+	/* Programs of a batch write from several threads from the start */
+	static std::once_flag once;
+	std::call_once(once, [] {
+		if (!m_bInitialised)
+		{
+			init();
+		}
+		previousAbortHandler = signal(SIGABRT, flushOnAbort);
+	});
 }
 
 void CLog::init()
@@ -35,4 +514,3 @@ void CLog::init()
 	setLevel(nDfltLevel);
 }
 
-
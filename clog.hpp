@@ -3,20 +3,34 @@
 
 #include <cstdio>
 #include <cstdarg>
+#include <cstddef>
+#include <atomic>
+#include <string>
 
 class CLog
 {
 	public:
 		enum { DEBUG, RELEASE };
 		static void write(int nLevel, const char *szFormat, ...);
+		static void vwrite(int nLevel, const char *szFormat, va_list args);
 		static void setLevel(int nLevel);
+		static int  setThreadLevel(int nLevel);
+		static int  level();
+
+		static bool startAsync(const char *szPath = NULL, size_t nSlots = 16384);
+		static void stopAsync();
+		static void flush();
+		static void flushForAbort();
+		static unsigned long dropped();
+
+		static std::string *capture(std::string *buffer);
 	protected:
 		static void checkInit();
 		static void init();
 	private:
 		CLog();
-		static bool m_bInitialised;
-		static int  m_nLevel;
+		static std::atomic<bool> m_bInitialised;
+		static std::atomic<int>  m_nLevel;
 };
 
 #endif
@@ -0,0 +1,47 @@
+#include <cstdlib>
+
+#include "error.hpp"
+#include "clog.hpp"
+
+/*!
+ * \file error.cpp
+ */
+
+/*!
+ *  \brief Whether an ErrorTrap lives on this thread
+ */
+static thread_local bool trapped = false;
+
+/**********************************************************************/
+ErrorTrap::ErrorTrap() : saved_(trapped)
+{
+	trapped = true;
+} /* ErrorTrap::ErrorTrap */
+
+/**********************************************************************/
+ErrorTrap::~ErrorTrap()
+{
+	trapped = saved_;
+} /* ErrorTrap::~ErrorTrap */
+
+/**********************************************************************/
+bool ErrorTrap::active()
+{
+	return trapped;
+} /* ErrorTrap::active */
+
+/**********************************************************************/
+/*!
+ * fn void programError()
+ * \brief Stops after an error in the program has been logged: throws a
+ * ProgramError inside an ErrorTrap, aborts outside of one, once the log
+ * is written out
+ */
+void programError()
+{
+	if (trapped) {
+		throw ProgramError();
+	}
+	CLog::flushForAbort();
+	abort();
+} /* programError */
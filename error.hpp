@@ -0,0 +1,40 @@
+#pragma once
+
+/*!
+ * \file error.hpp
+ * \brief Stopping at an error in the program.
+ *
+ * An error is written to the log where it is found, then programError()
+ * stops: it aborts the process, unless the thread holds an ErrorTrap,
+ * in which case it throws a ProgramError for the owner of the trap to
+ * catch and carry on from.
+ */
+
+/**********************************************************************/
+/**
+ * A ProgramError struct.
+ * Thrown by programError() inside an ErrorTrap. The message is already
+ * in the log.
+ */
+struct ProgramError
+{
+}; /* ProgramError */
+
+/**********************************************************************/
+/**
+ * An ErrorTrap class.
+ * While one lives, programError() on its thread throws instead of
+ * aborting. Traps nest.
+ */
+class ErrorTrap
+{
+	public:
+		ErrorTrap();
+		~ErrorTrap();
+
+		static bool active();
+	private:
+		bool saved_;
+}; /* ErrorTrap */
+
+[[noreturn]] void programError();
@@ -0,0 +1,213 @@
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "intern.hpp"
+#include "arena.hpp"
+
+/*!
+ * \file intern.cpp
+ */
+
+/*!< One interned name */
+struct InternEntry
+{
+	const char *text;   /*!< '\0' terminated, in nameArena */
+	uint32_t    length;
+	uint32_t    hash;
+};
+
+/*!< An open addressed table of ids; never changed but to fill a bucket */
+struct InternBuckets
+{
+	size_t               mask;
+	std::atomic<NameId> *ids;
+};
+
+/*
+ * The entries live in chunks that never move: chunk c holds FIRST_CHUNK << c
+ * of them, so 24 chunks cover every NameId. Lookups take no lock: they read
+ * the bucket array that is current, and an id is only put in a bucket once
+ * its entry is written. Adding a name takes addLock; a lookup that misses
+ * looks again under it, since it may have read an array that grow() has
+ * since replaced.
+ */
+enum { FIRST_CHUNK_BITS = 8, FIRST_CHUNK = 1 << FIRST_CHUNK_BITS, CHUNKS = 24 };
+
+static Arena                        nameArena(16 * 1024);
+static InternEntry                 *chunks[CHUNKS];
+static std::atomic<NameId>          count(1);         /* entries[NO_NAME] is unused */
+static std::atomic<InternBuckets *> current(NULL);
+static std::vector<InternBuckets *> retired;          /* Arrays a lookup may still be reading */
+static std::mutex                   addLock;
+
+/**********************************************************************/
+/*!
+ * \brief FNV-1a over the name with ASCII case folded. Identifiers are
+ * made of letters, digits and '_', and |0x20 maps each of them to a
+ * distinct byte.
+ */
+static uint32_t hashName(const char *text, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ (uint8_t)(text[i] | 0x20)) * 16777619u;
+	}
+	return hash;
+} /* hashName */
+
+/**********************************************************************/
+static bool sameName(const InternEntry &entry, const char *text, size_t length)
+{
+	if (entry.length != length) {
+		return false;
+	}
+	for (size_t i = 0; i < length; i++) {
+		if ((entry.text[i] | 0x20) != (text[i] | 0x20)) {
+			return false;
+		}
+	}
+	return true;
+} /* sameName */
+
+/**********************************************************************/
+static InternEntry &entry(NameId id)
+{
+	uint32_t at = id + FIRST_CHUNK;
+	int chunk = 31 - __builtin_clz(at) - FIRST_CHUNK_BITS;
+	return chunks[chunk][at - ((uint32_t)FIRST_CHUNK << chunk)];
+} /* entry */
+
+/**********************************************************************/
+static InternBuckets *makeBuckets(size_t size)
+{
+	InternBuckets *buckets = new InternBuckets;
+	buckets->mask = size - 1;
+	buckets->ids = new std::atomic<NameId>[size];
+	for (size_t i = 0; i < size; i++) {
+		buckets->ids[i].store(NO_NAME, std::memory_order_relaxed);
+	}
+	return buckets;
+} /* makeBuckets */
+
+/**********************************************************************/
+/*!
+ * \brief The bucket of the name in buckets: the one holding its id, or
+ * the empty one where it goes
+ */
+static size_t findBucket(InternBuckets *buckets, const char *text, size_t length, uint32_t hash)
+{
+	size_t i = hash & buckets->mask;
+	NameId id;
+
+	while ((id = buckets->ids[i].load(std::memory_order_acquire)) != NO_NAME) {
+		const InternEntry &candidate = entry(id);
+		if (candidate.hash == hash && sameName(candidate, text, length)) {
+			return i;
+		}
+		i = (i + 1) & buckets->mask;
+	}
+	return i;
+} /* findBucket */
+
+/**********************************************************************/
+/*!
+ * \brief Replaces the bucket array by one twice its size once it is half
+ * full. Called with addLock held.
+ */
+static void grow(InternBuckets *buckets)
+{
+	InternBuckets *bigger = makeBuckets((buckets->mask + 1) * 2);
+	NameId last = count.load(std::memory_order_relaxed);
+	for (NameId id = 1; id < last; id++) {
+		size_t i = entry(id).hash & bigger->mask;
+		while (bigger->ids[i].load(std::memory_order_relaxed) != NO_NAME) {
+			i = (i + 1) & bigger->mask;
+		}
+		bigger->ids[i].store(id, std::memory_order_relaxed);
+	}
+	current.store(bigger, std::memory_order_release);
+	retired.push_back(buckets);
+} /* grow */
+
+/**********************************************************************/
+/*!
+ * \brief The bucket array, made on first use
+ */
+static InternBuckets *buckets()
+{
+	InternBuckets *buckets = current.load(std::memory_order_acquire);
+	if (!buckets) {
+		std::lock_guard<std::mutex> adding(addLock);
+		buckets = current.load(std::memory_order_relaxed);
+		if (!buckets) {
+			buckets = makeBuckets(256);
+			current.store(buckets, std::memory_order_release);
+		}
+	}
+	return buckets;
+} /* buckets */
+
+/**********************************************************************/
+/*!
+ * fn NameId InternTable::intern(const char *text, size_t length)
+ * \brief The id of the name, adding it on first sight. Any thread may
+ * call it; only adding a name takes a lock.
+ * \param text The name, not necessarily '\0' terminated
+ */
+NameId InternTable::intern(const char *text, size_t length)
+{
+	uint32_t hash = hashName(text, length);
+	InternBuckets *table = buckets();
+	NameId found = table->ids[findBucket(table, text, length, hash)].load(std::memory_order_acquire);
+	if (found != NO_NAME) {
+		return found;
+	}
+
+	std::lock_guard<std::mutex> adding(addLock);
+	table = current.load(std::memory_order_relaxed);
+	size_t i = findBucket(table, text, length, hash);
+	found = table->ids[i].load(std::memory_order_relaxed);
+	if (found != NO_NAME) {
+		return found;
+	}
+
+	NameId id = count.load(std::memory_order_relaxed);
+	uint32_t at = id + FIRST_CHUNK;
+	int chunk = 31 - __builtin_clz(at) - FIRST_CHUNK_BITS;
+	if (!chunks[chunk]) {
+		size_t entries = (size_t)FIRST_CHUNK << chunk;
+		chunks[chunk] = static_cast<InternEntry *>(nameArena.allocate(entries * sizeof(InternEntry), alignof(InternEntry)));
+	}
+	InternEntry &added = entry(id);
+	added.text   = nameArena.copyString(text, length);
+	added.length = length;
+	added.hash   = hash;
+
+	count.store(id + 1, std::memory_order_release);
+	table->ids[i].store(id, std::memory_order_release);
+
+	if ((size_t)(id + 1) * 2 > table->mask + 1) {
+		grow(table);
+	}
+	return id;
+} /* InternTable::intern */
+
+/**********************************************************************/
+NameId InternTable::intern(const char *text)
+{
+	return intern(text, strlen(text));
+} /* InternTable::intern */
+
+/**********************************************************************/
+const char *InternTable::name(NameId id)
+{
+	return id < count.load(std::memory_order_acquire) && id != NO_NAME ? entry(id).text : "";
+} /* InternTable::name */
+
+/**********************************************************************/
+size_t InternTable::size()
+{
+	return count.load(std::memory_order_acquire) - 1;
+} /* InternTable::size */
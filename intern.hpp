@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+
+/*!
+ * \file intern.hpp
+ * \brief One copy of every identifier, addressed by a small integer.
+ */
+
+typedef uint32_t NameId;
+
+enum { NO_NAME = 0 }; /*!< The NameId of tokens that are not identifiers */
+
+/**
+ * An InternTable class.
+ * Maps each distinct identifier to a NameId the first time the Lexer
+ * sees it. Pascal ignores case, so "Count" and "COUNT" get the same id;
+ * the table keeps the spelling it saw first. Names are never removed and
+ * the ids stay valid until the program exits, so the AST and the symbol
+ * tables compare names as integers and never copy them.
+ * The table is shared by all threads. In a batch the spelling kept is
+ * the first any program used, so what a program prints comes from its
+ * own declarations instead (VarSymbol::spelling()).
+ */
+class InternTable
+{
+	public:
+		static NameId intern(const char *text, size_t length);
+		static NameId intern(const char *text);
+
+		static const char *name(NameId id);
+		static size_t size();
+	private:
+		InternTable();
+}; /* InternTable */
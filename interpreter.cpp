@@ -3,13 +3,19 @@
 #include <cassert>
 #include <sstream>
 #include <cstdlib>
+#include <cstdarg>
 #include <map>
+#include <type_traits>
+#include <charconv>
+#include <algorithm>
+#include <atomic>
 
 #include "interpreter.hpp"
+#include "vm.hpp"
 #include "clog.hpp"
-
-ScopedSymbolTable *SemanticAnalyzer::scope_        = NULL;
-ScopedSymbolTable *SemanticAnalyzer::currentScope_ = NULL;
+#include "trace.hpp"
+#include "pool.hpp"
+#include "error.hpp"
 
 /*!
  * \file token.cpp
@@ -27,7 +33,7 @@ ScopedSymbolTable *SemanticAnalyzer::currentScope_ = NULL;
 /**********************************************************************/
 /*!
  * fn void Parser::raiseParseError()
- * \brief Raise assertion when error occurs while parsing
+ * \brief Reports an error while parsing and stops, see programError()
  */
 void Parser::raiseError(const TokenType &tokType)
 {
@@ -35,20 +41,64 @@ void Parser::raiseError(const TokenType &tokType)
 	CLog::write(CLog::RELEASE, "Expected ---> %s\n", getTokenTypeLabel(tokType).c_str());
 	CLog::write(CLog::RELEASE, "Got      --->  %s\n\n", currentToken_.representation().c_str());
 
-	assert(false);
+	programError();
 } /* Parser::raiseError */
 
 /**********************************************************************/
-Node *Parser::parse()
+/*!
+ * fn Program *Parser::parse()
+ * \brief Parses the whole program into a tree kept in a new Arena.
+ * The arena is handed over to the returned Program. The tokens in the
+ * tree are views of the source text, which must outlive the Program.
+ */
+Program *Parser::parse()
 {
-	CLog::write(CLog::DEBUG, "parse()\n");
-	Node *node = program();
+	TRACE(TRACE_PARSER, "parse()\n");
+	arena_ = new Arena();
+	index_ = 0;
+	tokensRead_ = 0;
+	currentToken_ = nextToken();
+
+	Program *node = program();
 	if (currentToken_.type() != T_EOF) {
 		raiseError(currentToken_.type());
 	}
+
+	node->setArena(arena_);
+	arena_ = NULL;
 	return node;
 } /* Parser::parse */
 
+/**********************************************************************/
+/*!
+ * fn Program *Parser::parseInput()
+ * \brief Parses one input of a Repl: declarations, then statements,
+ * without the PROGRAM heading or the BEGIN and END of a program.
+ * input : declarations statementList
+ * The tree is kept in a new Arena, as by parse().
+ */
+Program *Parser::parseInput()
+{
+	TRACE(TRACE_PARSER, "parseInput()\n");
+	arena_ = new Arena(1024); /* An input is a line or two; blocks double if not */
+	index_ = 0;
+	tokensRead_ = 0;
+	currentToken_ = nextToken();
+
+	std::vector<Node *> declarationNodes = declarations();
+	std::vector<Node *> statements = statementList();
+	if (currentToken_.type() != T_EOF) {
+		raiseError(T_EOF);
+	}
+
+	Compound *comp = new (*arena_) Compound(*arena_, statements);
+	Block *block = new (*arena_) Block(*arena_, declarationNodes, comp);
+	Program *node = new (*arena_) Program(Token(T_PASC_ID, "input"), block);
+	node->setArena(arena_);
+	arena_ = NULL;
+	return node;
+} /* Parser::parseInput */
+
 /**********************************************************************/
 /*!
  * fn void Parser::eat()
@@ -60,13 +110,53 @@ Node *Parser::parse()
 void Parser::eat(const TokenType &tokType)
 {
 	if (currentToken_.type() == tokType) {
-		currentToken_ = lexer_.getNextToken();
-		CLog::write(CLog::DEBUG, "%s\n", currentToken_.representation().c_str());
+		currentToken_ = nextToken();
+		TRACE(TRACE_PARSER, "%s\n", currentToken_.representation().c_str());
 	} else {
 		raiseError(tokType);
 	}
 } /* Parser::eat */
 
+/**********************************************************************/
+/*!
+ * fn Token Parser::nextToken()
+ * \brief The token after the current one, from the TokenBuffer if there
+ * is one, otherwise from the Lexer.
+ */
+Token Parser::nextToken()
+{
+	tokensRead_++;
+	if (tokens_) {
+		if (index_ < tokens_->size()) {
+			return tokens_->at(index_++);
+		}
+		return tokens_->at(tokens_->size() - 1); /* T_EOF */
+	}
+	return lexer_.getNextToken();
+} /* Parser::nextToken */
+
+/**********************************************************************/
+/*!
+ * fn Token Parser::peekToken(size_t distance)
+ * \brief Looks ahead without consuming anything. peekToken(1) is the
+ * token right after currentToken_.
+ */
+Token Parser::peekToken(size_t distance)
+{
+	if (tokens_) {
+		size_t i = index_ + distance - 1;
+		return tokens_->at(i < tokens_->size() ? i : tokens_->size() - 1);
+	}
+
+	/* A Lexer is only a position in the text: lex ahead on a copy */
+	Lexer ahead = lexer_;
+	Token tok = currentToken_;
+	for (size_t i = 0; i < distance; i++) {
+		tok = ahead.getNextToken();
+	}
+	return tok;
+} /* Parser::peekToken */
+
 /**********************************************************************/
 /*!
  * fn void Interpeter::expr()
@@ -77,10 +167,10 @@ void Parser::eat(const TokenType &tokType)
  */
 TokenNode *Parser::expr()
 {
-	CLog::write(CLog::DEBUG, "Parser::expr()\n");
+	TRACE(TRACE_PARSER, "Parser::expr()\n");
 	TokenNode *node = term();
 
-	CLog::write(CLog::DEBUG, "expr() 2\n");
+	TRACE(TRACE_PARSER, "expr() 2\n");
 	while (currentToken_.isOperatorFirstPrecedence()) {
 		Token tok = currentToken_;
 		if (tok.type() == T_PLUS) {
@@ -88,8 +178,8 @@ TokenNode *Parser::expr()
 		} else if (tok.type() == T_MINUS) {
 			eat(T_MINUS);
 		}
-		CLog::write(CLog::DEBUG, "Parser::expr() before BinOp First precedence\n");
-		node = new BinOp(node, tok, term());
+		TRACE(TRACE_PARSER, "Parser::expr() before BinOp First precedence\n");
+		node = new (*arena_) BinOp(node, tok, term());
 	}
 	return node;
 } /* Parser::expr */
@@ -101,30 +191,30 @@ TokenNode *Parser::expr()
  * 		   | T_MINUS factor
  * 		   | T_INTEGER
  * 		   | T_REAL
- * 		   | T_LPAREN expr T_RPAREN
+ * 		   | T_LPAREN condition T_RPAREN
  * 		   | variable
  * \return An T_INTEGER token value
  */
 TokenNode *Parser::factor()
 {
-	CLog::write(CLog::DEBUG, "Parser::factor()\n");
+	TRACE(TRACE_PARSER, "Parser::factor()\n");
 	Token tok = currentToken_;
 
 	if (tok.type() == T_PLUS) {
 		eat(T_PLUS);
-		return new UnaryOp(tok, factor());
+		return new (*arena_) UnaryOp(tok, factor());
 	} else if (tok.type() == T_MINUS) {
 		eat(T_MINUS);
-		return new UnaryOp(tok, factor());
+		return new (*arena_) UnaryOp(tok, factor());
 	} else if (tok.type() == T_INTEGER) {
 		eat(T_INTEGER);
-		return new Number(tok);
+		return new (*arena_) Number(tok);
 	} else if (tok.type() == T_REAL) {
 		eat(T_REAL);
-		return new Number(tok);
+		return new (*arena_) Number(tok);
 	} else if (tok.type() == T_LPAREN) {
 		eat(T_LPAREN);
-		TokenNode *node = expr();
+		TokenNode *node = condition();
 		eat(T_RPAREN);
 		return node;
 	} else {
@@ -141,15 +231,15 @@ TokenNode *Parser::factor()
  */
 Program *Parser::program()
 {
-	CLog::write(CLog::DEBUG, "program()\n"); 
+	TRACE(TRACE_PARSER, "program()\n"); 
 	eat(T_PASC_PROGRAM_RESERV);
 	Var *varNode = variable();
-	std::string progName = varNode->getValue();
-	CLog::write(CLog::DEBUG, "program name %s\n", progName.c_str()); 
+	Token progName = varNode->getToken();
+	TRACE(TRACE_PARSER, "program name %s\n", progName.value().c_str()); 
 	eat(T_SEMI);
 
 	Block *blockNode = block();
-	Program *progNode = new Program(progName, blockNode);
+	Program *progNode = new (*arena_) Program(progName, blockNode);
 	eat(T_PASC_DOT_RESERV);
 
 	return progNode;
@@ -163,14 +253,14 @@ Program *Parser::program()
  */
 std::vector<Node *> Parser::statementList()
 {
-	CLog::write(CLog::DEBUG, "statementList():\n"); 
+	TRACE(TRACE_PARSER, "statementList():\n"); 
 	Node *node = statement();
 
 	std::vector<Node *> results;
 
-	CLog::write(CLog::DEBUG, "\t currentToken_ %s\n", currentToken_.representation().c_str());
+	TRACE(TRACE_PARSER, "\t currentToken_ %s\n", currentToken_.representation().c_str());
 	results.push_back(node);
-	CLog::write(CLog::DEBUG, "\nstatementList(): statementsnum %d\n", results.size()); 
+	TRACE(TRACE_PARSER, "\nstatementList(): statementsnum %zu\n", results.size()); 
 
 	while (currentToken_.type() == T_SEMI) {
 		eat(T_SEMI);
@@ -181,24 +271,33 @@ std::vector<Node *> Parser::statementList()
 		raiseError(currentToken_.type());
 	}
 
-	CLog::write(CLog::DEBUG, "statementList() results.size() --> %d\n", results.size());
+	TRACE(TRACE_PARSER, "statementList() results.size() --> %zu\n", results.size());
 	return results;
 } /* Parser::statementList */
 
 /**********************************************************************/
 /*!
  * fn Node *Parser::statement()
- * \brief : statement : compoundStatement | assigmentStatement | empty
+ * \brief : statement : compoundStatement | ifStatement | whileStatement | forStatement
+ * 		     | procedureCallStatement | assigmentStatement | empty
  * \return Node *
  */
 Node *Parser::statement()
 {
-	CLog::write(CLog::DEBUG, "statement()\n"); 
-	CLog::write(CLog::DEBUG, "\t currentToken_ %s\n", currentToken_.representation().c_str());
+	TRACE(TRACE_PARSER, "statement()\n"); 
+	TRACE(TRACE_PARSER, "\t currentToken_ %s\n", currentToken_.representation().c_str());
 	Node *node = NULL;
 
 	if (currentToken_.type() == T_PASC_BEGIN_RESERV) {
 		node = compoundStatement();
+	} else if (currentToken_.type() == T_PASC_IF_RESERV) {
+		node = ifStatement();
+	} else if (currentToken_.type() == T_PASC_WHILE_RESERV) {
+		node = whileStatement();
+	} else if (currentToken_.type() == T_PASC_FOR_RESERV) {
+		node = forStatement();
+	} else if (currentToken_.type() == T_PASC_ID && peekToken(1).type() != T_PASC_ASSIGN) {
+		node = procedureCallStatement();
 	} else if (currentToken_.type() == T_PASC_ID) {
 		node = assignmentStatement();
 	} else {
@@ -215,18 +314,128 @@ Node *Parser::statement()
  */
 Assign *Parser::assignmentStatement()
 {
-	CLog::write(CLog::DEBUG, "assignmentStatement\n"); 
-	TokenNode *lhs = variable();
+	TRACE(TRACE_PARSER, "assignmentStatement\n"); 
+	Var *lhs = variable();
 	Token tok = currentToken_;
 
 	eat(T_PASC_ASSIGN);
 
 	Node *rhs = expr();
-	Assign *node = new Assign(lhs, tok, rhs);
+	Assign *node = new (*arena_) Assign(lhs, tok, rhs);
 
 	return node;
 } /* Parser::assignmentStatement */
 
+/**********************************************************************/
+/*!
+ * fn ProcedureCall *Parser::procedureCallStatement()
+ * \brief : procedureCallStatement : T_PASC_ID (T_LPAREN (expr (T_COMMA expr)*)? T_RPAREN)?
+ * \return ProcedureCall *
+ */
+ProcedureCall *Parser::procedureCallStatement()
+{
+	TRACE(TRACE_PARSER, "procedureCallStatement\n");
+	Token procName = currentToken_;
+	eat(T_PASC_ID);
+
+	std::vector<Node *> args;
+	if (currentToken_.type() == T_LPAREN) {
+		eat(T_LPAREN);
+		if (currentToken_.type() != T_RPAREN) {
+			args.push_back(expr());
+			while (currentToken_.type() == T_COMMA) {
+				eat(T_COMMA);
+				args.push_back(expr());
+			}
+		}
+		eat(T_RPAREN);
+	}
+	return new (*arena_) ProcedureCall(*arena_, procName, args);
+} /* Parser::procedureCallStatement */
+
+/**********************************************************************/
+/*!
+ * fn If *Parser::ifStatement()
+ * \brief : ifStatement : T_PASC_IF condition T_PASC_THEN statement (T_PASC_ELSE statement)?
+ * An ELSE belongs to the nearest IF.
+ * \return If *
+ */
+If *Parser::ifStatement()
+{
+	TRACE(TRACE_PARSER, "ifStatement\n");
+	eat(T_PASC_IF_RESERV);
+	Node *cond = condition();
+	eat(T_PASC_THEN_RESERV);
+	Node *thenStatement = statement();
+
+	Node *elseStatement = NULL;
+	if (currentToken_.type() == T_PASC_ELSE_RESERV) {
+		eat(T_PASC_ELSE_RESERV);
+		elseStatement = statement();
+	}
+	return new (*arena_) If(cond, thenStatement, elseStatement);
+} /* Parser::ifStatement */
+
+/**********************************************************************/
+/*!
+ * fn While *Parser::whileStatement()
+ * \brief : whileStatement : T_PASC_WHILE condition T_PASC_DO statement
+ * \return While *
+ */
+While *Parser::whileStatement()
+{
+	TRACE(TRACE_PARSER, "whileStatement\n");
+	eat(T_PASC_WHILE_RESERV);
+	Node *cond = condition();
+	eat(T_PASC_DO_RESERV);
+	Node *body = statement();
+	return new (*arena_) While(cond, body);
+} /* Parser::whileStatement */
+
+/**********************************************************************/
+/*!
+ * fn For *Parser::forStatement()
+ * \brief : forStatement : T_PASC_FOR variable T_PASC_ASSIGN expr (T_PASC_TO | T_PASC_DOWNTO) expr T_PASC_DO statement
+ * \return For *
+ */
+For *Parser::forStatement()
+{
+	TRACE(TRACE_PARSER, "forStatement\n");
+	eat(T_PASC_FOR_RESERV);
+	Var *var = variable();
+	eat(T_PASC_ASSIGN);
+	Node *start = expr();
+
+	bool down = currentToken_.type() == T_PASC_DOWNTO_RESERV;
+	eat(down ? T_PASC_DOWNTO_RESERV : T_PASC_TO_RESERV);
+	Node *bound = expr();
+
+	eat(T_PASC_DO_RESERV);
+	Node *body = statement();
+	return new (*arena_) For(var, start, bound, down, body);
+} /* Parser::forStatement */
+
+/**********************************************************************/
+/*!
+ * fn TokenNode *Parser::condition()
+ * \brief : condition : expr ((T_EQUAL | T_NOT_EQUAL | T_LESS | T_LESS_EQUAL
+ * 				| T_GREATER | T_GREATER_EQUAL) expr)?
+ * A lone expr is accepted here and rejected by the SemanticAnalyzer
+ * unless it is a parenthesized comparison.
+ * \return TokenNode *
+ */
+TokenNode *Parser::condition()
+{
+	TRACE(TRACE_PARSER, "condition\n");
+	TokenNode *node = expr();
+	if (currentToken_.isRelationalOperator()) {
+		Token tok = currentToken_;
+		eat(tok.type());
+		node = new (*arena_) BinOp(node, tok, expr());
+	}
+	return node;
+} /* Parser::condition */
+
 /**********************************************************************/
 /*!
  * fn Node *Parser::variable()
@@ -235,10 +444,10 @@ Assign *Parser::assignmentStatement()
  */
 Var *Parser::variable()
 {
-	CLog::write(CLog::DEBUG, "VARIABLE node: %s\n", currentToken_.representation().c_str()); 
-	Var *node = new Var(currentToken_);
+	TRACE(TRACE_PARSER, "VARIABLE node: %s\n", currentToken_.representation().c_str()); 
+	Var *node = new (*arena_) Var(currentToken_);
 	eat(T_PASC_ID);
-	CLog::write(CLog::DEBUG, "\t variable %s\n", currentToken_.representation().c_str());
+	TRACE(TRACE_PARSER, "\t variable %s\n", currentToken_.representation().c_str());
 
 	return node;
 } /* Parser::variable */
@@ -251,7 +460,7 @@ Var *Parser::variable()
  */
 NoOp *Parser::empty()
 {
-	return new NoOp();
+	return new (*arena_) NoOp();
 } /* Parser::empty */
 
 /**********************************************************************/
@@ -262,12 +471,12 @@ NoOp *Parser::empty()
  */
 Block* Parser::block()
 {
-	CLog::write(CLog::DEBUG, "block: %s\n", currentToken_.representation().c_str()); 
+	TRACE(TRACE_PARSER, "block: %s\n", currentToken_.representation().c_str()); 
 	std::vector<Node *>declarationNodes = declarations();
 	Compound *comp = compoundStatement();
-	Block *node = new Block(declarationNodes, comp);
+	Block *node = new (*arena_) Block(*arena_, declarationNodes, comp);
 
-	CLog::write(CLog::DEBUG, "END OF BLOCK NODE Creator: %s\n", currentToken_.representation().c_str()); 
+	TRACE(TRACE_PARSER, "END OF BLOCK NODE Creator: %s\n", currentToken_.representation().c_str()); 
 	return node;
 } /* Parser::block */
 
@@ -292,7 +501,7 @@ std::vector<Node *> Parser::declarations()
 			}
 		} else if (currentToken_.type() == T_PASC_PROCEDURE) {
 			eat(T_PASC_PROCEDURE);
-			std::string procName = currentToken_.value();
+			Token procName = currentToken_;
 			eat(T_PASC_ID);
 			
 			std::vector<Param *> params;
@@ -304,7 +513,7 @@ std::vector<Node *> Parser::declarations()
 
 			eat(T_SEMI);
 			Block *b_node = block();
-			ProcedureDecl *procDecl = new ProcedureDecl(procName, params, b_node);
+			ProcedureDecl *procDecl = new (*arena_) ProcedureDecl(*arena_, procName, params, b_node);
 			declarations.push_back(procDecl);
 			eat(T_SEMI);
 		} else {
@@ -361,7 +570,7 @@ std::vector<Param *> Parser::formalParameters()
 	std::vector<Token>::iterator it;
 	for (it = paramTokens.begin(); it != paramTokens.end(); it++)
 	{
-		Param *param = new Param(new Var(*it), type_n); 
+		Param *param = new (*arena_) Param(new (*arena_) Var(*it), type_n); 
 		params.push_back(param);
 	}
 	return params;
@@ -375,15 +584,15 @@ std::vector<Param *> Parser::formalParameters()
  */
  std::vector<VarDecl *> Parser::variableDeclaration()
 {
-	CLog::write(CLog::DEBUG, "variableDeclaration Beginning: %s\n", currentToken_.representation().c_str()); 
-	Var *var = new Var(currentToken_);
+	TRACE(TRACE_PARSER, "variableDeclaration Beginning: %s\n", currentToken_.representation().c_str()); 
+	Var *var = new (*arena_) Var(currentToken_);
 	std::vector<Var *> varNodes;
 	varNodes.push_back(var);
 	eat(T_PASC_ID);
 	
 	while (currentToken_.type() == T_COMMA) {
 		eat(T_COMMA);
-		Var *var = new Var(currentToken_);
+		Var *var = new (*arena_) Var(currentToken_);
 		varNodes.push_back(var);
 		eat(T_PASC_ID);
 	}
@@ -393,11 +602,11 @@ std::vector<Param *> Parser::formalParameters()
 	std::vector<VarDecl *> varDeclarations;
 	std::vector<Var *>::iterator it;
 	for ( it = varNodes.begin(); it != varNodes.end(); it++) {
-		VarDecl *vd = new VarDecl(*it, node);
+		VarDecl *vd = new (*arena_) VarDecl(*it, node);
 		varDeclarations.push_back(vd);
 	}
 
-	CLog::write(CLog::DEBUG, "variableDeclaration End: %s\n", currentToken_.representation().c_str()); 
+	TRACE(TRACE_PARSER, "variableDeclaration End: %s\n", currentToken_.representation().c_str()); 
 	return varDeclarations;
 } /* Parser::variableDeclaration */
 
@@ -409,7 +618,7 @@ std::vector<Param *> Parser::formalParameters()
  */
 Type *Parser::typeSpec()
 {
-	CLog::write(CLog::DEBUG, "typeSpec Start! %s\n", currentToken_.representation().c_str()); 
+	TRACE(TRACE_PARSER, "typeSpec Start! %s\n", currentToken_.representation().c_str()); 
 	Token tok = currentToken_;
 	if (currentToken_.type() == T_PASC_INTEGER_RESERV) {
 		eat(T_PASC_INTEGER_RESERV);
@@ -418,7 +627,7 @@ Type *Parser::typeSpec()
 	} else {
 		assert(false);
 	}
-	Type *node = new Type(tok);
+	Type *node = new (*arena_) Type(tok);
 	return node;
 } /* Parser::typeSpec */
 
@@ -430,7 +639,7 @@ Type *Parser::typeSpec()
  */
 TokenNode *Parser::term()
 {
-	CLog::write(CLog::DEBUG, "Parser::term()\n");
+	TRACE(TRACE_PARSER, "Parser::term()\n");
 	TokenNode *node = factor();
 
 	while (currentToken_.isOperatorSecondPrecedence()) {
@@ -442,9 +651,9 @@ TokenNode *Parser::term()
 		} else if (tok.type() == T_PASC_INT_DIV_RESERV) {
 			eat(T_PASC_INT_DIV_RESERV);
 		}
-		CLog::write(CLog::DEBUG, "Parser::term() before BinOp\n");
-		node = new BinOp(node, tok, factor());
-		CLog::write(CLog::DEBUG, "Parser::term() BinOp is %p\n", node);
+		TRACE(TRACE_PARSER, "Parser::term() before BinOp\n");
+		node = new (*arena_) BinOp(node, tok, factor());
+		TRACE(TRACE_PARSER, "Parser::term() BinOp is %p\n", node);
 	}
 	return node;
 } /* Parser::term */
@@ -463,16 +672,6 @@ TokenNode *Parser::term()
 
 
 
-/*!
- * fn void Compound::addNode(Node *node)
- * \brief : Adds a node to children_
- */
-void Compound::addNode(Node *node)
-{
-       	children_.push_back(node);
-}
-
-/**********************************************************************/
 /*fn Node *Parser::compoundStatement()
  * \brief : BEGIN statementList END
  * \return Node *
@@ -483,11 +682,7 @@ Compound *Parser::compoundStatement()
 	std::vector<Node *> nodes = statementList();
 	eat(T_PASC_END_RESERV);
 
-	Compound *root = new Compound();
-	std::vector<Node *>::const_iterator it;
-	for (it = nodes.begin(); it != nodes.end(); it++) {
-		root->addNode(*it);
-	}
+	Compound *root = new (*arena_) Compound(*arena_, nodes);
 	return root;
 }
 
@@ -612,6 +807,54 @@ void ProcedureDecl::visitASTPresenter(int ind)
 	}
 } /* ProcedureDecl::visitASTPresenter */
 
+/**********************************************************************/
+void ProcedureCall::visitASTPresenter(int ind)
+{
+	ind += 5;
+	std::string indent_s(ind, ' ');
+	CLog::write(CLog::RELEASE, "%sProcedureCall %s with %zu arguments\n", indent_s.c_str(), this->getName().c_str(), this->size());
+
+	ProcedureCall::iterator it;
+	for (it = this->begin(); it != this->end(); it++) {
+		(*it)->visitASTPresenter(ind);
+	}
+} /* ProcedureCall::visitASTPresenter */
+
+/**********************************************************************/
+void If::visitASTPresenter(int ind)
+{
+	ind += 5;
+	std::string indent_s(ind, ' ');
+	CLog::write(CLog::RELEASE, "%sIf Node with a condition, a THEN%s\n", indent_s.c_str(), else_ ? " and an ELSE" : "");
+	condition_->visitASTPresenter(ind);
+	then_->visitASTPresenter(ind);
+	if (else_) {
+		else_->visitASTPresenter(ind);
+	}
+} /* If::visitASTPresenter */
+
+/**********************************************************************/
+void While::visitASTPresenter(int ind)
+{
+	ind += 5;
+	std::string indent_s(ind, ' ');
+	CLog::write(CLog::RELEASE, "%sWhile Node with a condition and a body\n", indent_s.c_str());
+	condition_->visitASTPresenter(ind);
+	body_->visitASTPresenter(ind);
+} /* While::visitASTPresenter */
+
+/**********************************************************************/
+void For::visitASTPresenter(int ind)
+{
+	ind += 5;
+	std::string indent_s(ind, ' ');
+	CLog::write(CLog::RELEASE, "%sFor Node %s with a counter, two bounds and a body\n", indent_s.c_str(), down_ ? "DOWNTO" : "TO");
+	var_->visitASTPresenter(ind);
+	start_->visitASTPresenter(ind);
+	bound_->visitASTPresenter(ind);
+	body_->visitASTPresenter(ind);
+} /* For::visitASTPresenter */
+
 /**********************************************************************/
 void Param::visitASTPresenter(int ind)
 {
@@ -636,144 +879,525 @@ void Number::visitASTPresenter(int ind)
 /**********************************************************************/
 /**********************************************************************/
 /**********************************************************************/
-void ProcedureDecl::visitSemanticAnalyzer()
+/*!
+ * \brief Reports an error in the program and stops, see programError()
+ */
+[[noreturn]] static void semanticError(const char *format, ...)
 {
-	std::string procName = this->getName();
-	ProcedureSymbol *procSymbol = new ProcedureSymbol(procName);
-	SemanticAnalyzer::currentScope_->define(procSymbol);
+	va_list args;
+	va_start(args, format);
+	CLog::vwrite(CLog::RELEASE, format, args);
+	va_end(args);
+	programError();
+} /* semanticError */
 
-	CLog::write(CLog::RELEASE, "Enter scope: %s\n", procName.c_str());
+/**********************************************************************/
+/*!
+ * \brief The BuiltinTypeSymbol named by a Type node
+ */
+static BuiltinTypeSymbol *lookupType(SemanticAnalyzer &analyzer, Type *type)
+{
+	std::string typeName = type->getValue();
+	BuiltinTypeSymbol *typeSymbol = dynamic_cast<BuiltinTypeSymbol *>(analyzer.lookup(InternTable::intern(typeName.c_str(), typeName.size())));
+	if (!typeSymbol) {
+		semanticError("Error: %s is not a type!\n", typeName.c_str());
+	}
+	return typeSymbol;
+} /* lookupType */
 
-	/* Scope for parameters and local variables */
-	ScopedSymbolTable *procedureScope = new ScopedSymbolTable(procName, SemanticAnalyzer::currentScope_->getLevel() + 1, SemanticAnalyzer::currentScope_);
+/**********************************************************************/
+/*!
+ * fn void ProcedureDecl::declare(SemanticAnalyzer &analyzer)
+ * \brief Defines the procedure in the scope of analyzer and makes its
+ * own scope, with the parameters in it
+ */
+void ProcedureDecl::declare(SemanticAnalyzer &analyzer)
+{
+	std::string procName = this->getName();
+	if (analyzer.lookup(this->getId(), true)) {
+		semanticError("Error: Duplicate identifier %s found\n", procName.c_str());
+	}
 
-	SemanticAnalyzer::currentScope_ = procedureScope;
+	/* Scope for parameters and local variables, owned by the symbol */
+	scope_ = new ScopedSymbolTable(procName, analyzer.getScope()->getLevel() + 1, analyzer.getScope());
+	ProcedureSymbol *procSymbol = new ProcedureSymbol(this->getId(), this, scope_);
+	analyzer.getScope()->define(procSymbol);
 
 	/* Insert parameters into the procedure scope */
 	ProcedureDecl::iterator it;
 
 	for (it = this->begin(); it != this->end(); it++) {
-		Symbol *paramType = SemanticAnalyzer::currentScope_->lookup((*it)->getType()->getValue());
-		std::string paramName = (*it)->getVar()->getValue();
-		VarSymbol *varSymbol = new VarSymbol(paramName, paramType);
-		SemanticAnalyzer::currentScope_->define(varSymbol);
+		BuiltinTypeSymbol *paramType = lookupType(analyzer, (*it)->getType());
+		if (scope_->lookup((*it)->getVar()->getId(), true)) {
+			semanticError("Error: Duplicate identifier %s found\n", (*it)->getVar()->getValue().c_str());
+		}
+		VarSymbol *varSymbol = new VarSymbol((*it)->getVar()->getId(), paramType, (*it)->getVar()->getValue());
+		scope_->define(varSymbol);
+		(*it)->getVar()->bind(varSymbol);
 		procSymbol->add(varSymbol);
 	}
+} /* ProcedureDecl::declare */
 
-	this->getBlock()->visitSemanticAnalyzer();
-	SemanticAnalyzer::currentScope_ = SemanticAnalyzer::currentScope_->getEnclosingScope();
-	CLog::write(CLog::RELEASE, "Leave scope: %s\n", procName.c_str());
+/**********************************************************************/
+/*!
+ * fn void ProcedureDecl::analyzeBody(SemanticAnalyzer &analyzer)
+ * \brief Analyses the block in the scope declare() made
+ */
+void ProcedureDecl::analyzeBody(SemanticAnalyzer &analyzer)
+{
+	CLog::write(CLog::RELEASE, "Enter scope: %s\n", getName().c_str());
+	analyzer.setScope(scope_);
+	this->getBlock()->visitSemanticAnalyzer(analyzer);
+	analyzer.setScope(scope_->getEnclosingScope());
+	CLog::write(CLog::RELEASE, "Leave scope: %s\n", getName().c_str());
+} /* ProcedureDecl::analyzeBody */
+
+/**********************************************************************/
+void ProcedureDecl::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
+{
+	declare(analyzer);
+	analyzeBody(analyzer);
 } /* ProcedureDecl::visitSemanticAnalyzer */
 
 /**********************************************************************/
-void BinOp::visitSemanticAnalyzer()
+/*!
+ * fn void SemanticAnalyzer::analyzeProcedures(Node **procedures, size_t count)
+ * \brief Analyses count sibling ProcedureDecls on the TaskPool. They are
+ * all declared first, in order, up to the first that is in error. Then
+ * the bodies before it are analysed, each as in a serial run, right
+ * after its own declaration, by an analyser of its own: a Horizon hides
+ * the siblings declared after it. The messages of each body are
+ * captured, and an error ends only its own body. The messages are then
+ * written in order up to the first error, of a body or of the
+ * declaration after them, which stops the analysis. So the output is
+ * that of a serial run too.
+ */
+void SemanticAnalyzer::analyzeProcedures(Node **procedures, size_t count)
 {
-	this->getLhs()->visitSemanticAnalyzer();
-	this->getRhs()->visitSemanticAnalyzer();
+	std::vector<size_t> limits(count);
+	std::string declarationLog;
+	size_t declared = 0;
+	{
+		ErrorTrap trap;
+		std::string *savedLog = CLog::capture(&declarationLog);
+		try {
+			for (; declared < count; declared++) {
+				static_cast<ProcedureDecl *>(procedures[declared])->declare(*this);
+				limits[declared] = currentScope_->symbolCount();
+			}
+		} catch (const ProgramError &) {
+		}
+		CLog::capture(savedLog);
+	}
+
+	std::vector<std::string> logs(declared);
+	std::atomic<size_t> firstError(declared);
+	int level = CLog::level();
+	TaskPool::instance().run(declared, [&](size_t i) {
+		if (i > firstError.load()) {
+			return; /* Its messages would not be written */
+		}
+		SemanticAnalyzer body;
+		body.currentScope_ = currentScope_;
+		body.horizons_ = horizons_;
+		Horizon horizon = { currentScope_, limits[i] };
+		body.horizons_.push_back(horizon);
+
+		/* The thread may be waiting in the middle of another body */
+		ErrorTrap trap;
+		std::string *savedLog = CLog::capture(&logs[i]);
+		int savedLevel = CLog::setThreadLevel(level);
+		try {
+			static_cast<ProcedureDecl *>(procedures[i])->analyzeBody(body);
+		} catch (const ProgramError &) {
+			for (size_t first = firstError.load(); i < first && !firstError.compare_exchange_weak(first, i); ) {
+			}
+		}
+		CLog::setThreadLevel(savedLevel);
+		CLog::capture(savedLog);
+	});
+
+	for (size_t i = 0; i < declared && i <= firstError; i++) {
+		CLog::write(CLog::RELEASE, "%s", logs[i].c_str());
+	}
+	if (firstError < declared) {
+		programError();
+	}
+	if (declared < count) {
+		CLog::write(CLog::RELEASE, "%s", declarationLog.c_str());
+		programError();
+	}
+} /* SemanticAnalyzer::analyzeProcedures */
+
+/**********************************************************************/
+/*!
+ * fn Symbol *SemanticAnalyzer::lookup(NameId id, bool currentScopeOnly)
+ * \brief The symbol named id, searched from the scope being analysed
+ * outwards, among those this analyser can see
+ */
+Symbol *SemanticAnalyzer::lookup(NameId id, bool currentScopeOnly)
+{
+	TRACE(TRACE_SEMA, "Lookup: %s\n", InternTable::name(id));
+
+	for (ScopedSymbolTable *scope = currentScope_; scope; scope = scope->getEnclosingScope()) {
+		Symbol *symbol = scope->find(id);
+		if (symbol && !visible(scope, symbol)) {
+			symbol = NULL;
+		}
+		if (symbol || currentScopeOnly) {
+			return symbol;
+		}
+	}
+	return NULL;
+} /* SemanticAnalyzer::lookup */
+
+/**********************************************************************/
+/*!
+ * fn bool SemanticAnalyzer::visible(ScopedSymbolTable *scope, Symbol *symbol)
+ * \brief Whether the body being analysed can see symbol of scope. It
+ * can see all of them in a serial run.
+ */
+bool SemanticAnalyzer::visible(ScopedSymbolTable *scope, Symbol *symbol)
+{
+	for (size_t i = 0; i < horizons_.size(); i++) {
+		if (horizons_[i].scope == scope) {
+			return symbol->order() < horizons_[i].order;
+		}
+	}
+	return true;
+} /* SemanticAnalyzer::visible */
+
+/**********************************************************************/
+/*!
+ * \brief The kernel of a BinOp whose operands have the given types
+ */
+static Kernel selectKernel(TokenType op, SymbolType lhs, SymbolType rhs)
+{
+	static const Kernel kernels[4][10] = {
+		/*             T_PLUS    T_MINUS   T_MUL     T_DIV     =        <>       <        <=       >        >=      */
+		/* II */     { K_ADD_II, K_SUB_II, K_MUL_II, K_DIV_II, K_EQ_II, K_NE_II, K_LT_II, K_LE_II, K_GT_II, K_GE_II },
+		/* IR */     { K_ADD_IR, K_SUB_IR, K_MUL_IR, K_DIV_IR, K_EQ_IR, K_NE_IR, K_LT_IR, K_LE_IR, K_GT_IR, K_GE_IR },
+		/* RI */     { K_ADD_RI, K_SUB_RI, K_MUL_RI, K_DIV_RI, K_EQ_RI, K_NE_RI, K_LT_RI, K_LE_RI, K_GT_RI, K_GE_RI },
+		/* RR */     { K_ADD_RR, K_SUB_RR, K_MUL_RR, K_DIV_RR, K_EQ_RR, K_NE_RR, K_LT_RR, K_LE_RR, K_GT_RR, K_GE_RR },
+	};
+
+	int column;
+	switch (op)
+	{
+		case T_PLUS : column = 0; break;
+		case T_MINUS: column = 1; break;
+		case T_MUL  : column = 2; break;
+		case T_DIV  : column = 3; break;
+		case T_EQUAL        : column = 4; break;
+		case T_NOT_EQUAL    : column = 5; break;
+		case T_LESS         : column = 6; break;
+		case T_LESS_EQUAL   : column = 7; break;
+		case T_GREATER      : column = 8; break;
+		case T_GREATER_EQUAL: column = 9; break;
+		case T_PASC_INT_DIV_RESERV: return K_INT_DIV_II;
+		default:
+			semanticError("Error: Unknown operator %s!\n", getTokenTypeLabel(op).c_str());
+	}
+	return kernels[(lhs == REAL) * 2 + (rhs == REAL)][column];
+} /* selectKernel */
+
+/**********************************************************************/
+/*!
+ * \brief Aborts if node is a comparison: only conditions can use one
+ */
+static void expectNumber(Node *node, const char *what)
+{
+	if (node->valueType() == BOOLEAN) {
+		semanticError("Error: A comparison can not be %s!\n", what);
+	}
+} /* expectNumber */
+
+/**********************************************************************/
+/*!
+ * \brief Aborts unless node, the condition of statement, is a comparison
+ */
+static void expectCondition(Node *node, const char *statement)
+{
+	if (node->valueType() != BOOLEAN) {
+		semanticError("Error: %s needs a comparison!\n", statement);
+	}
+} /* expectCondition */
+
+/**********************************************************************/
+/*!
+ * \brief Aborts if var is the counter of an enclosing FOR loop
+ */
+static void expectNotCounter(SemanticAnalyzer &analyzer, Var *var)
+{
+	std::vector<Var *> &counters = analyzer.counters();
+	for (size_t i = 0; i < counters.size(); i++) {
+		if (counters[i]->level() == var->level() && counters[i]->slot() == var->slot()) {
+			semanticError("Error: Can not assign to FOR counter %s!\n", var->getValue().c_str());
+		}
+	}
+} /* expectNotCounter */
+
+/**********************************************************************/
+void BinOp::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
+{
+	this->getLhs()->visitSemanticAnalyzer(analyzer);
+	this->getRhs()->visitSemanticAnalyzer(analyzer);
+	expectNumber(getLhs(), "an operand");
+	expectNumber(getRhs(), "an operand");
+
+	SymbolType lhs = getLhs()->valueType();
+	SymbolType rhs = getRhs()->valueType();
+	TokenType op = getToken().type();
+
+	if (op == T_PASC_INT_DIV_RESERV && (lhs != INTEGER || rhs != INTEGER)) {
+		semanticError("Error: DIV needs INTEGER operands!\n");
+	}
+	kernel_ = selectKernel(op, lhs, rhs);
+	if (isComparison(kernel_)) {
+		type_ = BOOLEAN;
+	} else {
+		type_ = op == T_DIV || lhs == REAL || rhs == REAL ? REAL : INTEGER;
+	}
 } /* BinOp::visitSemanticAnalyzer */
 
 /**********************************************************************/
-void Block::visitSemanticAnalyzer()
+/*!
+ * fn size_t Block::procedures(Block::iterator it)
+ * \brief How many of the declarations from it on are ProcedureDecls
+ */
+size_t Block::procedures(Block::iterator it)
 {
-	Block::iterator it;
-	for (it = this->begin(); it != this->end(); it++) {
-		(*it)->visitSemanticAnalyzer();
+	size_t count = 0;
+	while (it + count != end() && dynamic_cast<ProcedureDecl *>(it[count])) {
+		count++;
 	}
-	this->getCompound()->visitSemanticAnalyzer();
+	return count;
+} /* Block::procedures */
+
+/**********************************************************************/
+void Block::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
+{
+	Block::iterator it = this->begin();
+	while (it != this->end()) {
+		size_t run = procedures(it);
+		if (run >= SemanticAnalyzer::MIN_PARALLEL && TaskPool::threads() > 1) {
+			analyzer.analyzeProcedures(it, run);
+		} else {
+			run = std::max<size_t>(run, 1);
+			for (size_t i = 0; i < run; i++) {
+				it[i]->visitSemanticAnalyzer(analyzer);
+			}
+		}
+		it += run;
+	}
+	this->getCompound()->visitSemanticAnalyzer(analyzer);
 } /* Block::visitSemanticAnalyzer */
 
 /**********************************************************************/
-void Program::visitSemanticAnalyzer()
+void Program::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
 {
-	CLog::write(CLog::RELEASE, "Enter scope: global\n");
-	ScopedSymbolTable *globalScope = new ScopedSymbolTable("global", 1, NULL);
+	/* Given the scope of an earlier Program, as an input of a Repl is, add to it */
+	bool fresh = scope_ == NULL;
+	if (fresh) {
+		CLog::write(CLog::RELEASE, "Enter scope: global\n");
+		scope_ = new ScopedSymbolTable("global", 1, NULL);
+		ownsScope_ = true;
+	}
 
-	SemanticAnalyzer::currentScope_ = globalScope;	
-	this->getBlock()->visitSemanticAnalyzer();
-	SemanticAnalyzer::currentScope_ = SemanticAnalyzer::currentScope_->getEnclosingScope();
-	CLog::write(CLog::RELEASE, "LEAVE scope: global\n");
+	analyzer.setScope(scope_);
+	this->getBlock()->visitSemanticAnalyzer(analyzer);
+	analyzer.setScope(scope_->getEnclosingScope());
+	if (fresh) {
+		CLog::write(CLog::RELEASE, "LEAVE scope: global\n");
+	}
 } /* Program::visitSemanticAnalyzer */
 
 /**********************************************************************/
-void Compound::visitSemanticAnalyzer()
+void Compound::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
 {
 	Compound::iterator it;
 
 	for (it = this->begin(); it != this->end(); it++) {
-		(*it)->visitSemanticAnalyzer();
+		(*it)->visitSemanticAnalyzer(analyzer);
 	}
 } /* Compound::visitSemanticAnalyzer */
 
 /**********************************************************************/
-void NoOp::visitSemanticAnalyzer()
+void NoOp::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
 {
 	return;
 } /* NoOp::visitSemanticAnalyzer */
 
 /**********************************************************************/
-void VarDecl::visitSemanticAnalyzer()
+void VarDecl::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
 {
-	std::string typeName = this->getTypeNode()->getValue();
-	Symbol *typeSymbol = SemanticAnalyzer::currentScope_->lookup(typeName);
+	BuiltinTypeSymbol *typeSymbol = lookupType(analyzer, this->getTypeNode());
 
-	std::string varName = this->getVarNode()->getValue();
-	Symbol *varSymbol = new VarSymbol(varName, typeSymbol);
-
-
-	if (SemanticAnalyzer::currentScope_->lookup(varName, true)) {
-		CLog::write(CLog::RELEASE, "Error: Duplicate identifier %s found\n", varName.c_str());
-		abort();
+	NameId varId = this->getVarNode()->getId();
+	if (analyzer.lookup(varId, true)) {
+		semanticError("Error: Duplicate identifier %s found\n", this->getVarNode()->getValue().c_str());
 	}
 
-	SemanticAnalyzer::currentScope_->define(varSymbol);
+	VarSymbol *varSymbol = new VarSymbol(varId, typeSymbol, this->getVarNode()->getValue());
+	analyzer.getScope()->define(varSymbol);
 } /* VarDecl::visitSemanticAnalyzer */
 
 /**********************************************************************/
-void Var::visitSemanticAnalyzer()
+/*!
+ * fn void Var::bind(VarSymbol *symbol)
+ * \brief Copies the address and the type of symbol onto the node
+ */
+void Var::bind(VarSymbol *symbol)
+{
+	level_     = symbol->level();
+	slot_      = symbol->slot();
+	valueType_ = symbol->valueType();
+} /* Var::bind */
+
+/**********************************************************************/
+void Var::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
 {
-	std::string varName = getValue();
-	Symbol *varSymbol = SemanticAnalyzer::currentScope_->lookup(varName);
+	Symbol *varSymbol = analyzer.lookup(getId());
 	if (!varSymbol) {
-		CLog::write(CLog::RELEASE, "Error: Symbol %s not found!\n", varName.c_str());
-		abort();
+		semanticError("Error: Symbol %s not found!\n", getValue().c_str());
 	}
+	VarSymbol *symbol = dynamic_cast<VarSymbol *>(varSymbol);
+	if (!symbol) {
+		semanticError("Error: %s is not a variable!\n", getValue().c_str());
+	}
+	bind(symbol);
+	TRACE(TRACE_SEMA, "Var %s -> level %d slot %d\n", symbol->name(), level_, slot_);
 } /* Var::visitSemanticAnalyzer */
 
 /**********************************************************************/
-void Assign::visitSemanticAnalyzer()
+void Assign::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
 {
-	this->getRhs()->visitSemanticAnalyzer();
-	this->getLhs()->visitSemanticAnalyzer();
+	this->getRhs()->visitSemanticAnalyzer(analyzer);
+	this->getLhs()->visitSemanticAnalyzer(analyzer);
+	expectNumber(getRhs(), "assigned");
+	expectNotCounter(analyzer, getLhs());
+
+	if (getLhs()->valueType() == INTEGER && getRhs()->valueType() == REAL) {
+		semanticError("Error: Can not assign a REAL to INTEGER %s!\n", getLhs()->getValue().c_str());
+	}
+	toReal_ = getLhs()->valueType() == REAL && getRhs()->valueType() == INTEGER;
 } /* Assign::visitSemanticAnalyzer */
 
 /**********************************************************************/
-void Type::visitSemanticAnalyzer()
+/*!
+ * fn void ProcedureCall::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
+ * \brief Binds the call to its ProcedureDecl and checks the arguments
+ * against the parameters: same count, and no REAL for an INTEGER.
+ */
+void ProcedureCall::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
+{
+	ProcedureSymbol *procSymbol = dynamic_cast<ProcedureSymbol *>(analyzer.lookup(getToken().id()));
+	if (!procSymbol) {
+		semanticError("Error: %s is not a procedure!\n", getName().c_str());
+	}
+	std::vector<VarSymbol *> &params = procSymbol->params();
+	if (params.size() != size()) {
+		semanticError("Error: %s takes %zu arguments, %zu given!\n", getName().c_str(), params.size(), size());
+	}
+
+	for (size_t i = 0; i < size(); i++) {
+		arg(i)->visitSemanticAnalyzer(analyzer);
+		expectNumber(arg(i), "an argument");
+		if (params[i]->valueType() == INTEGER && arg(i)->valueType() == REAL) {
+			semanticError("Error: Can not pass a REAL to INTEGER %s of %s!\n", params[i]->spelling(), getName().c_str());
+		}
+	}
+	procedure_ = procSymbol->getDecl();
+} /* ProcedureCall::visitSemanticAnalyzer */
+
+/**********************************************************************/
+/*!
+ * fn bool ProcedureCall::toReal(size_t i)
+ * \brief Whether argument i is an INTEGER passed to a REAL parameter
+ */
+bool ProcedureCall::toReal(size_t i)
+{
+	return procedure_->param(i)->getVar()->valueType() == REAL && arg(i)->valueType() == INTEGER;
+} /* ProcedureCall::toReal */
+
+/**********************************************************************/
+void If::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
+{
+	condition_->visitSemanticAnalyzer(analyzer);
+	expectCondition(condition_, "IF");
+	then_->visitSemanticAnalyzer(analyzer);
+	if (else_) {
+		else_->visitSemanticAnalyzer(analyzer);
+	}
+} /* If::visitSemanticAnalyzer */
+
+/**********************************************************************/
+void While::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
+{
+	condition_->visitSemanticAnalyzer(analyzer);
+	expectCondition(condition_, "WHILE");
+	body_->visitSemanticAnalyzer(analyzer);
+} /* While::visitSemanticAnalyzer */
+
+/**********************************************************************/
+/*!
+ * fn void For::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
+ * \brief The counter and both bounds must be INTEGERs. While the body is
+ * analysed the counter is in SemanticAnalyzer::counters(), so an Assign
+ * to it, or a nested FOR over it, is an error.
+ */
+void For::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
+{
+	start_->visitSemanticAnalyzer(analyzer);
+	bound_->visitSemanticAnalyzer(analyzer);
+	var_->visitSemanticAnalyzer(analyzer);
+
+	if (var_->valueType() != INTEGER) {
+		semanticError("Error: FOR counter %s must be an INTEGER!\n", var_->getValue().c_str());
+	}
+	if (start_->valueType() != INTEGER || bound_->valueType() != INTEGER) {
+		semanticError("Error: FOR bounds must be INTEGERs!\n");
+	}
+	expectNotCounter(analyzer, var_);
+
+	analyzer.counters().push_back(var_);
+	body_->visitSemanticAnalyzer(analyzer);
+	analyzer.counters().pop_back();
+} /* For::visitSemanticAnalyzer */
+
+/**********************************************************************/
+void Type::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
 {
 	return;
 } /* Type::visitSemanticAnalyzer */
 
 /**********************************************************************/
-void Number::visitSemanticAnalyzer()
+void Number::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
 {
 	return;
 } /* Number::visitSemanticAnalyzer */
 
 /**********************************************************************/
-void UnaryOp::visitSemanticAnalyzer()
+void UnaryOp::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
 {
-	return;
+	this->getExpr()->visitSemanticAnalyzer(analyzer);
+	expectNumber(getExpr(), "an operand");
+	type_ = getExpr()->valueType();
+	if (getToken().type() == T_MINUS) {
+		kernel_ = valueType() == INTEGER ? K_NEG_I : K_NEG_R;
+	}
 } /* UnaryOp::visitSemanticAnalyzer */
 
 /**********************************************************************/
-void Param::visitSemanticAnalyzer()
+void Param::visitSemanticAnalyzer(SemanticAnalyzer &analyzer)
 {
 	return;
 } /* Param::visitSemanticAnalyzer */
 
 /**********************************************************************/
-double Param::visitEvaluate()
+Value Param::visitEvaluate(Evaluator &evaluator)
 {
-	return 0;
+	return Value();
 } /* Param::visitEvaluate */
 
 /**********************************************************************/
@@ -785,159 +1409,445 @@ double Param::visitEvaluate()
 /**********************************************************************/
 /**********************************************************************/
 /**********************************************************************/
-double BinOp::visitEvaluate()
+Value BinOp::visitEvaluate(Evaluator &evaluator)
 {
-	CLog::write(CLog::DEBUG, "BinOp::visit\n");
-	CLog::write(CLog::DEBUG, "BinOp: this->op_.type(): %s\n", this->getToken().representation().c_str());
-	if (this->getToken().type() == T_PLUS) {
-		return this->lhs_->visitEvaluate() + this->rhs_->visitEvaluate();
-	} else if (this->getToken().type() == T_MINUS) {
-		return this->lhs_->visitEvaluate() - this->rhs_->visitEvaluate();
-	} else if (this->getToken().type() == T_MUL) {
-		return this->lhs_->visitEvaluate() * this->rhs_->visitEvaluate();
-	} else if (this->getToken().type() == T_DIV) {
-		return this->lhs_->visitEvaluate() / this->rhs_->visitEvaluate(); 
-	} else if (this->getToken().type() == T_PASC_INT_DIV_RESERV) {
-		return this->lhs_->visitEvaluate() / this->rhs_->visitEvaluate();//FIXME oxi / alla diairesi pou krataei to akeraio meros !
-	}
-	assert(false);
-	CLog::write(CLog::DEBUG, "BinOp::visit should not reach\n");
-	return 0;
+	TRACE(TRACE_EVAL, "BinOp: this->op_.type(): %s\n", this->getToken().representation().c_str());
+	Value lhs = this->lhs_->visitEvaluate(evaluator);
+	Value rhs = this->rhs_->visitEvaluate(evaluator);
+	return applyKernel(kernel_, lhs, rhs);
 } /* BinOp::visitEvaluate */
 
 /**********************************************************************/
-double Program::visitEvaluate()
+/*!
+ * fn void Program::release()
+ * \brief Frees the whole tree, this Program included, by dropping its
+ * Arena, and the scopes the SemanticAnalyzer made for it. A scope given
+ * by setScope() stays with whoever gave it.
+ */
+void Program::release()
+{
+	static_assert(std::is_trivially_destructible<Program>::value &&
+		      std::is_trivially_destructible<Block>::value &&
+		      std::is_trivially_destructible<Compound>::value &&
+		      std::is_trivially_destructible<ProcedureDecl>::value &&
+		      std::is_trivially_destructible<Var>::value &&
+		      std::is_trivially_destructible<BinOp>::value &&
+		      std::is_trivially_destructible<Type>::value,
+		      "AST nodes live in an Arena and are never destroyed");
+	if (ownsScope_) {
+		delete scope_;
+	}
+	Arena *arena = arena_;
+	delete arena;
+} /* Program::release */
+
+/**********************************************************************/
+Value Program::visitEvaluate(Evaluator &evaluator)
 {
-	getBlock()->visitEvaluate();
-	return 0;
+	getBlock()->visitEvaluate(evaluator);
+	return Value();
 } /* Program::visitEvaluate */
 
 /**********************************************************************/
-double Block::visitEvaluate()
+Value Block::visitEvaluate(Evaluator &evaluator)
 {
-	std::vector<Node *>::iterator it;
+	Block::iterator it;
 	for (it = declarations_.begin(); it != declarations_.end(); it++) {
-		(*it)->visitEvaluate();
+		(*it)->visitEvaluate(evaluator);
 	}
-	compoundStatement_->visitEvaluate();
-	return 0;
+	compoundStatement_->visitEvaluate(evaluator);
+	return Value();
 } /* Block::visitEvaluate */
 
 /**********************************************************************/
-double VarDecl::visitEvaluate()
+Value VarDecl::visitEvaluate(Evaluator &evaluator)
 {
-	return 0;
+	return Value();
 } /* VarDecl::visitEvaluate */
 
 /**********************************************************************/
-double Type::visitEvaluate()
+Value Type::visitEvaluate(Evaluator &evaluator)
 {
 	//do nothing
-	return 0;
+	return Value();
 } /* Type::visitEvaluate */
 
 /**********************************************************************/
-double UnaryOp::visitEvaluate()
+Value UnaryOp::visitEvaluate(Evaluator &evaluator)
 {
-	CLog::write(CLog::DEBUG, "UnaryOp::visitEvaluate(): Start!\n");
-	Token tok = this->getToken();
-	if (tok.type() == T_PLUS) {
-		return +(this->expr_->visitEvaluate());
-	} else if (tok.type() == T_MINUS) {
-		return -(this->expr_->visitEvaluate());
-	}
-	CLog::write(CLog::DEBUG, "UnaryOp::visitEvaluate(): Should not reach!\n");
-	return 0;
+	Value value = this->expr_->visitEvaluate(evaluator);
+	return applyKernel(kernel_, value, value);
 } /* UnaryOp::visitEvaluate */
 
 /**********************************************************************/
 /*!
- * fn void Compound::visitEvaluate()
+ * fn void Compound::visitEvaluate(Evaluator &evaluator)
  * \brief  Compound visitor iterates over its children and visits each one in turn.
  * \return An T_INTEGER token value
  */
-double Compound::visitEvaluate()
+Value Compound::visitEvaluate(Evaluator &evaluator)
 {
-	std::vector<Node *>::iterator it;
+	Compound::iterator it;
 	for (it = children_.begin(); it != children_.end(); it++) 
 	{
-		(*it)->visitEvaluate();
+		(*it)->visitEvaluate(evaluator);
 	}
-	return 0;
+	return Value();
 } /* Compound::visitEvaluate */
 
 /**********************************************************************/
-double Number::visitEvaluate()
+/*!
+ * fn Number::Number(const Token &tok)
+ * \brief Parses the literal once: a T_INTEGER token into an exact 64 bit
+ * integer, a T_REAL one into a double.
+ */
+Number::Number(const Token &tok)
+{
+	setToken(tok);
+	Token literal = getToken();
+	const char *first = literal.text();
+	const char *last  = first + literal.length();
+
+	std::from_chars_result result;
+	if (literal.type() == T_INTEGER) {
+		int64_t i = 0;
+		result = std::from_chars(first, last, i);
+		value_ = Value::integer(i);
+	} else {
+		double r = 0;
+		result = std::from_chars(first, last, r);
+		value_ = Value::real(r);
+	}
+	if (result.ec != std::errc()) {
+		CLog::write(CLog::RELEASE, "Error: %s is out of range!\n", literal.value().c_str());
+		programError();
+	}
+} /* Number::Number */
+
+/**********************************************************************/
+Value Number::visitEvaluate(Evaluator &evaluator)
 {
 	return value();
 } /* Number::visitEvaluate */
 
 /**********************************************************************/
-double Assign::visitEvaluate()
+/*!
+ * fn Value Assign::visitEvaluate(Evaluator &evaluator)
+ * \brief Stores the value of the right side into the slot of the variable
+ */
+Value Assign::visitEvaluate(Evaluator &evaluator)
 {
-	//typedef std::map<std::string, double>KVMap;
-
-	std::string varName = this->lhs_->getToken().value();
-	//ena map pou tha pairno to key()
-	std::map<std::string, double>::iterator it;
-	CLog::write(CLog::DEBUG, "visitEvaluate %s\n", varName.c_str());
-/*
-	it = Interpreter::GLOBAL_SCOPE.find(varName);
-	if (it == Interpreter::GLOBAL_SCOPE.end()) {
-		Interpreter::GLOBAL_SCOPE.insert(KVMap::value_type(varName, this->rhs_->visitEvaluate()));
+	Value value = this->rhs_->visitEvaluate(evaluator);
+	if (toReal_) {
+		value = Value::real((double)value.i);
 	}
-*/
-	return 0;
+	evaluator.callStack().frame(lhs_->level())[lhs_->slot()] = value;
+	return value;
 } /* Assign::visitEvaluate */
 
 /**********************************************************************/
-double Var::visitEvaluate()
+/*!
+ * fn Value Var::visitEvaluate(Evaluator &evaluator)
+ * \brief Reads the variable straight from its slot
+ */
+Value Var::visitEvaluate(Evaluator &evaluator)
 {
-	std::string varName = this->getToken().value();
-	std::map<std::string, double>::iterator it;
-/*
-	it = Interpreter::GLOBAL_SCOPE.find(varName);
-	if (it == Interpreter::GLOBAL_SCOPE.end()) {
-		CLog::write(CLog::RELEASE, "Var::visitEvaluate() --> No Such Variable!");
-	} else {
-		return it->second;
-	}
-	assert(false);
-*/
-	return 0;
+	return evaluator.callStack().frame(level_)[slot_];
 } /* Var::visitEvaluate */
 
 /**********************************************************************/
 /*!
- * fn void NoOp::visitEvaluate()
+ * fn void NoOp::visitEvaluate(Evaluator &evaluator)
  * \brief  NoOp visitor does nothing! 
  * \return An T_INTEGER token value
  */
-double NoOp::visitEvaluate()
+Value NoOp::visitEvaluate(Evaluator &evaluator)
 {
-	return 0;
+	return Value();
 } /* NoOp::visitEvaluate */
 
 /**********************************************************************/
-double ProcedureDecl::visitEvaluate()
+/*!
+ * fn Value ProcedureDecl::visitEvaluate(Evaluator &evaluator)
+ * \brief A declaration does nothing; its body runs when it is called.
+ */
+Value ProcedureDecl::visitEvaluate(Evaluator &evaluator)
 {
-	return block_->visitEvaluate();
+	return Value();
 } /* ProcedureDecl::visitEvaluate */
 
+/**********************************************************************/
+/*!
+ * fn Value ProcedureCall::visitEvaluate(Evaluator &evaluator)
+ * \brief Evaluates the arguments straight into the parameter slots of
+ * the next record, pushes it and runs the body of the callee.
+ */
+Value ProcedureCall::visitEvaluate(Evaluator &evaluator)
+{
+	ScopedSymbolTable *scope = procedure_->getScope();
+	Value *slots = evaluator.callStack().next(scope->frameSize());
+	for (size_t i = 0; i < size(); i++) {
+		slots[i] = arg(i)->visitEvaluate(evaluator);
+		if (toReal(i)) {
+			slots[i] = Value::real((double)slots[i].i);
+		}
+	}
+
+	evaluator.callStack().push(scope->getLevel(), scope->frameSize(), size());
+	procedure_->getBlock()->visitEvaluate(evaluator);
+	evaluator.callStack().pop();
+	return Value();
+} /* ProcedureCall::visitEvaluate */
+
+/**********************************************************************/
+Value If::visitEvaluate(Evaluator &evaluator)
+{
+	if (condition_->visitEvaluate(evaluator).i) {
+		then_->visitEvaluate(evaluator);
+	} else if (else_) {
+		else_->visitEvaluate(evaluator);
+	}
+	return Value();
+} /* If::visitEvaluate */
+
+/**********************************************************************/
+Value While::visitEvaluate(Evaluator &evaluator)
+{
+	while (condition_->visitEvaluate(evaluator).i) {
+		body_->visitEvaluate(evaluator);
+	}
+	return Value();
+} /* While::visitEvaluate */
+
+/**********************************************************************/
+/*!
+ * fn Value For::visitEvaluate(Evaluator &evaluator)
+ * \brief The counted loop. Both bounds are evaluated first, once; the
+ * counter gets the start value only if the loop runs. After each
+ * iteration the counter is read back from its slot, where a called
+ * procedure may have moved it, and stepped only while it is below the
+ * bound (above it, for DOWNTO), as OP_NEXT_UP and OP_NEXT_DOWN do. So a
+ * bound at the edge of the INTEGER range does not overflow.
+ */
+Value For::visitEvaluate(Evaluator &evaluator)
+{
+	int level = var_->level();
+	int slot  = var_->slot();
+	int64_t first = start_->visitEvaluate(evaluator).i;
+	int64_t last  = bound_->visitEvaluate(evaluator).i;
+
+	if (down_ ? first < last : first > last) {
+		return Value();
+	}
+	evaluator.callStack().frame(level)[slot] = Value::integer(first);
+
+	if (down_) {
+		for (;;) {
+			body_->visitEvaluate(evaluator);
+			Value *counter = &evaluator.callStack().frame(level)[slot]; /* The body may have moved the frame */
+			if (counter->i <= last) {
+				break;
+			}
+			counter->i--;
+		}
+	} else {
+		for (;;) {
+			body_->visitEvaluate(evaluator);
+			Value *counter = &evaluator.callStack().frame(level)[slot];
+			if (counter->i >= last) {
+				break;
+			}
+			counter->i++;
+		}
+	}
+	return Value();
+} /* For::visitEvaluate */
+
 /***********************************************/
 /***********************************************/
 /***********************************************/
 /***********************************************/
 /***********************************************/
 
-Node* Interpreter::interpret()
+Program* Interpreter::interpret()
 {
-	CLog::write(CLog::DEBUG, "\n\nInterpreter::interpret()\n");
-	Node *tree = parser_.parse();
-	CLog::write(CLog::DEBUG, "Interpreter::interpret() 2\n");
+	TRACE(TRACE_PARSER, "\n\nInterpreter::interpret()\n");
+	Program *tree = parser_.parse();
+	TRACE(TRACE_PARSER, "Interpreter::interpret() 2\n");
 	return tree;
 } /* Interpreter::interpret */
 
+/***********************************************/
+/***********************************************/
+/***********************************************/
+/***********************************************/
+/***********************************************/
+/*!
+ * fn Value *CallStack::next(int size)
+ * \brief Makes room for a record of size slots and tells where its slots
+ * will start. A caller writes the arguments there, then push()es.
+ */
+Value *CallStack::next(int size)
+{
+	if (top_ + size > values_.size()) {
+		grow(top_ + size);
+	}
+	return values_.data() + top_;
+} /* CallStack::next */
+
+/***********************************************/
+/*!
+ * fn void CallStack::grow(size_t size)
+ * \brief Moves the value stack to a bigger one and repoints the display
+ */
+void CallStack::grow(size_t size)
+{
+	Value *old = values_.data();
+	values_.resize(std::max(size, values_.size() * 2 + 256));
+	Value *now = values_.data();
+	if (now == old) {
+		return;
+	}
+
+	for (size_t i = 0; i < display_.size(); i++) {
+		if (display_[i]) {
+			display_[i] = now + (display_[i] - old);
+		}
+	}
+	for (size_t i = 0; i < records_.size(); i++) {
+		if (records_[i].savedDisplay) {
+			records_[i].savedDisplay = now + (records_[i].savedDisplay - old);
+		}
+	}
+} /* CallStack::grow */
+
+/***********************************************/
+/*!
+ * fn void CallStack::push(int level, int size, int given, int returnPc)
+ * \brief Pushes an activation record and makes it the display entry of level.
+ * The first given slots already hold the arguments; the rest are zeroed.
+ */
+void CallStack::push(int level, int size, int given, int returnPc)
+{
+	if (records_.size() >= MAX_DEPTH) {
+		CLog::write(CLog::RELEASE, "Error: Stack overflow!\n");
+		programError();
+	}
+	if (display_.size() <= (size_t)level) {
+		display_.resize(level + 1, NULL);
+	}
+	Value *slots = next(size);
+	for (int i = given; i < size; i++) {
+		slots[i] = Value();
+	}
+
+	ActivationRecord record;
+	record.level = level;
+	record.base = top_;
+	record.savedDisplay = display_[level];
+	record.returnPc = returnPc;
+	records_.push_back(record);
+
+	display_[level] = slots;
+	top_ += size;
+} /* CallStack::push */
+
+/***********************************************/
+/*!
+ * fn void CallStack::extend(int size)
+ * \brief Grows the innermost record to size slots, for the variables
+ * declared since it was pushed. The new slots are zeroed.
+ */
+void CallStack::extend(int size)
+{
+	ActivationRecord &record = records_.back();
+	size_t end = record.base + size;
+	if (end <= top_) {
+		return;
+	}
+	Value *slots = next(end - top_);
+	for (size_t i = 0; i < end - top_; i++) {
+		slots[i] = Value();
+	}
+	top_ = end;
+	display_[record.level] = values_.data() + record.base; /* An empty record had no slots to move */
+} /* CallStack::extend */
+
+/***********************************************/
+/*!
+ * fn int CallStack::pop()
+ * \brief Pops the innermost record
+ * \return The return address it was pushed with
+ */
+int CallStack::pop()
+{
+	ActivationRecord &record = records_.back();
+	display_[record.level] = record.savedDisplay;
+	top_ = record.base;
+	int returnPc = record.returnPc;
+	records_.pop_back();
+	return returnPc;
+} /* CallStack::pop */
+
+/***********************************************/
+/*!
+ * fn void Evaluator::printVariable(const char *name, SymbolType type, Value value)
+ * \brief Prints one variable of the memory
+ */
+void Evaluator::printVariable(const char *name, SymbolType type, Value value)
+{
+	if (type == INTEGER) {
+		CLog::write(CLog::RELEASE, "%s = %lld\n", name, (long long)value.i);
+	} else {
+		CLog::write(CLog::RELEASE, "%s = %g\n", name, value.r);
+	}
+} /* Evaluator::printVariable */
+
+/***********************************************/
+/*!
+ * fn void Evaluator::printMemory(ScopedSymbolTable *scope)
+ * \brief Prints the variables of scope as found in its current activation record
+ */
+void Evaluator::printMemory(ScopedSymbolTable *scope)
+{
+	Value *slots = callStack_.frame(scope->getLevel());
+	std::vector<VarSymbol *> &variables = scope->variables();
+
+	CLog::write(CLog::RELEASE, "Memory:\n");
+	for (size_t i = 0; i < variables.size(); i++) {
+		printVariable(variables[i]->spelling(), variables[i]->valueType(), slots[variables[i]->slot()]);
+	}
+} /* Evaluator::printMemory */
+
+/***********************************************/
+/*!
+ * fn void Evaluator::printMemory(Bytecode *code)
+ * \brief Prints the globals of code as found in the activation record
+ * of the program
+ */
+void Evaluator::printMemory(Bytecode *code)
+{
+	Value *slots = callStack_.frame(1);
+	std::vector<GlobalVariable> &globals = code->globals();
+
+	CLog::write(CLog::RELEASE, "Memory:\n");
+	for (size_t i = 0; i < globals.size(); i++) {
+		printVariable(globals[i].name.c_str(), globals[i].type, slots[globals[i].slot]);
+	}
+} /* Evaluator::printMemory */
+
+/***********************************************/
+/*!
+ * fn void divisionByZero()
+ * \brief The runtime error of an INTEGER DIV by zero, see programError()
+ */
+void divisionByZero()
+{
+	CLog::write(CLog::RELEASE, "Error: Division by zero!\n");
+	programError();
+} /* divisionByZero */
+
+/***********************************************/
 /***********************************************/
 /***********************************************/
 /***********************************************/
@@ -946,16 +1856,18 @@ Node* Interpreter::interpret()
 void ScopedSymbolTable::representation()
 {
 	CLog::write(CLog::RELEASE, "Symbols: \n");
-	std::map<std::string, Symbol *>::iterator it;
 
-	for ( it = ScopedSymbolTable::symbols_.begin(); it != ScopedSymbolTable::symbols_.end(); it++) {
-		CLog::write(CLog::RELEASE, "%s\n", it->second->representation());
+	for (size_t i = 0; i < symbols_.size(); i++) {
+		if (symbols_[i]) {
+			CLog::write(CLog::RELEASE, "%s\n", symbols_[i]->representation().c_str());
+		}
 	}
 
 } /* ScopedSymbolTable::representation */
 
 /***********************************************/
 ScopedSymbolTable::ScopedSymbolTable(std::string name, int level, ScopedSymbolTable *enclosingScope)
+	: symbols_(16, NULL), count_(0)
 {
 	name_  = name;
 	level_ = level;
@@ -963,43 +1875,141 @@ ScopedSymbolTable::ScopedSymbolTable(std::string name, int level, ScopedSymbolTa
 	initBuiltins();
 } /* ScopedSymbolTable::ScopedSymbolTable */
 
+/***********************************************/
+ScopedSymbolTable::~ScopedSymbolTable()
+{
+	for (size_t i = 0; i < symbols_.size(); i++) {
+		delete symbols_[i];
+	}
+} /* ScopedSymbolTable::~ScopedSymbolTable */
+
+/***********************************************/
+ProcedureSymbol::~ProcedureSymbol()
+{
+	delete scope_;
+} /* ProcedureSymbol::~ProcedureSymbol */
+
 /***********************************************/
 void ScopedSymbolTable::initBuiltins()
 {
-	define(new BuiltinTypeSymbol("INTEGER"));
-	define(new BuiltinTypeSymbol("REAL"));
+	define(new BuiltinTypeSymbol(InternTable::intern("INTEGER"), INTEGER));
+	define(new BuiltinTypeSymbol(InternTable::intern("REAL"), REAL));
 } /* ScopedSymbolTable::initBuiltins */
 
 /***********************************************/
+/*!
+ * fn void ScopedSymbolTable::define(Symbol *symbol)
+ * \brief Adds symbol to this scope, which owns it from then on. Callers
+ * check for a definition of the name first; should there be one, it
+ * stays. The table doubles once it is half full.
+ */
 void ScopedSymbolTable::define(Symbol *symbol)
 {
-	CLog::write(CLog::RELEASE, "Insert %s\n", symbol->representation().c_str());
-	typedef std::map<std::string, Symbol *>KVMap;
+	TRACE(TRACE_SEMA, "Insert %s\n", symbol->representation().c_str());
 
-	ScopedSymbolTable::symbols_.insert(KVMap::value_type(symbol->name(), symbol));
+	size_t mask = symbols_.size() - 1;
+	size_t i = symbol->id() & mask;
+	while (symbols_[i]) {
+		if (symbols_[i]->id() == symbol->id()) {
+			return;
+		}
+		i = (i + 1) & mask;
+	}
+	symbols_[i] = symbol;
+	symbol->setOrder(count_);
+
+	if (++count_ * 2 > symbols_.size()) {
+		std::vector<Symbol *> old(symbols_.size() * 2, NULL);
+		old.swap(symbols_);
+		mask = symbols_.size() - 1;
+		for (size_t j = 0; j < old.size(); j++) {
+			if (old[j]) {
+				i = old[j]->id() & mask;
+				while (symbols_[i]) {
+					i = (i + 1) & mask;
+				}
+				symbols_[i] = old[j];
+			}
+		}
+	}
 } /* ScopedSymbolTable::define */
 
 /***********************************************/
-Symbol *ScopedSymbolTable::lookup(const std::string &name, bool currentScopeOnly)
+/*!
+ * fn void ScopedSymbolTable::define(VarSymbol *symbol)
+ * \brief Defines a variable and gives it the next free slot of this scope
+ */
+void ScopedSymbolTable::define(VarSymbol *symbol)
 {
-	CLog::write(CLog::RELEASE, "Lookup: %s. (Scope name : %s)\n", name.c_str(), ScopedSymbolTable::name_.c_str());
-	std::map<std::string, Symbol *>::iterator it;
-
-	it = ScopedSymbolTable::symbols_.find(name);
+	symbol->setAddress(level_, variables_.size());
+	TRACE(TRACE_SEMA, "Slot %d of %s: %s\n", symbol->slot(), name_.c_str(), symbol->name());
+	variables_.push_back(symbol);
+	define(static_cast<Symbol *>(symbol));
+} /* ScopedSymbolTable::define */
 
-	if (it != ScopedSymbolTable::symbols_.end()) {
-		return it->second;
+/***********************************************/
+/*!
+ * fn void ScopedSymbolTable::truncate(size_t count)
+ * \brief Deletes the symbols defined after the first count, and frees
+ * the slots of the variables among them, as a Repl does with an input
+ * that is in error
+ */
+void ScopedSymbolTable::truncate(size_t count)
+{
+	while (!variables_.empty() && variables_.back()->order() >= count) {
+		variables_.pop_back();
 	}
 
-	if (currentScopeOnly) {
-		return NULL;
+	std::vector<Symbol *> old(symbols_.size(), NULL);
+	old.swap(symbols_);
+	size_t mask = symbols_.size() - 1;
+	for (size_t j = 0; j < old.size(); j++) {
+		if (old[j] && old[j]->order() >= count) {
+			delete old[j];
+		} else if (old[j]) {
+			size_t i = old[j]->id() & mask;
+			while (symbols_[i]) {
+				i = (i + 1) & mask;
+			}
+			symbols_[i] = old[j];
+		}
 	}
+	count_ = std::min(count_, count);
+} /* ScopedSymbolTable::truncate */
 
-	/* recursively go up the chain and lookup the name */
-	if (getEnclosingScope()) {
-		return getEnclosingScope()->lookup(name);
+/***********************************************/
+/*!
+ * fn Symbol *ScopedSymbolTable::find(NameId id)
+ * \brief The symbol named id in this scope only, or NULL
+ */
+Symbol *ScopedSymbolTable::find(NameId id)
+{
+	size_t mask = symbols_.size() - 1;
+	size_t i = id & mask;
+	while (symbols_[i]) {
+		if (symbols_[i]->id() == id) {
+			return symbols_[i];
+		}
+		i = (i + 1) & mask;
 	}
+	return NULL;
+} /* ScopedSymbolTable::find */
+
+/***********************************************/
+/*!
+ * fn Symbol *ScopedSymbolTable::lookup(NameId id, bool currentScopeOnly)
+ * \brief The symbol named id, searched from this scope outwards
+ */
+Symbol *ScopedSymbolTable::lookup(NameId id, bool currentScopeOnly)
+{
+	TRACE(TRACE_SEMA, "Lookup: %s. (Scope name : %s)\n", InternTable::name(id), ScopedSymbolTable::name_.c_str());
 
+	for (ScopedSymbolTable *scope = this; scope; scope = scope->getEnclosingScope()) {
+		Symbol *symbol = scope->find(id);
+		if (symbol || currentScopeOnly) {
+			return symbol;
+		}
+	}
 	return NULL;
 } /* ScopedSymbolTable::lookup */
 
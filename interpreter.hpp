@@ -1,18 +1,24 @@
 #pragma once
 #include "token.hpp"
 #include "clog.hpp"
+#include "arena.hpp"
+#include "value.hpp"
 #include <vector>
-#include <map>
 
 /*!
  * \file interpreter.hpp
  */
 
-enum SymbolType {
-	INTEGER,
-	REAL,
-	NONE
-};
+class Compiler;
+class Bytecode;
+class Jit;
+class CEmitter;
+class SemanticAnalyzer;
+class Evaluator;
+class Optimizer;
+class VarSymbol;
+class ScopedSymbolTable;
+
 /**********************************************************************/
 /**********************************************************************/
 /**********************************************************************/
@@ -20,17 +26,23 @@ enum SymbolType {
 /**
  * A Node class.
  * An abstract class.
+ * Nodes are created in the Arena of the parse with new (arena) and are
+ * never deleted one by one; see Program::release().
  */
 class Node
 {
 	public:
 		virtual Node *getRhs() { return NULL; }
 		virtual Node *getLhs() { return NULL; }
-		virtual double  value()   { return 1; }
+		virtual SymbolType valueType() { return NONE; } /*!< INTEGER or REAL for expressions, once analysed */
 
 		virtual void   visitASTPresenter(int ind) = 0;
-		virtual void   visitSemanticAnalyzer()    = 0;
-		virtual double visitEvaluate()            = 0;
+		virtual void   visitSemanticAnalyzer(SemanticAnalyzer &analyzer) = 0;
+		virtual Value  visitEvaluate(Evaluator &evaluator) = 0;
+		virtual void   visitCompiler(Compiler &compiler) = 0;
+		virtual Node  *visitOptimizer(Optimizer &optimizer) = 0;
+		virtual bool   visitJit(Jit &jit)         = 0; /*!< Native code for the node; false if it has none */
+		virtual void   visitCEmitter(CEmitter &emitter) = 0;
 	private:
 }; /* Node */
 
@@ -44,7 +56,7 @@ class TokenNode : public Node
 {
 	public:
 		Token getToken() { return token_; }
-		void  setToken(Token tok) { token_ = tok; }
+		void  setToken(const Token &tok) { token_ = tok; }
 	private:	
 		Token token_;
 }; /* TokenNode */
@@ -57,15 +69,18 @@ class TokenNode : public Node
 class Type : public Node
 {
 	public:
-		Type(Token tok) : token_(tok), value_(tok.value()) {}
-		std::string getValue() { return value_; }
+		Type(const Token &tok) : token_(tok) {}
+		std::string getValue() { return getKeywordName(token_.type()); }
 
 		void visitASTPresenter(int ind);
-		void visitSemanticAnalyzer();
-		double visitEvaluate();
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
 	private:
 		Token token_;
-		std::string value_;
 }; /* Type */
 
 /**********************************************************************/
@@ -77,20 +92,23 @@ class Type : public Node
 class Compound : public Node
 {
 	public:
-		typedef std::vector<Node *>::iterator iterator;
+		typedef ArenaArray<Node *>::iterator iterator;
 
-		void addNode(Node *node); 
-		std::vector<Node *> getChildren() { return children_; }
+		Compound(Arena &arena, const std::vector<Node *> &children) : children_(arena, children) {}
 		size_t size() { return children_.size(); }
 
 		void visitASTPresenter(int ind);
-		void visitSemanticAnalyzer();
-		double visitEvaluate();
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
 
 		iterator begin() { return children_.begin(); }
 		iterator end() { return children_.end(); }
 	private:
-		std::vector<Node *> children_;
+		ArenaArray<Node *> children_;
 }; /* Compound */
 
 /**********************************************************************/
@@ -98,23 +116,36 @@ class Compound : public Node
  * A Var class
  * Represents a Node that is constructed out of a T_PASC_ID token.
  * It represents a varialbe. The value_ holds the variable's name
+ * The SemanticAnalyzer resolves the name once and keeps the address of
+ * the variable, its (level, slot), on the node, so neither the analysis
+ * of later statements nor the run look the name up again.
  */
 class Var : public TokenNode
 {
 	public:
-		Var(Token &op)
+		Var(const Token &op) : level_(0), valueType_(NONE), slot_(-1)
 		{
 			setToken(op);
-			value_ = op.value();
 		}
 
-		std::string getValue() { return value_; }
+		std::string getValue() { return getToken().value(); }
+		NameId      getId() { return getToken().id(); }
+		SymbolType  valueType() { return (SymbolType)valueType_; }
+		int level() { return level_; }
+		int slot()  { return slot_; }
+		void bind(VarSymbol *symbol);
 
 		void visitASTPresenter(int ind);
-		void visitSemanticAnalyzer();
-		double visitEvaluate();
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
 	private:
-		std::string value_;
+		uint16_t level_;     /*!< Set by bind() */
+		uint16_t valueType_; /*!< A SymbolType  */
+		int32_t  slot_;
 }; /* Var */
 
 /**********************************************************************/
@@ -130,8 +161,12 @@ class VarDecl : public Node
 		Var  *getVarNode()  { return varNode_; }
 
 		void visitASTPresenter(int ind);
-		void visitSemanticAnalyzer();
-		double visitEvaluate();
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
 	private:
 		Var  *varNode_;
 		Type *typeNode_;
@@ -145,23 +180,28 @@ class VarDecl : public Node
 class Block : public Node
 {
 	public:
-		typedef std::vector<Node *>::iterator iterator;
+		typedef ArenaArray<Node *>::iterator iterator;
 
-		Block(std::vector<Node *>declarations, Compound *compoundStatement) : declarations_(declarations), compoundStatement_(compoundStatement) {}
+		Block(Arena &arena, const std::vector<Node *> &declarations, Compound *compoundStatement)
+			: declarations_(arena, declarations), compoundStatement_(compoundStatement) {}
 
 		Block::iterator begin() { return declarations_.begin(); }
 		Block::iterator end()   { return declarations_.end(); }
 
-		std::vector<Node *>getDeclarations() { return declarations_; }
 		size_t size() { return declarations_.size(); }
+		size_t procedures(Block::iterator it);
 		
 		Compound *getCompound() { return compoundStatement_; }
 
 		void visitASTPresenter(int ind);
-		void visitSemanticAnalyzer();
-		double visitEvaluate();
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
 	private:
-		std::vector<Node *>declarations_;
+		ArenaArray<Node *>declarations_;
 		Compound *compoundStatement_;
 }; /* Block */
 
@@ -174,16 +214,30 @@ class Program : public Node
 {
 	public:
 
-		Program(std::string name, Block *block) : name_(name), block_(block) {}
+		Program(const Token &name, Block *block) : name_(name), block_(block), scope_(NULL), ownsScope_(false), arena_(NULL) {}
 		Block *getBlock() { return block_; };
-		std::string getName() { return name_; }
+		std::string getName() { return name_.value(); }
+		NameId getId() { return name_.id(); }
+		ScopedSymbolTable *getScope() { return scope_; }
+		void   setScope(ScopedSymbolTable *scope) { scope_ = scope; }
+
+		void   setArena(Arena *arena) { arena_ = arena; }
+		Arena *getArena() { return arena_; }
+		void   release();
 
 		void visitASTPresenter(int ind);
-		void visitSemanticAnalyzer();
-		double visitEvaluate();
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
 	private:
-		std::string name_;
+		Token name_;
 		Block *block_;
+		ScopedSymbolTable *scope_; /*!< The global scope. Set by the SemanticAnalyzer, unless given */
+		bool   ownsScope_;         /*!< The SemanticAnalyzer made scope_, for release() to delete */
+		Arena *arena_;             /*!< Owns this tree, the Program included */
 }; /* Program */
 
 /**********************************************************************/
@@ -195,8 +249,12 @@ class NoOp : public Node
 {
 	public:
 		void visitASTPresenter(int ind);
-		void visitSemanticAnalyzer();
-		double visitEvaluate();
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
 	private:
 }; /* NoOp */
 
@@ -210,19 +268,25 @@ class NoOp : public Node
 class Assign : public TokenNode
 {
 	public:
-		Assign(TokenNode *lhs, Token &op, Node *rhs) : lhs_(lhs), rhs_(rhs)
+		Assign(Var *lhs, const Token &op, Node *rhs) : lhs_(lhs), rhs_(rhs), toReal_(false)
 		{
 			setToken(op);
 		}
-		TokenNode *getLhs() { return lhs_; }
+		Var  *getLhs() { return lhs_; }
 		Node *getRhs() { return rhs_; }
+		bool  toReal() { return toReal_; }
 
 		void visitASTPresenter(int ind);
-		void visitSemanticAnalyzer();
-		double visitEvaluate();
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
 	private:
-		TokenNode *lhs_;
+		Var  *lhs_;
 		Node *rhs_;
+		bool  toReal_; /*!< An INTEGER stored into a REAL variable */
 }; /* Assign */
 
 /**********************************************************************/
@@ -233,21 +297,28 @@ class Assign : public TokenNode
 class BinOp : public TokenNode
 {
 	public:
-		BinOp(Node *lhs, Token &op, Node *rhs) : lhs_(lhs), rhs_(rhs)
+		BinOp(Node *lhs, const Token &op, Node *rhs) : kernel_(K_NONE), type_(NONE), lhs_(lhs), rhs_(rhs)
 		{
 			setToken(op);
 		}
 		Node *getRhs() { return rhs_; }
 		Node *getLhs() { return lhs_; }
+		Kernel getKernel() { return kernel_; }
+		SymbolType valueType() { return type_; }
 
 		void visitASTPresenter(int ind);
-		void visitSemanticAnalyzer();
-		double visitEvaluate();
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
 	private:
+		Kernel kernel_; /*!< Chosen by the SemanticAnalyzer from the operand types */
+		SymbolType type_;
 		Node *lhs_;
 		Node *rhs_;
-
-};
+}; /* BinOp */
 
 /**********************************************************************/
 /**
@@ -257,17 +328,25 @@ class BinOp : public TokenNode
 class UnaryOp : public TokenNode
 {
 	public:
-		UnaryOp(Token &op, Node *expr) : expr_(expr)
+		UnaryOp(const Token &op, Node *expr) : kernel_(K_NONE), type_(NONE), expr_(expr)
 		{
 			setToken(op);
 		}
 
 		Node *getExpr() { return expr_; }
+		Kernel getKernel() { return kernel_; }
+		SymbolType valueType() { return type_; }
 
 		void visitASTPresenter(int ind);
-		void visitSemanticAnalyzer();
-		double visitEvaluate();
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
 	private:
+		Kernel kernel_; /*!< K_NEG_I, K_NEG_R, or K_NONE for a unary plus */
+		SymbolType type_;
 		Node *expr_;
 }; /* UnaryOp */
 
@@ -281,8 +360,12 @@ class Param : public Node
 		Type *getType() { return type_; }
 
 		void visitASTPresenter(int ind);
-		void visitSemanticAnalyzer();
-		double visitEvaluate();
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
 	private:
 		Var *var_;
 		Type *type_;
@@ -292,40 +375,193 @@ class Param : public Node
 class ProcedureDecl : public Node
 {
 	public:
-		typedef std::vector<Param *>::iterator iterator;
+		typedef ArenaArray<Param *>::iterator iterator;
 
-		ProcedureDecl(const std::string &procName, std::vector<Param *>params, Block *block)
-		       	: name_(procName), params_(params), block_(block) {}
+		ProcedureDecl(Arena &arena, const Token &procName, const std::vector<Param *> &params, Block *block)
+		       	: name_(procName), params_(arena, params), block_(block), scope_(NULL) {}
 
 		Block *getBlock() { return block_; }
-		std::string getName() { return name_; }
+		std::string getName() { return name_.value(); }
+		NameId getId() { return name_.id(); }
+		ScopedSymbolTable *getScope() { return scope_; }
 		iterator begin() { return params_.begin(); }
 		iterator end()   { return params_.end(); }
+		Param *param(size_t i) { return params_[i]; }
+		size_t size() { return params_.size(); }
+
+		void declare(SemanticAnalyzer &analyzer);
+		void analyzeBody(SemanticAnalyzer &analyzer);
 
 		void visitASTPresenter(int ind);
-		void visitSemanticAnalyzer();
-		double visitEvaluate();
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
 	private:
-		std::string name_;
-		std::vector<Param *> params_;
+		Token name_;
+		ArenaArray<Param *> params_;
 		Block *block_;
+		ScopedSymbolTable *scope_; /*!< Parameters and locals. Set by the SemanticAnalyzer */
 }; /* ProcedureDecl */
 
+/**********************************************************************/
+/**
+ * A ProcedureCall class
+ * A procedure call statement. Its token is the name of the procedure.
+ * Arguments are passed by value: argument i is evaluated in the caller
+ * and becomes slot i, the i-th parameter, of the activation record of
+ * the callee.
+ */
+class ProcedureCall : public TokenNode
+{
+	public:
+		typedef ArenaArray<Node *>::iterator iterator;
+
+		ProcedureCall(Arena &arena, const Token &procName, const std::vector<Node *> &args)
+			: args_(arena, args), procedure_(NULL)
+		{
+			setToken(procName);
+		}
+
+		std::string getName() { return getToken().value(); }
+		ProcedureDecl *getProcedure() { return procedure_; }
+		iterator begin() { return args_.begin(); }
+		iterator end()   { return args_.end(); }
+		Node  *arg(size_t i) { return args_[i]; }
+		size_t size() { return args_.size(); }
+		bool   toReal(size_t i);
+
+		void visitASTPresenter(int ind);
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
+	private:
+		ArenaArray<Node *> args_;
+		ProcedureDecl *procedure_; /*!< The callee. Set by the SemanticAnalyzer */
+}; /* ProcedureCall */
+
+/**********************************************************************/
+/**
+ * An If class
+ * IF condition THEN statement, and an optional ELSE statement.
+ * The condition is a comparison.
+ */
+class If : public Node
+{
+	public:
+		If(Node *condition, Node *thenStatement, Node *elseStatement)
+			: condition_(condition), then_(thenStatement), else_(elseStatement) {}
+
+		Node *getCondition() { return condition_; }
+		Node *getThen() { return then_; }
+		Node *getElse() { return else_; } /*!< NULL without an ELSE */
+
+		void visitASTPresenter(int ind);
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
+	private:
+		Node *condition_;
+		Node *then_;
+		Node *else_;
+}; /* If */
+
+/**********************************************************************/
+/**
+ * A While class
+ * WHILE condition DO statement
+ */
+class While : public Node
+{
+	public:
+		While(Node *condition, Node *body) : condition_(condition), body_(body) {}
+
+		Node *getCondition() { return condition_; }
+		Node *getBody() { return body_; }
+
+		void visitASTPresenter(int ind);
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
+	private:
+		Node *condition_;
+		Node *body_;
+}; /* While */
+
+/**********************************************************************/
+/**
+ * A For class
+ * FOR var := start TO bound DO statement, or DOWNTO.
+ * A counted loop: the counter is an INTEGER variable, start and bound
+ * are both evaluated once, before the counter is assigned, and the body
+ * runs once for each value from start to bound. A loop that runs zero
+ * times leaves the counter as it was. The body may not assign the
+ * counter. A procedure it calls still may, when the counter is one of
+ * its globals; each iteration then goes on from the value the counter
+ * has, and the loop ends once it is not below the bound (above it, for
+ * DOWNTO). Every backend steps the counter in this way.
+ */
+class For : public Node
+{
+	public:
+		For(Var *var, Node *start, Node *bound, bool down, Node *body)
+			: var_(var), start_(start), bound_(bound), body_(body), down_(down) {}
+
+		Var  *getVar() { return var_; }
+		Node *getStart() { return start_; }
+		Node *getBound() { return bound_; }
+		Node *getBody() { return body_; }
+		bool  isDown() { return down_; }
+
+		void visitASTPresenter(int ind);
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
+	private:
+		Var  *var_;
+		Node *start_;
+		Node *bound_;
+		Node *body_;
+		bool  down_; /*!< DOWNTO */
+}; /* For */
+
 /**********************************************************************/
 class Number : public TokenNode
 {
 	public:
-		Number(Token tok)
-       		{
+		Number(const Token &tok);
+		Number(const Token &tok, Value value) : value_(value)
+		{
 			setToken(tok);
 		}
 
-		double value() { return atof(getToken().value().c_str()); }
+		Value value() { return value_; }
+		bool  isInteger(int64_t i) { return valueType() == INTEGER && value_.i == i; }
+		SymbolType valueType() { return getToken().type() == T_INTEGER ? INTEGER : REAL; }
 
 		void visitASTPresenter(int ind);
-		void visitSemanticAnalyzer();
-		double visitEvaluate();
+		void visitSemanticAnalyzer(SemanticAnalyzer &analyzer);
+		Value visitEvaluate(Evaluator &evaluator);
+		void visitCompiler(Compiler &compiler);
+		Node *visitOptimizer(Optimizer &optimizer);
+		bool visitJit(Jit &jit);
+		void visitCEmitter(CEmitter &emitter);
 	private:
+		Value value_; /*!< Parsed once, by the constructor */
 }; /* Number */
 
 
@@ -335,23 +571,38 @@ class Number : public TokenNode
 /**********************************************************************/
 /**********************************************************************/
 /**********************************************************************/
+/**
+ * A Parser class.
+ * Pulls its tokens from the Lexer one at a time or, when given a filled
+ * TokenBuffer, walks the buffer by index.
+ */
 class Parser
 {
 	public:
-		Parser(Lexer lexer) : lexer_(lexer), currentToken_(lexer_.getNextToken()) {}
+		Parser(Lexer &lexer, TokenBuffer *tokens = NULL) : lexer_(lexer), tokens_(tokens), index_(0), tokensRead_(0), arena_(NULL) {}
+		~Parser() { delete arena_; } /* Of a parse an error cut short */
 
 		void eat(const TokenType &toktype);
+		Token nextToken();
+		Token peekToken(size_t distance);
+		size_t tokensRead() { return tokensRead_; }
 
 		std::vector<Node *>statementList();
 		Node      *statement();
 		Program   *program();
-		Node      *parse();
+		Program   *parse();
+		Program   *parseInput();
 		TokenNode *expr();
 		TokenNode *term();
 		TokenNode *factor();
 		Var       *variable();
 		Compound  *compoundStatement();
 		Assign    *assignmentStatement();
+		ProcedureCall *procedureCallStatement();
+		If        *ifStatement();
+		While     *whileStatement();
+		For       *forStatement();
+		TokenNode *condition();
 		NoOp      *empty();
 		Block     *block();
 		Type      *typeSpec();
@@ -361,8 +612,12 @@ class Parser
 		std::vector<Param *>formalParameterList();
 	private:
 		void raiseError(const TokenType &tokType);
-		Lexer lexer_;
+		Lexer &lexer_;
+		TokenBuffer *tokens_;
+		size_t index_;      /*!< Next token of tokens_ */
+		size_t tokensRead_;
 		Token currentToken_;
+		Arena *arena_; /*!< The arena of the running parse() */
 }; /* Parser */
 
 /**********************************************************************/
@@ -374,43 +629,78 @@ class Parser
 class Symbol
 {
 	public:
-		Symbol(std::string name, Symbol *type = NULL) : name_(name), type_(type) {}
+		Symbol(NameId id, Symbol *type = NULL) : id_(id), type_(type), order_(0) {}
+		virtual ~Symbol() {}
 
-		virtual std::string representation() { return name_; }
-		std::string name() { return name_; }
+		virtual std::string representation() { return name(); }
+		NameId id() { return id_; }
+		const char *name() { return InternTable::name(id_); }
 		Symbol *type() { return type_; }
+		size_t order() { return order_; }
+		void   setOrder(size_t order) { order_ = order; }
 	protected:
-		std::string name_;
+		NameId id_;
 		Symbol *type_;
+		size_t order_; /*!< How many symbols its scope had before it */
 }; /* Symbol */
 
 /**********************************************************************/
 class BuiltinTypeSymbol : public Symbol
 {
 	public:
-		BuiltinTypeSymbol(std::string name) : Symbol(name, NULL) {}
+		BuiltinTypeSymbol(NameId id, SymbolType valueType) : Symbol(id, NULL), valueType_(valueType) {}
+		SymbolType valueType() { return valueType_; }
 	private:
+		SymbolType valueType_;
 }; /* BuiltinTypeSymbol */
 
 /**********************************************************************/
+/**
+ * A VarSymbol class.
+ * Besides its name and type, a variable has a fixed address: the level
+ * of the scope it belongs to and its slot in the activation record of
+ * that scope. Both are given by ScopedSymbolTable::define.
+ */
 class VarSymbol : public Symbol
 {
 	public:
-		VarSymbol(std::string name, Symbol *type) : Symbol(name, type) {}
-		std::string representation() const { return name_; }
+		VarSymbol(NameId id, BuiltinTypeSymbol *type, const std::string &spelling)
+			: Symbol(id, type), spelling_(spelling), valueType_(type->valueType()), level_(0), slot_(-1) {}
+
+		SymbolType valueType() { return valueType_; }
+		const char *spelling() { return spelling_.c_str(); } /*!< As declared: what the memory dump prints */
+
+		int level() { return level_; }
+		int slot()  { return slot_; }
+		void setAddress(int level, int slot) { level_ = level; slot_ = slot; }
 	private:
+		std::string spelling_; /*!< name() is that of the first program of a batch to use it */
+		SymbolType valueType_;
+		int level_;
+		int slot_;
 }; /* VarSymbol */
 
 /**********************************************************************/
+/**
+ * A ProcedureSymbol class.
+ * Owns the scope of the parameters and locals of the procedure, which
+ * goes with it.
+ */
 class ProcedureSymbol : public Symbol
 {
 	public:
-		ProcedureSymbol(std::string name) : Symbol(name, NULL) {}
+		ProcedureSymbol(NameId id, ProcedureDecl *decl, ScopedSymbolTable *scope) : Symbol(id, NULL), decl_(decl), scope_(scope) {}
+		~ProcedureSymbol();
 		void add(VarSymbol *varSymbol) { params_.push_back(varSymbol); }
+		std::vector<VarSymbol *> &params() { return params_; }
+		ProcedureDecl *getDecl() { return decl_; }
 	private:
-		std::vector<VarSymbol *> params_;
-
+		ProcedureSymbol(const ProcedureSymbol &);
+		ProcedureSymbol &operator=(const ProcedureSymbol &);
 
+		std::vector<VarSymbol *> params_;
+		ProcedureDecl *decl_;
+		ScopedSymbolTable *scope_;
 }; /* ProcedureSymbol */
 
 /**********************************************************************/
@@ -419,24 +709,44 @@ class ProcedureSymbol : public Symbol
 /**********************************************************************/
 /**********************************************************************/
 /**********************************************************************/
+/**
+ * A ScopedSymbolTable class.
+ * The symbols of one scope in an open addressing hash table keyed by
+ * NameId. Ids are small and dense, so the id itself is the hash.
+ * The table owns the symbols defined in it, and so, through their
+ * ProcedureSymbols, the scopes of its procedures.
+ */
 class ScopedSymbolTable
 {
 	public:
 		ScopedSymbolTable(std::string name = "global", int level = 1, ScopedSymbolTable *enclosScope = NULL);
+		~ScopedSymbolTable();
 
 		void initBuiltins();
 		void define(Symbol *symbol);
-		Symbol *lookup(const std::string &name, bool currentScopeOnly = false);
+		void define(VarSymbol *symbol);
+		void truncate(size_t count);
+		Symbol *lookup(NameId id, bool currentScopeOnly = false);
+		Symbol *find(NameId id);
 
 		void representation();
 		int getLevel() { return level_; }
+		int frameSize() { return variables_.size(); }
+		size_t symbolCount() { return count_; }
+		std::vector<VarSymbol *> &variables() { return variables_; }
 
 		ScopedSymbolTable *getEnclosingScope() { return enclosingScope_; }
 	private:
+		ScopedSymbolTable(const ScopedSymbolTable &);
+		ScopedSymbolTable &operator=(const ScopedSymbolTable &);
+
 		std::string name_;
 		int level_;
 		ScopedSymbolTable *enclosingScope_;
-		std::map<std::string, Symbol *> symbols_;
+
+		std::vector<Symbol *> symbols_;      /*!< Power of two buckets, NULL when free */
+		size_t count_;
+		std::vector<VarSymbol *> variables_; /*!< In slot order */
 
 }; /* ScopedSymbolTable */
 
@@ -449,10 +759,10 @@ class ScopedSymbolTable
 class Interpreter
 {
 	public:
-		Interpreter(Parser parser) : parser_(parser) {}
-		Node *interpret();
+		Interpreter(Parser &parser) : parser_(parser) {}
+		Program *interpret();
 	private:
-		Parser parser_;
+		Parser &parser_;
 }; /* Interpreter */
 
 /**********************************************************************/
@@ -463,11 +773,82 @@ class Interpreter
 /**********************************************************************/
 
 			/* Visitors */
+/**
+ * An ActivationRecord
+ * The variable slots of one running program or procedure.
+ */
+struct ActivationRecord
+{
+	int     level;
+	size_t  base;         /*!< Index of the first slot in the value stack */
+	Value  *savedDisplay; /*!< The display entry of level before this record was pushed */
+	int     returnPc;     /*!< Where the VM resumes once the record is popped */
+}; /* ActivationRecord */
+
+/**********************************************************************/
+/**
+ * A CallStack class.
+ * Holds the activation records of the running program. The display maps
+ * a scope level to the slots of its innermost record, so a variable is
+ * reached with display[level][slot] and no name is looked up at runtime.
+ * The slots of all records are carved, one after the other, from a
+ * single value stack. A call costs no allocation once the stack has
+ * grown to the deepest call seen. When the stack has to grow, the
+ * display is moved along with it.
+ */
+class CallStack
+{
+	public:
+		enum { MAX_DEPTH = 10000 }; /*!< Records alive at once, the program included */
+
+		CallStack() : top_(0) {}
+
+		Value *next(int size);
+		void   push(int level, int size, int given = 0, int returnPc = -1);
+		void   extend(int size);
+		int    pop();
+		size_t depth() const { return records_.size(); }
+
+		Value  *frame(int level) { return display_[level]; }
+		Value **display() { return &display_[0]; }
+	private:
+		void grow(size_t size);
+
+		std::vector<Value> values_;  /*!< The value stack */
+		size_t top_;                 /*!< First free slot of values_ */
+		std::vector<Value *> display_;
+		std::vector<ActivationRecord> records_;
+}; /* CallStack */
+
+/**********************************************************************/
+/**
+ * An Evaluator
+ * Runs a program. By default the tree is compiled to Bytecode and run
+ * by the VM. TREE mode keeps the recursive visitEvaluate walk around
+ * so both can be compared on the same program.
+ * The Evaluator sets up the global activation record and prints the
+ * global variables once the program is done. It owns the CallStack, so
+ * programs run by different Evaluators do not share any state.
+ */
 class Evaluator
 {
 	public:
-		double visit(Node *node) { return node->visitEvaluate(); }
+		enum Mode { VM, TREE };
+
+		Evaluator(Mode mode = VM, bool disassemble = false, Jit *jit = NULL) : mode_(mode), disassemble_(disassemble), jit_(jit) {}
+		Value visit(Program *program);
+		Bytecode *compile(Program *program);
+		Value run(Bytecode *code);
+		void printMemory(ScopedSymbolTable *scope);
+		void printMemory(Bytecode *code);
+		static void printVariable(const char *name, SymbolType type, Value value);
+
+		CallStack &callStack() { return callStack_; }
 	private:
+		CallStack callStack_; /*!< Of the program this Evaluator runs */
+		Mode mode_;
+		bool disassemble_;
+		Jit *jit_; /*!< Native code for the VM, or NULL */
 };
 
 /**********************************************************************/
@@ -484,14 +865,46 @@ class ASTPresenter
 };
 
 /**********************************************************************/
+/**
+ * A SemanticAnalyzer class.
+ * Resolves the names of a tree and checks its types, through
+ * Node::visitSemanticAnalyzer. It holds all the state of one analysis:
+ * the scope being analysed and the FOR counters around the node, so
+ * analysers of different programs may run on different threads. A run
+ * of at least MIN_PARALLEL sibling procedures is analysed on the
+ * TaskPool by analysers of their own, see analyzeProcedures().
+ */
 class SemanticAnalyzer 
 {
 	public:
-		void visit(Node *node) { node->visitSemanticAnalyzer(); }
-		static ScopedSymbolTable *scope_;
-		static ScopedSymbolTable *currentScope_;
+		enum { MIN_PARALLEL = 8 }; /*!< Fewer sibling procedures are analysed in turn */
+
+		SemanticAnalyzer() : currentScope_(NULL) {}
+
+		void visit(Node *node) { node->visitSemanticAnalyzer(*this); }
+		void analyzeProcedures(Node **procedures, size_t count);
+		Symbol *lookup(NameId id, bool currentScopeOnly = false);
+
+		ScopedSymbolTable *getScope() { return currentScope_; }
+		void setScope(ScopedSymbolTable *scope) { currentScope_ = scope; }
+		std::vector<Var *> &counters() { return counters_; }
 	private:
+		/**
+		 * A Horizon struct.
+		 * The symbols of scope a procedure body analysed ahead of time
+		 * may see: those before order, as in a serial run
+		 */
+		struct Horizon
+		{
+			ScopedSymbolTable *scope;
+			size_t order;
+		};
+
+		bool visible(ScopedSymbolTable *scope, Symbol *symbol);
 
+		ScopedSymbolTable *currentScope_;
+		std::vector<Var *> counters_;     /*!< Counters of the FOR loops being analysed */
+		std::vector<Horizon> horizons_;
 };
 
 
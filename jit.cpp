@@ -0,0 +1,937 @@
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "jit.hpp"
+#include "interpreter.hpp"
+#include "clog.hpp"
+#include "trace.hpp"
+
+/*!
+ * \file jit.cpp
+ */
+
+/**********************************************************************/
+/*!
+ *  \brief Names of the 64 bit registers and of the XMM registers,
+ *  for the listing
+ */
+static const char *intName[8]  = { "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi" };
+static const char *realName[8] = { "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7" };
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                        Jit methods                                 */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+Jit::~Jit()
+{
+	if (memory_) {
+		munmap(memory_, mapped_);
+	}
+} /* Jit::~Jit */
+
+/**********************************************************************/
+/*!
+ * fn bool Jit::supported()
+ * \brief Whether this build can run the code the Jit makes
+ */
+bool Jit::supported()
+{
+#if defined(__x86_64__)
+	return true;
+#else
+	return false;
+#endif
+} /* Jit::supported */
+
+/**********************************************************************/
+/*!
+ * fn int Jit::compile(Node **statements, size_t count, size_t *compiled)
+ * \brief Translates the longest run of statements, from the first of the
+ * count given, into one native function. A statement that can not be
+ * translated ends the run, and its code so far is dropped.
+ * \return The index of the function in functions(), with the length of
+ * the run in compiled, or -1 if the run would do nothing
+ */
+int Jit::compile(Node **statements, size_t count, size_t *compiled)
+{
+	if (!supported()) {
+		return -1;
+	}
+	size_t entry = code_.size();
+	note("push rbx");
+	emit({ 0x53 });
+	note("mov rbx, rsp");
+	emit({ 0x48, 0x89, 0xE3 });
+	size_t body = code_.size();
+	size_t n = 0;
+	while (n < count) {
+		size_t mark = code_.size();
+		if (!statements[n]->visitJit(*this)) {
+			rewind(mark);
+			break;
+		}
+		n++;
+	}
+	if (code_.size() == body) {
+		/* Nothing translated, or only empty statements */
+		rewind(entry);
+		return -1;
+	}
+	note("xor eax, eax");
+	emit({ 0x31, 0xC0 });
+	note("pop rbx");
+	emit({ 0x5B });
+	note("ret");
+	emit({ 0xC3 });
+
+	entries_.push_back(entry);
+	statements_ += n;
+	*compiled = n;
+	TRACE(TRACE_EVAL, "Jit: function %zu, %zu statements, %zu bytes\n", entries_.size() - 1, n, code_.size() - entry);
+	return entries_.size() - 1;
+} /* Jit::compile */
+
+/**********************************************************************/
+/*!
+ * fn bool Jit::finish()
+ * \brief Copies the code into pages of its own and makes them executable
+ * instead of writable. functions() is valid from here on.
+ * \return false if the system refused the memory
+ */
+bool Jit::finish()
+{
+	if (code_.empty()) {
+		return true;
+	}
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t size = (code_.size() + page - 1) / page * page;
+	void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) {
+		return false;
+	}
+	memcpy(memory, &code_[0], code_.size());
+	if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+		munmap(memory, size);
+		return false;
+	}
+	memory_ = memory;
+	mapped_ = size;
+
+	functions_.clear();
+	for (size_t i = 0; i < entries_.size(); i++) {
+		functions_.push_back((NativeCode)((uint8_t *)memory_ + entries_[i]));
+	}
+	if (dump_) {
+		dump();
+	}
+	return true;
+} /* Jit::finish */
+
+/**********************************************************************/
+/*!
+ * fn void Jit::dump()
+ * \brief Prints every function: the offset, the bytes and the text of
+ * each instruction
+ */
+void Jit::dump()
+{
+	CLog::write(CLog::RELEASE, "JIT: %zu functions, %zu bytes at %p\n", entries_.size(), code_.size(), memory_);
+	size_t function = 0;
+	for (size_t i = 0; i < lineAt_.size(); i++) {
+		if (function < entries_.size() && entries_[function] == lineAt_[i]) {
+			CLog::write(CLog::RELEASE, "Native %zu:\n", function++);
+		}
+		size_t end = i + 1 < lineAt_.size() ? lineAt_[i + 1] : code_.size();
+		char hex[64] = "";
+		size_t length = 0;
+		for (size_t at = lineAt_[i]; at < end && length + 3 < sizeof(hex); at++) {
+			length += snprintf(hex + length, sizeof(hex) - length, "%02x ", code_[at]);
+		}
+		CLog::write(CLog::RELEASE, "%6zu  %-31s %s\n", lineAt_[i] - entries_[function - 1], hex, lines_[i].c_str());
+	}
+} /* Jit::dump */
+
+/**********************************************************************/
+/*!
+ * fn void Jit::note(const char *format, ...)
+ * \brief Names the instruction emitted next, when dumping
+ */
+void Jit::note(const char *format, ...)
+{
+	if (!dump_) {
+		return;
+	}
+	char text[96];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+	lineAt_.push_back(code_.size());
+	lines_.push_back(text);
+} /* Jit::note */
+
+/**********************************************************************/
+void Jit::rewind(size_t size)
+{
+	code_.resize(size);
+	while (!lineAt_.empty() && lineAt_.back() >= size) {
+		lineAt_.pop_back();
+		lines_.pop_back();
+	}
+} /* Jit::rewind */
+
+/**********************************************************************/
+void Jit::emit(std::initializer_list<uint8_t> bytes)
+{
+	code_.insert(code_.end(), bytes);
+} /* Jit::emit */
+
+/**********************************************************************/
+void Jit::emit32(int32_t value)
+{
+	for (int i = 0; i < 4; i++) {
+		code_.push_back((uint8_t)(value >> (8 * i)));
+	}
+} /* Jit::emit32 */
+
+/**********************************************************************/
+void Jit::emit64(int64_t value)
+{
+	for (int i = 0; i < 8; i++) {
+		code_.push_back((uint8_t)(value >> (8 * i)));
+	}
+} /* Jit::emit64 */
+
+/**********************************************************************/
+/*!
+ * fn void Jit::address(int reg, int base, int32_t disp)
+ * \brief The ModRM byte, and the SIB byte and displacement it needs,
+ * of an instruction between reg and the memory at [base + disp]
+ */
+void Jit::address(int reg, int base, int32_t disp)
+{
+	int mod = 2;
+	if (disp == 0) {
+		mod = 0;
+	} else if (disp >= -128 && disp <= 127) {
+		mod = 1;
+	}
+	code_.push_back((uint8_t)(mod << 6 | reg << 3 | base));
+	if (base == RSP) {
+		code_.push_back(0x24);
+	}
+	if (mod == 1) {
+		code_.push_back((uint8_t)disp);
+	} else if (mod == 2) {
+		emit32(disp);
+	}
+} /* Jit::address */
+
+/**********************************************************************/
+/*!
+ * fn void Jit::loadInt(int reg, int level, int slot)
+ * \brief reg = display[level][slot]. Leaves display[level] in RSI.
+ */
+void Jit::loadInt(int reg, int level, int slot)
+{
+	note("mov rsi, [rdi+%d]", level * 8);
+	emit({ 0x48, 0x8B });
+	address(RSI, RDI, level * 8);
+	note("mov %s, [rsi+%d]", intName[reg], slot * 8);
+	emit({ 0x48, 0x8B });
+	address(reg, RSI, slot * 8);
+} /* Jit::loadInt */
+
+/**********************************************************************/
+/*!
+ * fn void Jit::storeInt(int level, int slot)
+ * \brief display[level][slot] = RAX
+ */
+void Jit::storeInt(int level, int slot)
+{
+	note("mov rsi, [rdi+%d]", level * 8);
+	emit({ 0x48, 0x8B });
+	address(RSI, RDI, level * 8);
+	note("mov [rsi+%d], rax", slot * 8);
+	emit({ 0x48, 0x89 });
+	address(RAX, RSI, slot * 8);
+} /* Jit::storeInt */
+
+/**********************************************************************/
+void Jit::loadReal(int xmm, int level, int slot)
+{
+	note("mov rsi, [rdi+%d]", level * 8);
+	emit({ 0x48, 0x8B });
+	address(RSI, RDI, level * 8);
+	note("movsd %s, [rsi+%d]", realName[xmm], slot * 8);
+	emit({ 0xF2, 0x0F, 0x10 });
+	address(xmm, RSI, slot * 8);
+} /* Jit::loadReal */
+
+/**********************************************************************/
+/*!
+ * fn void Jit::storeReal(int level, int slot)
+ * \brief display[level][slot] = XMM0
+ */
+void Jit::storeReal(int level, int slot)
+{
+	note("mov rsi, [rdi+%d]", level * 8);
+	emit({ 0x48, 0x8B });
+	address(RSI, RDI, level * 8);
+	note("movsd [rsi+%d], xmm0", slot * 8);
+	emit({ 0xF2, 0x0F, 0x11 });
+	address(XMM0, RSI, slot * 8);
+} /* Jit::storeReal */
+
+/**********************************************************************/
+void Jit::constant(int reg, int64_t value)
+{
+	note("mov %s, %lld", intName[reg], (long long)value);
+	if (value >= INT32_MIN && value <= INT32_MAX) {
+		emit({ 0x48, 0xC7, (uint8_t)(0xC0 | reg) });
+		emit32((int32_t)value);
+	} else {
+		emit({ 0x48, (uint8_t)(0xB8 | reg) });
+		emit64(value);
+	}
+} /* Jit::constant */
+
+/**********************************************************************/
+/*!
+ * fn void Jit::constantReal(int xmm, double value)
+ * \brief xmm = value, through RCX
+ */
+void Jit::constantReal(int xmm, double value)
+{
+	Value bits = Value::real(value);
+	note("mov rcx, %g", value);
+	emit({ 0x48, 0xB9 });
+	emit64(bits.i);
+	note("movq %s, rcx", realName[xmm]);
+	emit({ 0x66, 0x48, 0x0F, 0x6E, (uint8_t)(0xC0 | xmm << 3 | RCX) });
+} /* Jit::constantReal */
+
+/**********************************************************************/
+/*!
+ * fn bool Jit::operand(Node *node, bool real)
+ * \brief Loads a Var or a Number straight into RCX, or into XMM1 if
+ * real, where a BinOp wants its right operand. An INTEGER is
+ * converted for a REAL operation.
+ * \return false, emitting nothing, for any other node
+ */
+bool Jit::operand(Node *node, bool real)
+{
+	Var *var = dynamic_cast<Var *>(node);
+	Number *number = dynamic_cast<Number *>(node);
+	if (!var && !number) {
+		return false;
+	}
+	if (real && node->valueType() == REAL) {
+		if (var) {
+			loadReal(XMM1, var->level(), var->slot());
+		} else {
+			constantReal(XMM1, number->value().r);
+		}
+		return true;
+	}
+	if (var) {
+		loadInt(RCX, var->level(), var->slot());
+	} else {
+		constant(RCX, number->value().i);
+	}
+	if (real) {
+		toReal(XMM1, RCX);
+	}
+	return true;
+} /* Jit::operand */
+
+/**********************************************************************/
+void Jit::toReal(int xmm, int reg)
+{
+	note("cvtsi2sd %s, %s", realName[xmm], intName[reg]);
+	emit({ 0xF2, 0x48, 0x0F, 0x2A, (uint8_t)(0xC0 | xmm << 3 | reg) });
+} /* Jit::toReal */
+
+/**********************************************************************/
+void Jit::moveInt(int dst, int src)
+{
+	note("mov %s, %s", intName[dst], intName[src]);
+	emit({ 0x48, 0x89, (uint8_t)(0xC0 | src << 3 | dst) });
+} /* Jit::moveInt */
+
+/**********************************************************************/
+void Jit::moveReal(int dst, int src)
+{
+	note("movapd %s, %s", realName[dst], realName[src]);
+	emit({ 0x66, 0x0F, 0x28, (uint8_t)(0xC0 | dst << 3 | src) });
+} /* Jit::moveReal */
+
+/**********************************************************************/
+void Jit::pushInt()
+{
+	note("push rax");
+	emit({ 0x50 });
+} /* Jit::pushInt */
+
+/**********************************************************************/
+void Jit::popInt(int reg)
+{
+	note("pop %s", intName[reg]);
+	emit({ (uint8_t)(0x58 | reg) });
+} /* Jit::popInt */
+
+/**********************************************************************/
+void Jit::pushReal()
+{
+	note("sub rsp, 8");
+	emit({ 0x48, 0x83, 0xEC, 0x08 });
+	note("movsd [rsp], xmm0");
+	emit({ 0xF2, 0x0F, 0x11 });
+	address(XMM0, RSP, 0);
+} /* Jit::pushReal */
+
+/**********************************************************************/
+void Jit::popReal(int xmm)
+{
+	note("movsd %s, [rsp]", realName[xmm]);
+	emit({ 0xF2, 0x0F, 0x10 });
+	address(xmm, RSP, 0);
+	note("add rsp, 8");
+	emit({ 0x48, 0x83, 0xC4, 0x08 });
+} /* Jit::popReal */
+
+/**********************************************************************/
+/*!
+ * fn void Jit::intOp(Kernel kernel)
+ * \brief RAX = RAX op RCX for an _II kernel. Arithmetic wraps around
+ * like applyKernel. DIV returns 1 from the function for a zero divisor,
+ * with the stack it was called with, and negates for -1, which idiv
+ * would trap on for the smallest INTEGER. A comparison leaves 0 or 1.
+ */
+void Jit::intOp(Kernel kernel)
+{
+	uint8_t setcc = 0;
+	switch (kernel)
+	{
+		case K_ADD_II:
+			note("add rax, rcx");
+			emit({ 0x48, 0x01, 0xC8 });
+			return;
+		case K_SUB_II:
+			note("sub rax, rcx");
+			emit({ 0x48, 0x29, 0xC8 });
+			return;
+		case K_MUL_II:
+			note("imul rax, rcx");
+			emit({ 0x48, 0x0F, 0xAF, 0xC1 });
+			return;
+		case K_INT_DIV_II:
+			note("test rcx, rcx");
+			emit({ 0x48, 0x85, 0xC9 });
+			note("jnz +10");
+			emit({ 0x75, 0x0A });
+			note("mov rsp, rbx");
+			emit({ 0x48, 0x89, 0xDC });
+			note("pop rbx");
+			emit({ 0x5B });
+			note("mov eax, 1");
+			emit({ 0xB8 });
+			emit32(1);
+			note("ret");
+			emit({ 0xC3 });
+			note("cmp rcx, -1");
+			emit({ 0x48, 0x83, 0xF9, 0xFF });
+			note("jne +5");
+			emit({ 0x75, 0x05 });
+			note("neg rax");
+			emit({ 0x48, 0xF7, 0xD8 });
+			note("jmp +5");
+			emit({ 0xEB, 0x05 });
+			note("cqo");
+			emit({ 0x48, 0x99 });
+			note("idiv rcx");
+			emit({ 0x48, 0xF7, 0xF9 });
+			return;
+		case K_EQ_II: setcc = 0x94; break;
+		case K_NE_II: setcc = 0x95; break;
+		case K_LT_II: setcc = 0x9C; break;
+		case K_LE_II: setcc = 0x9E; break;
+		case K_GT_II: setcc = 0x9F; break;
+		case K_GE_II: setcc = 0x9D; break;
+		default:
+			CLog::write(CLog::RELEASE, "Jit::intOp(): Unknown kernel %d\n", kernel);
+			abort();
+	}
+	note("cmp rax, rcx");
+	emit({ 0x48, 0x39, 0xC8 });
+	note("set%s al", kernel == K_EQ_II ? "e" : kernel == K_NE_II ? "ne" : kernel == K_LT_II ? "l" :
+			kernel == K_LE_II ? "le" : kernel == K_GT_II ? "g" : "ge");
+	emit({ 0x0F, setcc, 0xC0 });
+	note("movzx eax, al");
+	emit({ 0x0F, 0xB6, 0xC0 });
+} /* Jit::intOp */
+
+/**********************************************************************/
+/*!
+ * fn void Jit::realOp(Kernel kernel)
+ * \brief XMM0 = XMM0 op XMM1 for an _RR, _IR or _RI kernel, or DIV of
+ * two INTEGERs, once both operands are REALs. A comparison leaves 0 or
+ * 1 in RAX; like the C++ operators, every comparison with a NaN is false
+ * but <>.
+ */
+void Jit::realOp(Kernel kernel)
+{
+	switch (kernel)
+	{
+		case K_ADD_RR: case K_ADD_IR: case K_ADD_RI:
+			note("addsd xmm0, xmm1");
+			emit({ 0xF2, 0x0F, 0x58, 0xC1 });
+			return;
+		case K_SUB_RR: case K_SUB_IR: case K_SUB_RI:
+			note("subsd xmm0, xmm1");
+			emit({ 0xF2, 0x0F, 0x5C, 0xC1 });
+			return;
+		case K_MUL_RR: case K_MUL_IR: case K_MUL_RI:
+			note("mulsd xmm0, xmm1");
+			emit({ 0xF2, 0x0F, 0x59, 0xC1 });
+			return;
+		case K_DIV_RR: case K_DIV_IR: case K_DIV_RI: case K_DIV_II:
+			note("divsd xmm0, xmm1");
+			emit({ 0xF2, 0x0F, 0x5E, 0xC1 });
+			return;
+		case K_EQ_RR: case K_EQ_IR: case K_EQ_RI:
+			note("ucomisd xmm0, xmm1");
+			emit({ 0x66, 0x0F, 0x2E, 0xC1 });
+			note("sete al");
+			emit({ 0x0F, 0x94, 0xC0 });
+			note("setnp cl");
+			emit({ 0x0F, 0x9B, 0xC1 });
+			note("and al, cl");
+			emit({ 0x20, 0xC8 });
+			break;
+		case K_NE_RR: case K_NE_IR: case K_NE_RI:
+			note("ucomisd xmm0, xmm1");
+			emit({ 0x66, 0x0F, 0x2E, 0xC1 });
+			note("setne al");
+			emit({ 0x0F, 0x95, 0xC0 });
+			note("setp cl");
+			emit({ 0x0F, 0x9A, 0xC1 });
+			note("or al, cl");
+			emit({ 0x08, 0xC8 });
+			break;
+		case K_LT_RR: case K_LT_IR: case K_LT_RI:
+			note("ucomisd xmm1, xmm0");
+			emit({ 0x66, 0x0F, 0x2E, 0xC8 });
+			note("seta al");
+			emit({ 0x0F, 0x97, 0xC0 });
+			break;
+		case K_LE_RR: case K_LE_IR: case K_LE_RI:
+			note("ucomisd xmm1, xmm0");
+			emit({ 0x66, 0x0F, 0x2E, 0xC8 });
+			note("setae al");
+			emit({ 0x0F, 0x93, 0xC0 });
+			break;
+		case K_GT_RR: case K_GT_IR: case K_GT_RI:
+			note("ucomisd xmm0, xmm1");
+			emit({ 0x66, 0x0F, 0x2E, 0xC1 });
+			note("seta al");
+			emit({ 0x0F, 0x97, 0xC0 });
+			break;
+		case K_GE_RR: case K_GE_IR: case K_GE_RI:
+			note("ucomisd xmm0, xmm1");
+			emit({ 0x66, 0x0F, 0x2E, 0xC1 });
+			note("setae al");
+			emit({ 0x0F, 0x93, 0xC0 });
+			break;
+		default:
+			CLog::write(CLog::RELEASE, "Jit::realOp(): Unknown kernel %d\n", kernel);
+			abort();
+	}
+	note("movzx eax, al");
+	emit({ 0x0F, 0xB6, 0xC0 });
+} /* Jit::realOp */
+
+/**********************************************************************/
+void Jit::negInt()
+{
+	note("neg rax");
+	emit({ 0x48, 0xF7, 0xD8 });
+} /* Jit::negInt */
+
+/**********************************************************************/
+/*!
+ * fn void Jit::negReal()
+ * \brief Flips the sign bit of XMM0, as -x does
+ */
+void Jit::negReal()
+{
+	constantReal(XMM1, -0.0);
+	note("xorpd xmm0, xmm1");
+	emit({ 0x66, 0x0F, 0x57, 0xC1 });
+} /* Jit::negReal */
+
+/**********************************************************************/
+/*!
+ * fn size_t Jit::jumpIfZero()
+ * \brief Jumps if RAX is 0, to where bind() says
+ * \return The place of the displacement, for bind()
+ */
+size_t Jit::jumpIfZero()
+{
+	note("test rax, rax");
+	emit({ 0x48, 0x85, 0xC0 });
+	note("jz");
+	emit({ 0x0F, 0x84 });
+	emit32(0);
+	return code_.size() - 4;
+} /* Jit::jumpIfZero */
+
+/**********************************************************************/
+size_t Jit::jump()
+{
+	note("jmp");
+	emit({ 0xE9 });
+	emit32(0);
+	return code_.size() - 4;
+} /* Jit::jump */
+
+/**********************************************************************/
+/*!
+ * fn void Jit::jumpTo(size_t target)
+ * \brief Jumps back to target, an offset already emitted
+ */
+void Jit::jumpTo(size_t target)
+{
+	note("jmp %+d", (int)(target - (code_.size() + 5)));
+	emit({ 0xE9 });
+	emit32((int32_t)(target - (code_.size() + 4)));
+} /* Jit::jumpTo */
+
+/**********************************************************************/
+/*!
+ * fn void Jit::bind(size_t at)
+ * \brief Points the jump whose displacement is at, to here()
+ */
+void Jit::bind(size_t at)
+{
+	int32_t disp = (int32_t)(code_.size() - (at + 4));
+	for (int i = 0; i < 4; i++) {
+		code_[at + i] = (uint8_t)(disp >> (8 * i));
+	}
+	for (size_t i = lineAt_.size(); i-- > 0; ) {
+		if (lineAt_[i] < at) {
+			char text[16];
+			snprintf(text, sizeof(text), " %+d", disp);
+			lines_[i] += text;
+			break;
+		}
+	}
+} /* Jit::bind */
+
+/**********************************************************************/
+/*!
+ * fn size_t Jit::forEnter(int level, int slot, bool down)
+ * \brief With the start of a FOR on top of the machine stack and its
+ * bound in RAX, leaves the bound on the stack, and skips the loop if the
+ * start is already past it or else sets the counter to the start
+ * \return The place of the displacement, for bind()
+ */
+size_t Jit::forEnter(int level, int slot, bool down)
+{
+	note("xchg rax, [rsp]");
+	emit({ 0x48, 0x87 });
+	address(RAX, RSP, 0);
+	note("cmp rax, [rsp]");
+	emit({ 0x48, 0x3B });
+	address(RAX, RSP, 0);
+	note(down ? "jl" : "jg");
+	emit({ 0x0F, (uint8_t)(down ? 0x8C : 0x8F) });
+	emit32(0);
+	size_t toEnd = code_.size() - 4;
+	storeInt(level, slot);
+	return toEnd;
+} /* Jit::forEnter */
+
+/**********************************************************************/
+/*!
+ * fn void Jit::forNext(int level, int slot, bool down, size_t body)
+ * \brief The end of a FOR body: unless the counter has reached the
+ * bound, steps it and jumps back to body. The counter stays at the bound
+ * when the loop ends, as with OP_NEXT_UP.
+ */
+void Jit::forNext(int level, int slot, bool down, size_t body)
+{
+	loadInt(RAX, level, slot);
+	note("cmp rax, [rsp]");
+	emit({ 0x48, 0x3B });
+	address(RAX, RSP, 0);
+	note(down ? "jle" : "jge");
+	emit({ 0x0F, (uint8_t)(down ? 0x8E : 0x8D) });
+	emit32(0);
+	size_t done = code_.size() - 4;
+	note(down ? "dec rax" : "inc rax");
+	emit({ 0x48, 0xFF, (uint8_t)(down ? 0xC8 : 0xC0) });
+	note("mov [rsi+%d], rax", slot * 8);
+	emit({ 0x48, 0x89 });
+	address(RAX, RSI, slot * 8);
+	jumpTo(body);
+	bind(done);
+} /* Jit::forNext */
+
+/**********************************************************************/
+/*!
+ * fn void Jit::dropBound()
+ * \brief Pops the bound of a FOR that has ended
+ */
+void Jit::dropBound()
+{
+	note("add rsp, 8");
+	emit({ 0x48, 0x83, 0xC4, 0x08 });
+} /* Jit::dropBound */
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                    Node::visitJit methods                          */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+bool Program::visitJit(Jit &jit)
+{
+	return false;
+} /* Program::visitJit */
+
+/**********************************************************************/
+bool Block::visitJit(Jit &jit)
+{
+	return false;
+} /* Block::visitJit */
+
+/**********************************************************************/
+bool VarDecl::visitJit(Jit &jit)
+{
+	return false;
+} /* VarDecl::visitJit */
+
+/**********************************************************************/
+bool Type::visitJit(Jit &jit)
+{
+	return false;
+} /* Type::visitJit */
+
+/**********************************************************************/
+bool Compound::visitJit(Jit &jit)
+{
+	Compound::iterator it;
+	for (it = this->begin(); it != this->end(); it++) {
+		if (!(*it)->visitJit(jit)) {
+			return false;
+		}
+	}
+	return true;
+} /* Compound::visitJit */
+
+/**********************************************************************/
+bool NoOp::visitJit(Jit &jit)
+{
+	return true;
+} /* NoOp::visitJit */
+
+/**********************************************************************/
+bool Assign::visitJit(Jit &jit)
+{
+	if (!getRhs()->visitJit(jit)) {
+		return false;
+	}
+	if (toReal()) {
+		jit.toReal(XMM0, RAX);
+	}
+	if (getLhs()->valueType() == REAL) {
+		jit.storeReal(getLhs()->level(), getLhs()->slot());
+	} else {
+		jit.storeInt(getLhs()->level(), getLhs()->slot());
+	}
+	return true;
+} /* Assign::visitJit */
+
+/**********************************************************************/
+bool Var::visitJit(Jit &jit)
+{
+	if (valueType() == REAL) {
+		jit.loadReal(XMM0, level(), slot());
+	} else {
+		jit.loadInt(RAX, level(), slot());
+	}
+	return true;
+} /* Var::visitJit */
+
+/**********************************************************************/
+/*!
+ * fn bool BinOp::visitJit(Jit &jit)
+ * \brief The left operand is computed first. A Var or Number on the
+ * right is loaded straight into the second register; anything else is
+ * computed after saving the left operand on the machine stack.
+ */
+bool BinOp::visitJit(Jit &jit)
+{
+	Kernel kernel = getKernel();
+	bool real = kernel == K_DIV_II || (kernel >= K_ADD_RR && kernel <= K_GE_RI);
+
+	if (!getLhs()->visitJit(jit)) {
+		return false;
+	}
+	if (real && getLhs()->valueType() != REAL) {
+		jit.toReal(XMM0, RAX);
+	}
+
+	if (!jit.operand(getRhs(), real)) {
+		if (real) {
+			jit.pushReal();
+		} else {
+			jit.pushInt();
+		}
+		if (!getRhs()->visitJit(jit)) {
+			return false;
+		}
+		if (real) {
+			if (getRhs()->valueType() != REAL) {
+				jit.toReal(XMM0, RAX);
+			}
+			jit.moveReal(XMM1, XMM0);
+			jit.popReal(XMM0);
+		} else {
+			jit.moveInt(RCX, RAX);
+			jit.popInt(RAX);
+		}
+	}
+
+	if (real) {
+		jit.realOp(kernel);
+	} else {
+		jit.intOp(kernel);
+	}
+	return true;
+} /* BinOp::visitJit */
+
+/**********************************************************************/
+bool UnaryOp::visitJit(Jit &jit)
+{
+	if (!getExpr()->visitJit(jit)) {
+		return false;
+	}
+	if (getKernel() == K_NEG_I) {
+		jit.negInt();
+	} else if (getKernel() == K_NEG_R) {
+		jit.negReal();
+	}
+	return true;
+} /* UnaryOp::visitJit */
+
+/**********************************************************************/
+bool Number::visitJit(Jit &jit)
+{
+	if (valueType() == REAL) {
+		jit.constantReal(XMM0, value().r);
+	} else {
+		jit.constant(RAX, value().i);
+	}
+	return true;
+} /* Number::visitJit */
+
+/**********************************************************************/
+bool Param::visitJit(Jit &jit)
+{
+	return false;
+} /* Param::visitJit */
+
+/**********************************************************************/
+bool ProcedureDecl::visitJit(Jit &jit)
+{
+	return false;
+} /* ProcedureDecl::visitJit */
+
+/**********************************************************************/
+/*!
+ * fn bool ProcedureCall::visitJit(Jit &jit)
+ * \brief A call needs a new activation record, which may move the
+ * display the native code holds: calls stay bytecode
+ */
+bool ProcedureCall::visitJit(Jit &jit)
+{
+	return false;
+} /* ProcedureCall::visitJit */
+
+/**********************************************************************/
+bool If::visitJit(Jit &jit)
+{
+	if (!getCondition()->visitJit(jit)) {
+		return false;
+	}
+	size_t toElse = jit.jumpIfZero();
+	if (!getThen()->visitJit(jit)) {
+		return false;
+	}
+	if (getElse()) {
+		size_t toEnd = jit.jump();
+		jit.bind(toElse);
+		if (!getElse()->visitJit(jit)) {
+			return false;
+		}
+		jit.bind(toEnd);
+	} else {
+		jit.bind(toElse);
+	}
+	return true;
+} /* If::visitJit */
+
+/**********************************************************************/
+bool While::visitJit(Jit &jit)
+{
+	size_t head = jit.here();
+	if (!getCondition()->visitJit(jit)) {
+		return false;
+	}
+	size_t toEnd = jit.jumpIfZero();
+	if (!getBody()->visitJit(jit)) {
+		return false;
+	}
+	jit.jumpTo(head);
+	jit.bind(toEnd);
+	return true;
+} /* While::visitJit */
+
+/**********************************************************************/
+/*!
+ * fn bool For::visitJit(Jit &jit)
+ * \brief Like For::visitCompiler, with the start kept on the machine
+ * stack while the bound is evaluated, and the bound while the loop runs
+ */
+bool For::visitJit(Jit &jit)
+{
+	int level = getVar()->level();
+	int slot  = getVar()->slot();
+
+	if (!getStart()->visitJit(jit)) {
+		return false;
+	}
+	jit.pushInt();
+	if (!getBound()->visitJit(jit)) {
+		return false;
+	}
+
+	size_t toEnd = jit.forEnter(level, slot, isDown());
+	size_t body = jit.here();
+	if (!getBody()->visitJit(jit)) {
+		return false;
+	}
+	jit.forNext(level, slot, isDown(), body);
+	jit.bind(toEnd);
+	jit.dropBound();
+	return true;
+} /* For::visitJit */
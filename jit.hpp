@@ -0,0 +1,110 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+#include <string>
+#include "value.hpp"
+
+/*!
+ * \file jit.hpp
+ * \brief Native x86-64 code for the statements of an analysed tree.
+ */
+
+class Node;
+
+/*!
+ * A function made by the Jit. It runs its statements on the variables
+ * that display, the display of the CallStack, addresses. It returns 0,
+ * or 1 if it stopped at a DIV by zero, for its caller to report: no
+ * error can be thrown through native code.
+ */
+typedef int (*NativeCode)(Value **display);
+
+/*!
+ *  \enum JitRegister
+ *  \brief The registers the generated code uses. INTEGERs and BOOLEANs
+ *  are computed in RAX, REALs in XMM0; RCX and XMM1 hold the right
+ *  operand of a BinOp; RSI holds display[level]; RDI is display itself;
+ *  RBX keeps the stack pointer the function started with.
+ */
+enum JitRegister
+{
+	RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RSI = 6, RDI = 7,
+	XMM0 = 0, XMM1 = 1
+}; /* JitRegister */
+
+/**********************************************************************/
+/**
+ * A Jit class.
+ * Compiles runs of statements to x86-64 code for the VM. The Compiler
+ * offers each Compound's statements to compile(): the longest run that
+ * Node::visitJit can translate becomes one native function, called by a
+ * single OP_NATIVE, and everything else stays bytecode. Assign, Compound,
+ * If, While and For statements over Var, Number, BinOp and UnaryOp
+ * expressions are translated; a ProcedureCall is not.
+ * The code is collected in a buffer and copied once, by finish(), into
+ * memory that is mapped writable and then made executable.
+ */
+class Jit
+{
+	public:
+		Jit(bool dump = false) : dump_(dump), memory_(NULL), mapped_(0), statements_(0) {}
+		~Jit();
+
+		static bool supported();
+
+		int  compile(Node **statements, size_t count, size_t *compiled);
+		bool finish();
+
+		const std::vector<NativeCode> &functions() { return functions_; }
+		size_t bytes()      { return code_.size(); }
+		size_t statements() { return statements_; }
+
+		/* Instructions, for the Node::visitJit methods */
+		void loadInt(int reg, int level, int slot);
+		void storeInt(int level, int slot);
+		void loadReal(int xmm, int level, int slot);
+		void storeReal(int level, int slot);
+		void constant(int reg, int64_t value);
+		void constantReal(int xmm, double value);
+		bool operand(Node *node, bool real);
+		void toReal(int xmm, int reg);
+		void moveInt(int dst, int src);
+		void moveReal(int dst, int src);
+		void pushInt();
+		void popInt(int reg);
+		void pushReal();
+		void popReal(int xmm);
+		void intOp(Kernel kernel);
+		void realOp(Kernel kernel);
+		void negInt();
+		void negReal();
+
+		size_t here() { return code_.size(); }
+		size_t jumpIfZero();
+		size_t jump();
+		void   jumpTo(size_t target);
+		void   bind(size_t at);
+		size_t forEnter(int level, int slot, bool down);
+		void   forNext(int level, int slot, bool down, size_t body);
+		void   dropBound();
+	private:
+		void note(const char *format, ...);
+		void emit(std::initializer_list<uint8_t> bytes);
+		void emit32(int32_t value);
+		void emit64(int64_t value);
+		void address(int reg, int base, int32_t disp);
+		void rewind(size_t size);
+		void dump();
+
+		bool dump_;
+		std::vector<uint8_t>     code_;
+		std::vector<size_t>      entries_;   /*!< Offset of each function in code_ */
+		std::vector<size_t>      lineAt_;    /*!< Offset of each instruction in code_, for dump() */
+		std::vector<std::string> lines_;     /*!< Its text */
+		std::vector<NativeCode>  functions_; /*!< Set by finish() */
+		void   *memory_;
+		size_t  mapped_;
+		size_t  statements_; /*!< Statements compiled so far */
+}; /* Jit */
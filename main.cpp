@@ -0,0 +1,404 @@
+#include <iostream>
+#include <string.h>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "clog.hpp"
+#include "interpreter.hpp"
+#include "token.hpp"
+#include "source.hpp"
+#include "scan.hpp"
+#include "trace.hpp"
+#include "optimizer.hpp"
+#include "jit.hpp"
+#include "cemitter.hpp"
+#include "cache.hpp"
+#include "vm.hpp"
+#include "repl.hpp"
+#include "pool.hpp"
+#include "batch.hpp"
+
+/*
+ *  \file main.cpp
+ *  \brief The interpreter program: its options and how they run the
+ *  engine of libpascal
+ */
+
+/**********************************************************************/
+
+/**********************************************************************/
+/**
+ * Options given on the command line
+ */
+struct Options
+{
+	Options() : mode(Evaluator::VM), disassemble(false), time(false), stats(false), echo(false), pretokenize(false),
+		    logAsync(false), logFile(NULL), optimize(true), jit(false), jitDump(false), emitC(NULL), cacheDir(NULL), repl(false),
+		    batch(false), jobs(0), stress(0), file(NULL) {}
+
+	Evaluator::Mode mode;  /*!< --exec=vm|tree                          */
+	bool disassemble;      /*!< --disasm : print the compiled bytecode  */
+	bool time;             /*!< --time   : report the execution time    */
+	bool stats;            /*!< --stats  : report memory statistics     */
+	bool echo;             /*!< --echo   : print the program first      */
+	bool pretokenize;      /*!< --pretokenize : lex everything before parsing */
+	bool logAsync;         /*!< --log-async : write the log from a background thread */
+	const char *logFile;   /*!< --log-file=path : write the log there, implies --log-async */
+	bool optimize;         /*!< --no-opt : skip the Optimizer           */
+	bool jit;              /*!< --jit    : run what it can as native code on the VM */
+	bool jitDump;          /*!< --jit-dump : print the native code, implies --jit */
+	const char *emitC;     /*!< --emit-c=path : translate the program to C instead of running it */
+	const char *cacheDir;  /*!< --cache, --cache-dir=path : keep the compiled program there between runs */
+	bool repl;             /*!< --repl   : read the program from stdin one input at a time */
+	bool batch;            /*!< --batch  : run every file and directory named */
+	unsigned jobs;         /*!< --jobs=N : programs of the batch run at once, 0 for one per CPU */
+	unsigned stress;       /*!< --stress=N : run the program N times at once and compare the outputs */
+	const char *file;      /*!< The program to run                      */
+	std::vector<const char *> paths; /*!< The files and directories of the batch */
+}; /* Options */
+
+/**********************************************************************/
+
+/**********************************************************************/
+/*!
+ *  \brief Runs the program from its file in the BytecodeCache, if there
+ *  is a valid one
+ *  \return false if there is not, and the program is to be analysed
+ */
+static bool startCached(SourceFile &source, const Options &options, BytecodeCache &cache)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	Bytecode *code = cache.load(source.data(), source.size(), options.optimize);
+	std::chrono::steady_clock::time_point loaded = std::chrono::steady_clock::now();
+	if (!code) {
+		return false;
+	}
+
+	Evaluator evaluator(options.mode, options.disassemble);
+	evaluator.run(code);
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	if (options.time) {
+		double ms = std::chrono::duration<double, std::milli>(end - loaded).count();
+		CLog::write(CLog::RELEASE, "Execution (vm): %.3f ms\n", ms);
+	}
+	if (options.stats) {
+		double ms = std::chrono::duration<double, std::milli>(loaded - begin).count();
+		CLog::write(CLog::RELEASE, "Cache: loaded %s in %.3f ms\n", cache.lastPath().c_str(), ms);
+		if (options.logAsync) {
+			CLog::write(CLog::RELEASE, "Log: %lu messages dropped\n", CLog::dropped());
+		}
+	}
+	delete code;
+	return true;
+} /* startCached */
+
+/**********************************************************************/
+
+/**********************************************************************/
+static void start(SourceFile &source, const Options &options)
+{
+	if (options.echo) {
+		CLog::write(CLog::RELEASE, "%.*s\n", (int)source.size(), source.data());
+	}
+
+	/* Native code and C are not cached, nor is anything for the tree walker */
+	BytecodeCache cache(options.cacheDir ? options.cacheDir : "");
+	bool cached = options.cacheDir && options.mode == Evaluator::VM && !options.jit && !options.emitC;
+	if (cached && startCached(source, options, cache)) {
+		return;
+	}
+
+	Lexer lex(source.data(), source.size());
+	TokenBuffer tokens;
+	if (options.pretokenize) {
+		tokens.fill(lex);
+	}
+	TRACE(TRACE_PARSER, "start() before parser, parse(lex)\n"); 
+	Parser parser(lex, options.pretokenize ? &tokens : NULL);
+	TRACE(TRACE_PARSER, "interpret() before interpret, interpret(parser)\n"); 
+	Interpreter interpreter(parser);
+	Program *result = interpreter.interpret();
+
+	std::chrono::steady_clock::time_point analysis = std::chrono::steady_clock::now();
+	SemanticAnalyzer seman;
+	seman.visit(result);
+
+	Optimizer optimizer;
+	if (options.optimize) {
+		optimizer.visit(result);
+	}
+	if (options.time) {
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - analysis).count();
+		CLog::write(CLog::RELEASE, "Analysis (%u threads): %.3f ms\n", TaskPool::threads(), ms);
+	}
+
+	ASTPresenter pres;
+	pres.visit(result);
+
+	if (options.emitC) {
+		CEmitter emitter;
+		if (!emitter.write(result, options.emitC)) {
+			CLog::write(CLog::RELEASE, "Can not write %s\n", options.emitC);
+		}
+		result->release();
+		return;
+	}
+
+	Jit jit(options.jitDump);
+	bool native = options.jit && options.mode == Evaluator::VM;
+	if (native && !Jit::supported()) {
+		CLog::write(CLog::RELEASE, "JIT: not supported on this CPU, running bytecode only\n");
+		native = false;
+	}
+	Evaluator evaluator(options.mode, options.disassemble, native ? &jit : NULL);
+	Bytecode *code = NULL;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	if (cached) {
+		code = evaluator.compile(result);
+		evaluator.run(code);
+	} else {
+		evaluator.visit(result);
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	bool stored = code && cache.store(source.data(), source.size(), options.optimize, code);
+	delete code;
+
+	if (options.time) {
+		double ms = std::chrono::duration<double, std::milli>(end - begin).count();
+		CLog::write(CLog::RELEASE, "Execution (%s): %.3f ms\n", native ? "jit" : options.mode == Evaluator::VM ? "vm" : "tree", ms);
+	}
+
+	if (options.stats) {
+		if (options.pretokenize) {
+			CLog::write(CLog::RELEASE, "Lexer (%s): %u tokens in %.3f ms, %.2f Mtokens/s, %.1f MB/s\n",
+					scanOps->name, tokens.size(), tokens.seconds() * 1000, tokens.tokensPerSecond() / 1e6,
+					tokens.seconds() > 0 ? source.size() / tokens.seconds() / 1e6 : 0);
+		} else {
+			CLog::write(CLog::RELEASE, "Lexer (%s): %u tokens\n", scanOps->name, parser.tokensRead());
+		}
+		CLog::write(CLog::RELEASE, "Optimizer: %zu nodes removed\n", optimizer.removed());
+		CLog::write(CLog::RELEASE, "Intern table: %zu names\n", InternTable::size());
+		if (native) {
+			CLog::write(CLog::RELEASE, "JIT: %zu functions, %zu statements, %zu bytes\n",
+					jit.functions().size(), jit.statements(), jit.bytes());
+		}
+		if (cached) {
+			CLog::write(CLog::RELEASE, "Cache: %s %s\n", stored ? "stored" : "can not write", cache.lastPath().c_str());
+		}
+		Arena *arena = result->getArena();
+		CLog::write(CLog::RELEASE, "AST arena: %u bytes used, %u bytes reserved in %u blocks, peak %u bytes\n",
+				arena->bytesUsed(), arena->bytesReserved(), arena->blocks(), Arena::peakBytes());
+		if (options.logAsync) {
+			CLog::write(CLog::RELEASE, "Log: %lu messages dropped\n", CLog::dropped());
+		}
+	}
+	result->release();
+} /* start */
+
+/**********************************************************************/
+
+/**********************************************************************/
+/*!
+ *  \brief Runs the program once, then runs times more at once on jobs
+ *  threads, every run from its own Lexer to its own VM, and checks that
+ *  each gives the output of the first
+ *  \return 0 when they all do, 1 when one does not
+ */
+static int stress(SourceFile &source, const Options &options, unsigned times, unsigned jobs)
+{
+	jobs = jobs ? jobs : 1;
+	Options quiet(options); /* Timings differ from run to run */
+	quiet.time  = false;
+	quiet.stats = false;
+	quiet.echo  = false;
+	quiet.cacheDir = NULL; /* Cached runs skip the tree and the scope log */
+
+	std::string reference;
+	std::string *previous = CLog::capture(&reference);
+	start(source, quiet);
+	CLog::capture(previous);
+
+	std::vector<std::string> outputs(times);
+	std::atomic<unsigned> next(0);
+	auto work = [&]() {
+		for (unsigned i = next++; i < times; i = next++) {
+			CLog::capture(&outputs[i]);
+			start(source, quiet);
+			CLog::capture(NULL);
+		}
+	};
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (unsigned i = 1; i < jobs && i < times; i++) {
+		workers.push_back(std::thread(work));
+	}
+	work();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	CLog::write(CLog::RELEASE, "%s", reference.c_str());
+	unsigned different = 0;
+	for (unsigned i = 0; i < times; i++) {
+		if (outputs[i] != reference) {
+			if (!different) {
+				CLog::write(CLog::RELEASE, "Stress: run %u wrote:\n%s", i + 1, outputs[i].c_str());
+			}
+			different++;
+		}
+	}
+	if (different) {
+		CLog::write(CLog::RELEASE, "Stress: %u of %u runs on %u threads differ from the first run\n", different, times, jobs);
+		return 1;
+	}
+	CLog::write(CLog::RELEASE, "Stress: %u runs on %u threads in %.3f s, all identical\n", times, jobs, seconds);
+	return 0;
+} /* stress */
+
+/**********************************************************************/
+
+/*!
+ *  \brief Fills options from the command line
+ *  \return 1 when it names a program, 0 when it does not, -1 on an error
+ */
+static int parseArgs(const int argc, char **argv, Options &options)
+{
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--exec=vm")) {
+			options.mode = Evaluator::VM;
+		} else if (!strcmp(argv[i], "--exec=tree")) {
+			options.mode = Evaluator::TREE;
+		} else if (!strcmp(argv[i], "--disasm")) {
+			options.disassemble = true;
+		} else if (!strcmp(argv[i], "--time")) {
+			options.time = true;
+		} else if (!strcmp(argv[i], "--stats")) {
+			options.stats = true;
+		} else if (!strcmp(argv[i], "--echo")) {
+			options.echo = true;
+		} else if (!strcmp(argv[i], "--pretokenize")) {
+			options.pretokenize = true;
+		} else if (!strcmp(argv[i], "--jit")) {
+			options.jit = true;
+		} else if (!strcmp(argv[i], "--jit-dump")) {
+			options.jit = true;
+			options.jitDump = true;
+		} else if (!strncmp(argv[i], "--emit-c=", 9)) {
+			options.emitC = argv[i] + 9;
+		} else if (!strcmp(argv[i], "--cache")) {
+			static std::string directory = BytecodeCache::defaultDirectory();
+			options.cacheDir = directory.c_str();
+		} else if (!strncmp(argv[i], "--cache-dir=", 12)) {
+			options.cacheDir = argv[i] + 12;
+		} else if (!strcmp(argv[i], "--repl")) {
+			options.repl = true;
+		} else if (!strcmp(argv[i], "--batch")) {
+			options.batch = true;
+		} else if (!strncmp(argv[i], "--jobs=", 7)) {
+			int jobs = atoi(argv[i] + 7);
+			if (jobs < 1) {
+				std::cout << "Bad job count " << argv[i] + 7 << std::endl;
+				return -1;
+			}
+			options.jobs = jobs;
+		} else if (!strncmp(argv[i], "--stress=", 9)) {
+			int times = atoi(argv[i] + 9);
+			if (times < 1) {
+				std::cout << "Bad run count " << argv[i] + 9 << std::endl;
+				return -1;
+			}
+			options.stress = times;
+		} else if (!strncmp(argv[i], "--threads=", 10)) {
+			int threads = atoi(argv[i] + 10);
+			if (threads < 1) {
+				std::cout << "Bad thread count " << argv[i] + 10 << std::endl;
+				return -1;
+			}
+			TaskPool::setThreads(threads);
+		} else if (!strcmp(argv[i], "--no-opt")) {
+			options.optimize = false;
+		} else if (!strcmp(argv[i], "--log-async")) {
+			options.logAsync = true;
+		} else if (!strncmp(argv[i], "--log-file=", 11)) {
+			options.logAsync = true;
+			options.logFile = argv[i] + 11;
+		} else if (!strncmp(argv[i], "--scan=", 7)) {
+			if (!setScanOps(argv[i] + 7)) {
+				std::cout << "Scanner " << argv[i] + 7 << " is not available" << std::endl;
+				return -1;
+			}
+		} else if (argv[i][0] == '-') {
+			std::cout << "Unknown option " << argv[i] << std::endl;
+			return -1;
+		} else if (options.batch) {
+			options.paths.push_back(argv[i]);
+		} else {
+			options.file = argv[i];
+			return 1;
+		}
+	}
+	return options.paths.empty() ? 0 : 1;
+} /* parseArgs */
+
+/**********************************************************************/
+
+/**********************************************************************/
+int main(int argc, char **argv)
+{
+	Options options;
+	if (parseArgs(argc, argv, options) != (options.repl ? 0 : 1)) {
+		std::cout << "Usage: " << argv[0] << " [options] pascal_file" << std::endl;
+		std::cout << "       " << argv[0] << " [options] --repl" << std::endl;
+		std::cout << "       " << argv[0] << " [options] --batch [--jobs=N] file|directory..." << std::endl;
+		std::cout << "       " << argv[0] << " [options] --stress=N [--jobs=N] pascal_file" << std::endl;
+		return 1;
+	}
+	if (options.batch) {
+		Batch batch(options.jobs ? options.jobs : std::thread::hardware_concurrency());
+		for (size_t i = 0; i < options.paths.size(); i++) {
+			if (!batch.add(options.paths[i])) {
+				std::cout << "Can not read " << options.paths[i] << std::endl;
+				return 1;
+			}
+		}
+		if (options.logAsync && !CLog::startAsync(options.logFile)) {
+			std::cout << "Can not write " << options.logFile << std::endl;
+			return 1;
+		}
+		batch.run([&options](SourceFile &source) { start(source, options); });
+		return 0;
+	}
+	if (options.repl) {
+		if (options.logAsync && !CLog::startAsync(options.logFile)) {
+			std::cout << "Can not write " << options.logFile << std::endl;
+			return 1;
+		}
+		Repl repl(options.mode, options.optimize, options.time);
+		repl.run(stdin);
+		return 0;
+	}
+
+	SourceFile source;
+	if (!source.open(options.file)) {
+		std::cout << "Can not read " << options.file << std::endl;
+		return 1;
+	}
+	if (options.logAsync && !CLog::startAsync(options.logFile)) {
+		std::cout << "Can not write " << options.logFile << std::endl;
+		return 1;
+	}
+	if (options.stress) {
+		return stress(source, options, options.stress, options.jobs ? options.jobs : std::thread::hardware_concurrency());
+	}
+	start(source, options);
+	return 0;
+} /* main */
+
+/**********************************************************************/
+
+/**********************************************************************/
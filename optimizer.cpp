@@ -0,0 +1,288 @@
+#include <cstdio>
+#include <algorithm>
+#include <vector>
+
+#include "optimizer.hpp"
+#include "interpreter.hpp"
+#include "arena.hpp"
+#include "trace.hpp"
+#include "pool.hpp"
+
+/*!
+ * \file optimizer.cpp
+ */
+
+/**********************************************************************/
+/*!
+ * fn void Optimizer::visit(Program *program)
+ * \brief Simplifies the tree of program in place
+ */
+void Optimizer::visit(Program *program)
+{
+	arena_ = program->getArena();
+	program->visitOptimizer(*this);
+	arena_ = NULL;
+	TRACE(TRACE_SEMA, "Optimizer: %zu nodes removed\n", removed_);
+} /* Optimizer::visit */
+
+/**********************************************************************/
+/*!
+ * fn Number *Optimizer::makeNumber(Value value, SymbolType type)
+ * \brief A literal for a folded value. Its token text is the value
+ * printed back, kept in the arena next to the node.
+ */
+Number *Optimizer::makeNumber(Value value, SymbolType type)
+{
+	char text[32];
+	int length;
+	if (type == INTEGER) {
+		length = snprintf(text, sizeof(text), "%lld", (long long)value.i);
+	} else {
+		length = snprintf(text, sizeof(text), "%.17g", value.r);
+	}
+	Token tok(type == INTEGER ? T_INTEGER : T_REAL, arena_->copyString(text, length), length);
+	return new (*arena_) Number(tok, value);
+} /* Optimizer::makeNumber */
+
+/**********************************************************************/
+/*!
+ * fn void Optimizer::optimizeProcedures(Node **procedures, size_t count)
+ * \brief Simplifies count sibling ProcedureDecls on the TaskPool, each
+ * with an Optimizer of its own. An arena is not shared between threads,
+ * so each task makes its Numbers in one of its own, which the arena in
+ * use then adopts.
+ */
+void Optimizer::optimizeProcedures(Node **procedures, size_t count)
+{
+	std::vector<Optimizer> children(count);
+	TaskPool::instance().run(count, [&](size_t i) {
+		children[i].arena_ = new Arena();
+		procedures[i]->visitOptimizer(children[i]);
+	});
+	for (size_t i = 0; i < count; i++) {
+		arena_->adopt(children[i].arena_);
+		delete children[i].arena_;
+		removed_ += children[i].removed_;
+	}
+} /* Optimizer::optimizeProcedures */
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                   Node::visitOptimizer methods                     */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+Node *Program::visitOptimizer(Optimizer &optimizer)
+{
+	block_->visitOptimizer(optimizer);
+	return this;
+} /* Program::visitOptimizer */
+
+/**********************************************************************/
+Node *Block::visitOptimizer(Optimizer &optimizer)
+{
+	Block::iterator it = this->begin();
+	while (it != this->end()) {
+		size_t run = procedures(it);
+		if (run >= SemanticAnalyzer::MIN_PARALLEL && TaskPool::threads() > 1) {
+			optimizer.optimizeProcedures(it, run);
+		} else {
+			run = std::max<size_t>(run, 1);
+			for (size_t i = 0; i < run; i++) {
+				it[i]->visitOptimizer(optimizer);
+			}
+		}
+		it += run;
+	}
+	compoundStatement_->visitOptimizer(optimizer);
+	return this;
+} /* Block::visitOptimizer */
+
+/**********************************************************************/
+Node *VarDecl::visitOptimizer(Optimizer &optimizer)
+{
+	return this;
+} /* VarDecl::visitOptimizer */
+
+/**********************************************************************/
+Node *Type::visitOptimizer(Optimizer &optimizer)
+{
+	return this;
+} /* Type::visitOptimizer */
+
+/**********************************************************************/
+Node *Compound::visitOptimizer(Optimizer &optimizer)
+{
+	Compound::iterator it;
+	for (it = this->begin(); it != this->end(); it++) {
+		*it = (*it)->visitOptimizer(optimizer);
+	}
+	return this;
+} /* Compound::visitOptimizer */
+
+/**********************************************************************/
+Node *NoOp::visitOptimizer(Optimizer &optimizer)
+{
+	return this;
+} /* NoOp::visitOptimizer */
+
+/**********************************************************************/
+Node *Assign::visitOptimizer(Optimizer &optimizer)
+{
+	rhs_ = rhs_->visitOptimizer(optimizer);
+	return this;
+} /* Assign::visitOptimizer */
+
+/**********************************************************************/
+Node *Var::visitOptimizer(Optimizer &optimizer)
+{
+	return this;
+} /* Var::visitOptimizer */
+
+/**********************************************************************/
+/*!
+ * fn Node *BinOp::visitOptimizer(Optimizer &optimizer)
+ * \brief Folds two literals into one, or drops a neutral operand.
+ * An INTEGER DIV by a literal zero is left for the run to report, and
+ * comparisons are left as they are: a Number can not hold a BOOLEAN.
+ */
+Node *BinOp::visitOptimizer(Optimizer &optimizer)
+{
+	lhs_ = lhs_->visitOptimizer(optimizer);
+	rhs_ = rhs_->visitOptimizer(optimizer);
+
+	Number *lhs = dynamic_cast<Number *>(lhs_);
+	Number *rhs = dynamic_cast<Number *>(rhs_);
+	TokenType op = getToken().type();
+
+	if (isComparison(kernel_)) {
+		return this;
+	}
+	if (lhs && rhs) {
+		if (kernel_ == K_INT_DIV_II && rhs->value().i == 0) {
+			return this;
+		}
+		optimizer.remove(2);
+		return optimizer.makeNumber(applyKernel(kernel_, lhs->value(), rhs->value()), valueType());
+	}
+
+	Node *result = this;
+	switch (op)
+	{
+		case T_PLUS:
+			/* -0.0 + 0 is 0.0, so x + 0 is x only for an INTEGER x */
+			if (valueType() != INTEGER) {
+				break;
+			}
+			if (rhs && rhs->isInteger(0)) {
+				result = lhs_;
+			} else if (lhs && lhs->isInteger(0)) {
+				result = rhs_;
+			}
+			break;
+		case T_MINUS:
+			if (rhs && rhs->isInteger(0)) {
+				result = lhs_;
+			}
+			break;
+		case T_MUL:
+			if (rhs && rhs->isInteger(1)) {
+				result = lhs_;
+			} else if (lhs && lhs->isInteger(1)) {
+				result = rhs_;
+			}
+			break;
+		default:
+			break;
+	}
+	if (result != this) {
+		optimizer.remove(2);
+	}
+	return result;
+} /* BinOp::visitOptimizer */
+
+/**********************************************************************/
+/*!
+ * fn Node *UnaryOp::visitOptimizer(Optimizer &optimizer)
+ * \brief +x is x, -(-x) is x, and -literal is a literal
+ */
+Node *UnaryOp::visitOptimizer(Optimizer &optimizer)
+{
+	expr_ = expr_->visitOptimizer(optimizer);
+
+	if (kernel_ == K_NONE) {
+		optimizer.remove(1);
+		return expr_;
+	}
+
+	Number *number = dynamic_cast<Number *>(expr_);
+	if (number) {
+		optimizer.remove(1);
+		return optimizer.makeNumber(applyKernel(kernel_, number->value(), number->value()), valueType());
+	}
+
+	UnaryOp *inner = dynamic_cast<UnaryOp *>(expr_);
+	if (inner && inner->getKernel() != K_NONE) {
+		optimizer.remove(2);
+		return inner->getExpr();
+	}
+	return this;
+} /* UnaryOp::visitOptimizer */
+
+/**********************************************************************/
+Node *Number::visitOptimizer(Optimizer &optimizer)
+{
+	return this;
+} /* Number::visitOptimizer */
+
+/**********************************************************************/
+Node *Param::visitOptimizer(Optimizer &optimizer)
+{
+	return this;
+} /* Param::visitOptimizer */
+
+/**********************************************************************/
+Node *ProcedureCall::visitOptimizer(Optimizer &optimizer)
+{
+	ProcedureCall::iterator it;
+	for (it = this->begin(); it != this->end(); it++) {
+		*it = (*it)->visitOptimizer(optimizer);
+	}
+	return this;
+} /* ProcedureCall::visitOptimizer */
+
+/**********************************************************************/
+Node *If::visitOptimizer(Optimizer &optimizer)
+{
+	condition_ = condition_->visitOptimizer(optimizer);
+	then_ = then_->visitOptimizer(optimizer);
+	if (else_) {
+		else_ = else_->visitOptimizer(optimizer);
+	}
+	return this;
+} /* If::visitOptimizer */
+
+/**********************************************************************/
+Node *While::visitOptimizer(Optimizer &optimizer)
+{
+	condition_ = condition_->visitOptimizer(optimizer);
+	body_ = body_->visitOptimizer(optimizer);
+	return this;
+} /* While::visitOptimizer */
+
+/**********************************************************************/
+Node *For::visitOptimizer(Optimizer &optimizer)
+{
+	start_ = start_->visitOptimizer(optimizer);
+	bound_ = bound_->visitOptimizer(optimizer);
+	body_ = body_->visitOptimizer(optimizer);
+	return this;
+} /* For::visitOptimizer */
+
+/**********************************************************************/
+Node *ProcedureDecl::visitOptimizer(Optimizer &optimizer)
+{
+	block_->visitOptimizer(optimizer);
+	return this;
+} /* ProcedureDecl::visitOptimizer */
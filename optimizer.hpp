@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include "token.hpp"
+#include "value.hpp"
+
+/*!
+ * \file optimizer.hpp
+ * \brief Constant folding and algebraic simplification of the AST.
+ */
+
+class Node;
+class Number;
+class Program;
+class Arena;
+
+/**********************************************************************/
+/**
+ * An Optimizer class.
+ * Runs after the SemanticAnalyzer and before the Evaluator. Every
+ * Node::visitOptimizer returns the node that replaces it: itself, one of
+ * its children, or a new Number made in the arena of the Program.
+ * Constant BinOp/UnaryOp subtrees become a single Number, and the
+ * identities x * 1, 1 * x, x + 0, 0 + x, x - 0, +x and -(-x) are reduced
+ * to x. The neutral literal must be an INTEGER: x * 1.0 turns an INTEGER
+ * x into a REAL, so it is kept. x / 1 is kept for the same reason.
+ * x + 0 and 0 + x are only reduced for an INTEGER x, since -0.0 + 0 is
+ * 0.0.
+ * Sibling procedures are simplified in parallel like they are analysed,
+ * each by an Optimizer of its own, into an arena of its own that the
+ * Program adopts afterwards. No state is shared between Optimizers.
+ */
+class Optimizer
+{
+	public:
+		Optimizer() : arena_(NULL), removed_(0) {}
+
+		void visit(Program *program);
+		size_t removed() { return removed_; }
+		void   remove(size_t nodes) { removed_ += nodes; }
+
+		Number *makeNumber(Value value, SymbolType type);
+		void    optimizeProcedures(Node **procedures, size_t count);
+	private:
+		Arena *arena_;       /*!< Where the Numbers made are */
+		size_t removed_;     /*!< Nodes taken out of the tree so far */
+}; /* Optimizer */
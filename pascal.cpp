@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <string>
+#include <strings.h>
+
+#include "pascal.hpp"
+#include "clog.hpp"
+#include "error.hpp"
+#include "token.hpp"
+#include "optimizer.hpp"
+#include "jit.hpp"
+
+/*!
+ * \file pascal.cpp
+ */
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                     CompiledProgram methods                        */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*!
+ * fn CompiledProgram *CompiledProgram::compile(const char *text, size_t size, bool optimize, bool jit, std::string *error)
+ * \brief Compiles the program text to Bytecode, with the statements the
+ * Jit can translate as native code if jit is set and the CPU allows it.
+ * text is not needed once it returns. Nothing is written to the log:
+ * if the program has an error, what the analysis logged goes to error,
+ * when it is not NULL.
+ * \return The CompiledProgram, which the caller owns, or NULL on an error
+ */
+CompiledProgram *CompiledProgram::compile(const char *text, size_t size, bool optimize, bool jit, std::string *error)
+{
+	std::string log;
+	std::string *previous = CLog::capture(&log);
+
+	Program *program = NULL;
+	try {
+		ErrorTrap trap;
+		Lexer lex(text, size);
+		Parser parser(lex);
+		Interpreter interpreter(parser);
+		program = interpreter.interpret();
+
+		SemanticAnalyzer seman;
+		seman.visit(program);
+		if (optimize) {
+			Optimizer optimizer;
+			optimizer.visit(program);
+		}
+	} catch (const ProgramError &) {
+		if (program) {
+			program->release();
+		}
+		CLog::capture(previous);
+		if (error) {
+			error->swap(log);
+		}
+		return NULL;
+	}
+
+	Jit *native = jit && Jit::supported() ? new Jit() : NULL;
+	Evaluator evaluator(Evaluator::VM, false, native);
+	Bytecode *code = evaluator.compile(program);
+	program->release();
+
+	CLog::capture(previous);
+	return new CompiledProgram(code, native);
+} /* CompiledProgram::compile */
+
+/**********************************************************************/
+CompiledProgram::~CompiledProgram()
+{
+	delete code_;
+	delete jit_;
+} /* CompiledProgram::~CompiledProgram */
+
+/**********************************************************************/
+/*!
+ * fn int CompiledProgram::find(const char *name) const
+ * \brief The index of the global variable name, in any case
+ * \return -1 if the program has no such variable
+ */
+int CompiledProgram::find(const char *name) const
+{
+	const std::vector<GlobalVariable> &variables = globals();
+	for (size_t i = 0; i < variables.size(); i++) {
+		if (!strcasecmp(variables[i].name.c_str(), name)) {
+			return i;
+		}
+	}
+	return -1;
+} /* CompiledProgram::find */
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                        Execution methods                           */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+Execution::Execution(const CompiledProgram &program)
+	: program_(program), frame_(program.bytecode()->frameSize(), Value())
+{
+} /* Execution::Execution */
+
+/**********************************************************************/
+/*!
+ * fn bool Execution::setInteger(const char *name, int64_t value)
+ * \brief Sets an INTEGER global, or a REAL one to the value as a REAL,
+ * as an assignment in the program does
+ * \return false if the program has no such variable
+ */
+bool Execution::setInteger(const char *name, int64_t value)
+{
+	int variable = program_.find(name);
+	if (variable < 0) {
+		return false;
+	}
+	bool real = program_.globals()[variable].type == REAL;
+	set(variable, real ? Value::real(value) : Value::integer(value));
+	return true;
+} /* Execution::setInteger */
+
+/**********************************************************************/
+/*!
+ * fn bool Execution::setReal(const char *name, double value)
+ * \brief Sets a REAL global
+ * \return false if the program has no such variable, or it is an INTEGER
+ */
+bool Execution::setReal(const char *name, double value)
+{
+	int variable = program_.find(name);
+	if (variable < 0 || program_.globals()[variable].type != REAL) {
+		return false;
+	}
+	set(variable, Value::real(value));
+	return true;
+} /* Execution::setReal */
+
+/**********************************************************************/
+/*!
+ * fn int64_t Execution::integer(const char *name) const
+ * \brief The value of an INTEGER global; a REAL one is truncated
+ * \return 0 if the program has no such variable
+ */
+int64_t Execution::integer(const char *name) const
+{
+	int variable = program_.find(name);
+	if (variable < 0) {
+		return 0;
+	}
+	Value value = get(variable);
+	return program_.globals()[variable].type == REAL ? (int64_t)value.r : value.i;
+} /* Execution::integer */
+
+/**********************************************************************/
+/*!
+ * fn double Execution::real(const char *name) const
+ * \brief The value of a global as a REAL
+ * \return 0 if the program has no such variable
+ */
+double Execution::real(const char *name) const
+{
+	int variable = program_.find(name);
+	if (variable < 0) {
+		return 0;
+	}
+	Value value = get(variable);
+	return program_.globals()[variable].type == REAL ? value.r : (double)value.i;
+} /* Execution::real */
+
+/**********************************************************************/
+/*!
+ * fn void Execution::reset()
+ * \brief Sets every global back to 0
+ */
+void Execution::reset()
+{
+	frame_.assign(frame_.size(), Value());
+} /* Execution::reset */
+
+/**********************************************************************/
+/*!
+ * fn bool Execution::run(std::string *error)
+ * \brief Runs the program once from the values of its globals, and
+ * keeps the values it leaves in them. A runtime error unwinds the call
+ * stack and leaves the globals as they were; its message goes to error,
+ * when it is not NULL, instead of the log.
+ * \return false on a runtime error
+ */
+bool Execution::run(std::string *error)
+{
+	const Bytecode *code = program_.bytecode();
+	std::string log;
+	std::string *previous = CLog::capture(&log);
+	try {
+		ErrorTrap trap;
+		callStack_.push(1, frame_.size());
+		std::copy(frame_.begin(), frame_.end(), callStack_.frame(1));
+		vm_.run(code, callStack_);
+	} catch (const ProgramError &) {
+		while (callStack_.depth() > 0) {
+			callStack_.pop();
+		}
+		CLog::capture(previous);
+		if (error) {
+			error->swap(log);
+		}
+		return false;
+	}
+	CLog::capture(previous);
+
+	Value *slots = callStack_.frame(1); /* Moved if the stack grew */
+	std::copy(slots, slots + frame_.size(), frame_.begin());
+	callStack_.pop();
+	return true;
+} /* Execution::run */
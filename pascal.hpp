@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "interpreter.hpp"
+#include "vm.hpp"
+
+/*!
+ * \file pascal.hpp
+ * \brief The interface of libpascal for programs that embed the engine.
+ */
+
+/**********************************************************************/
+/**
+ * A CompiledProgram class.
+ * A program lexed, parsed, analysed, optimized and compiled once, to be
+ * run any number of times by Executions. It holds the Bytecode, the
+ * native code of the Jit if it was asked for, and the global variables;
+ * the tree is released once it is compiled. Nothing of it changes after
+ * compile(), so Executions on different threads may run one
+ * CompiledProgram at once without a lock.
+ * An error in the program does not stop the caller: compile() returns
+ * NULL, with what the analysis logged in error if it is given.
+ */
+class CompiledProgram
+{
+	public:
+		static CompiledProgram *compile(const char *text, size_t size, bool optimize = true, bool jit = false,
+		                                std::string *error = NULL);
+		~CompiledProgram();
+
+		int find(const char *name) const;
+		const std::vector<GlobalVariable> &globals() const { return code_->globals(); }
+		const Bytecode *bytecode() const { return code_; }
+	private:
+		CompiledProgram(Bytecode *code, Jit *jit) : code_(code), jit_(jit) {}
+		CompiledProgram(const CompiledProgram &);
+		CompiledProgram &operator=(const CompiledProgram &);
+
+		Bytecode *code_;
+		Jit *jit_; /*!< Owns the native code of code_, or NULL */
+}; /* CompiledProgram */
+
+/**********************************************************************/
+/**
+ * An Execution class.
+ * Runs a CompiledProgram on variables of its own. The globals start at
+ * 0; set() gives them the values to start a run with, and after run()
+ * get() reads what the program left in them. A run starts from the
+ * values the globals have, so a second run sees what the first left
+ * unless they are set again or reset().
+ * An Execution has its own CallStack and VM, which it keeps from run to
+ * run: a run allocates nothing once the stacks are as deep as it needs.
+ * An Execution is used by one thread at a time; run one Execution per
+ * thread to run a program on several threads.
+ * Variables are named by their index in CompiledProgram::globals(),
+ * which CompiledProgram::find() gives.
+ * A runtime error, a DIV by zero or too deep a recursion, ends the run
+ * and run() returns false with the message in error; the globals keep
+ * the values they had before the run.
+ */
+class Execution
+{
+	public:
+		Execution(const CompiledProgram &program);
+
+		void  set(int variable, Value value) { frame_[program_.globals()[variable].slot] = value; }
+		Value get(int variable) const { return frame_[program_.globals()[variable].slot]; }
+		bool  setInteger(const char *name, int64_t value);
+		bool  setReal(const char *name, double value);
+		int64_t integer(const char *name) const;
+		double  real(const char *name) const;
+
+		void reset();
+		bool run(std::string *error = NULL);
+	private:
+		const CompiledProgram &program_;
+		std::vector<Value> frame_;  /*!< The globals between runs */
+		CallStack callStack_;
+		::VM vm_;
+}; /* Execution */
@@ -0,0 +1,201 @@
+#include <algorithm>
+
+#include "pool.hpp"
+
+/*!
+ * \file pool.cpp
+ */
+
+unsigned TaskPool::threads_ = 0;
+
+/*!
+ *  \brief The Queue of this thread, if it is a worker
+ */
+static thread_local int workerIndex = -1;
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                     TaskPool methods                               */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*!
+ * fn TaskPool &TaskPool::instance()
+ * \brief The pool, made on first use
+ */
+TaskPool &TaskPool::instance()
+{
+	static TaskPool pool(threads());
+	return pool;
+} /* TaskPool::instance */
+
+/**********************************************************************/
+/*!
+ * fn unsigned TaskPool::threads()
+ * \brief The threads the pool has or will have, the caller of run()
+ * included
+ */
+unsigned TaskPool::threads()
+{
+	if (threads_) {
+		return threads_;
+	}
+	return std::max(1u, std::thread::hardware_concurrency());
+} /* TaskPool::threads */
+
+/**********************************************************************/
+TaskPool::TaskPool(unsigned threads) : queued_(0), stop_(false)
+{
+	for (unsigned i = 0; i < threads; i++) {
+		queues_.push_back(new Queue());
+	}
+	for (unsigned i = 0; i + 1 < threads; i++) {
+		workers_.push_back(std::thread(&TaskPool::work, this, (size_t)i));
+	}
+} /* TaskPool::TaskPool */
+
+/**********************************************************************/
+TaskPool::~TaskPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(sleepLock_);
+		stop_ = true;
+	}
+	wake_.notify_all();
+	for (size_t i = 0; i < workers_.size(); i++) {
+		workers_[i].join();
+	}
+	for (size_t i = 0; i < queues_.size(); i++) {
+		delete queues_[i];
+	}
+} /* TaskPool::~TaskPool */
+
+/**********************************************************************/
+size_t TaskPool::self()
+{
+	return workerIndex >= 0 ? (size_t)workerIndex : queues_.size() - 1;
+} /* TaskPool::self */
+
+/**********************************************************************/
+/*!
+ * fn void TaskPool::run(size_t count, const std::function<void(size_t)> &task)
+ * \brief Calls task(0) to task(count - 1), in any order and on any
+ * threads, and returns when all calls have returned
+ */
+void TaskPool::run(size_t count, const std::function<void(size_t)> &task)
+{
+	if (workers_.empty() || count < 2) {
+		for (size_t i = 0; i < count; i++) {
+			task(i);
+		}
+		return;
+	}
+
+	Group group;
+	group.task = &task;
+	group.pending = count;
+
+	size_t me = self();
+	{
+		std::lock_guard<std::mutex> guard(queues_[me]->lock);
+		for (size_t i = 0; i < count; i++) {
+			Task t = { &group, i };
+			queues_[me]->tasks.push_back(t);
+		}
+	}
+	{
+		std::lock_guard<std::mutex> guard(sleepLock_);
+		queued_ += count;
+	}
+	wake_.notify_all();
+
+	const Group *only = workerIndex >= 0 ? NULL : &group;
+	while (group.pending.load(std::memory_order_acquire) != 0) {
+		Task t;
+		if (!take(me, only, t)) {
+			break;
+		}
+		execute(t);
+	}
+
+	/* Also waits for the last task to let go of the lock */
+	std::unique_lock<std::mutex> guard(group.lock);
+	group.done.wait(guard, [&group] { return group.pending.load() == 0; });
+} /* TaskPool::run */
+
+/**********************************************************************/
+/*!
+ * fn bool TaskPool::take(size_t self, const Group *only, Task &task)
+ * \brief The newest task of the queue self, else the oldest of another.
+ * Given only, the newest task of that group in the queue self.
+ * \return false if there is none
+ */
+bool TaskPool::take(size_t self, const Group *only, Task &task)
+{
+	if (only) {
+		Queue *queue = queues_[self];
+		std::lock_guard<std::mutex> guard(queue->lock);
+		for (size_t i = queue->tasks.size(); i-- > 0; ) {
+			if (queue->tasks[i].group == only) {
+				task = queue->tasks[i];
+				queue->tasks.erase(queue->tasks.begin() + i);
+				queued_--;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	for (size_t n = 0; n < queues_.size(); n++) {
+		size_t i = (self + n) % queues_.size();
+		Queue *queue = queues_[i];
+		std::lock_guard<std::mutex> guard(queue->lock);
+		if (queue->tasks.empty()) {
+			continue;
+		}
+		if (i == self) {
+			task = queue->tasks.back();
+			queue->tasks.pop_back();
+		} else {
+			task = queue->tasks.front();
+			queue->tasks.pop_front();
+		}
+		queued_--;
+		return true;
+	}
+	return false;
+} /* TaskPool::take */
+
+/**********************************************************************/
+void TaskPool::execute(const Task &task)
+{
+	Group *group = task.group;
+	(*group->task)(task.index);
+	std::lock_guard<std::mutex> guard(group->lock);
+	if (group->pending.fetch_sub(1, std::memory_order_release) == 1) {
+		group->done.notify_all();
+	}
+} /* TaskPool::execute */
+
+/**********************************************************************/
+/*!
+ * fn void TaskPool::work(size_t self)
+ * \brief The loop of a worker: runs tasks, and sleeps while there are none
+ */
+void TaskPool::work(size_t self)
+{
+	workerIndex = self;
+	for (;;) {
+		Task task;
+		if (take(self, NULL, task)) {
+			execute(task);
+			continue;
+		}
+		std::unique_lock<std::mutex> guard(sleepLock_);
+		wake_.wait(guard, [this] { return stop_ || queued_ > 0; });
+		if (stop_) {
+			return;
+		}
+	}
+} /* TaskPool::work */
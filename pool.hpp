@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * \file pool.hpp
+ * \brief A work stealing pool of threads for the front end.
+ */
+
+/**********************************************************************/
+/**
+ * A TaskPool class.
+ * Runs groups of independent tasks. Each worker has a deque of tasks,
+ * and the threads that are not workers share one: a thread takes from
+ * the back of its own and steals from the front of the others when it
+ * has none.
+ * A thread waiting in run() for its group runs tasks meanwhile, so a
+ * task may call run() itself without tying up a worker: a worker runs
+ * tasks of any group, another thread only those of its own, as the
+ * groups in the shared deque may be of unrelated callers. Once there is
+ * none it can take, it sleeps until its group is done. The pool is made on first use with the number of
+ * threads setThreads() gave, the calling thread included, or one per
+ * CPU; with one thread run() simply calls the tasks in order.
+ */
+class TaskPool
+{
+	public:
+		static TaskPool &instance();
+		static void     setThreads(unsigned threads) { threads_ = threads; }
+		static unsigned threads();
+
+		void run(size_t count, const std::function<void(size_t)> &task);
+	private:
+		/**
+		 * A Group struct.
+		 * The tasks of one run(), and how many of them are not done.
+		 * The last task to finish signals done under lock.
+		 */
+		struct Group
+		{
+			const std::function<void(size_t)> *task;
+			std::atomic<size_t> pending;
+			std::mutex lock;
+			std::condition_variable done;
+		};
+
+		/**
+		 * A Task struct.
+		 * One call of the function of a Group
+		 */
+		struct Task
+		{
+			Group *group;
+			size_t index;
+		};
+
+		/**
+		 * A Queue struct.
+		 * The deque of one thread
+		 */
+		struct Queue
+		{
+			std::mutex lock;
+			std::deque<Task> tasks;
+		};
+
+		TaskPool(unsigned threads);
+		~TaskPool();
+
+		size_t self();
+		bool   take(size_t self, const Group *only, Task &task);
+		void   execute(const Task &task);
+		void   work(size_t self);
+
+		std::vector<Queue *> queues_;      /*!< One per worker, then the one of other threads */
+		std::vector<std::thread> workers_;
+		std::mutex sleepLock_;
+		std::condition_variable wake_;
+		std::atomic<size_t> queued_;       /*!< Tasks in all queues */
+		std::atomic<bool> stop_;
+
+		static unsigned threads_;
+}; /* TaskPool */
@@ -0,0 +1,208 @@
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+
+#include "repl.hpp"
+#include "clog.hpp"
+#include "optimizer.hpp"
+#include "trace.hpp"
+#include "error.hpp"
+
+/*!
+ * \file repl.cpp
+ */
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                        Repl methods                                */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+Repl::Repl(Evaluator::Mode mode, bool optimize, bool time)
+	: mode_(mode), optimize_(optimize), time_(time), code_(NULL), evaluator_(mode)
+{
+	globals_ = new ScopedSymbolTable("global", 1, NULL);
+	evaluator_.callStack().push(globals_->getLevel(), 0);
+	if (mode_ == Evaluator::VM) {
+		code_ = new Bytecode();
+	}
+} /* Repl::Repl */
+
+/**********************************************************************/
+Repl::~Repl()
+{
+	evaluator_.callStack().pop();
+	delete code_;
+	for (size_t i = 0; i < inputs_.size(); i++) {
+		inputs_[i]->release();
+	}
+	delete globals_;
+} /* Repl::~Repl */
+
+/**********************************************************************/
+/*!
+ * fn bool Repl::complete(const char *text, size_t size)
+ * \brief Whether text is a whole input: it ends with a T_SEMI outside of
+ * any BEGIN and END, every PROCEDURE in it has its body, and no { is
+ * left open. A FOR, IF or WHILE can so go on over the next lines, and so
+ * can a procedure or a comment. Text the Lexer fails on is complete, so
+ * that execute() reports it.
+ */
+bool Repl::complete(const char *text, size_t size)
+{
+	bool comment = false;
+	for (size_t i = 0; i < size; i++) {
+		if (text[i] == '{') {
+			comment = true;
+		} else if (text[i] == '}') {
+			comment = false;
+		}
+	}
+	if (comment) {
+		return false;
+	}
+
+	int depth = 0;     /* BEGINs without their END */
+	int procedures = 0; /* PROCEDUREs without their body */
+	TokenType last = T_EOF;
+	ErrorTrap trap;
+	std::string message;
+	std::string *savedLog = CLog::capture(&message);
+	try {
+		Lexer lexer(text, size);
+		for (Token tok = lexer.getNextToken(); tok.type() != T_EOF; tok = lexer.getNextToken()) {
+			if (tok.type() == T_PASC_PROCEDURE) {
+				procedures++;
+			} else if (tok.type() == T_PASC_BEGIN_RESERV) {
+				depth++;
+			} else if (tok.type() == T_PASC_END_RESERV) {
+				depth--;
+				if (depth == 0 && procedures > 0) {
+					procedures--;
+				}
+			}
+			last = tok.type();
+		}
+	} catch (const ProgramError &) {
+		CLog::capture(savedLog);
+		return true;
+	}
+	CLog::capture(savedLog);
+	return last == T_SEMI && depth <= 0 && procedures == 0;
+} /* Repl::complete */
+
+/**********************************************************************/
+/*!
+ * fn void Repl::execute(const char *text, size_t size)
+ * \brief Runs one complete input. The text is copied and kept. An input
+ * that does not parse or analyse is reported and dropped, with the
+ * globals it defined, and the session goes on.
+ */
+void Repl::execute(const char *text, size_t size)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	texts_.push_back(std::string(text, size));
+	const std::string &kept = texts_.back();
+
+	size_t symbols = globals_->symbolCount();
+	Program *input = NULL;
+	try {
+		ErrorTrap trap;
+		Lexer lex(kept.data(), kept.size());
+		Parser parser(lex);
+		input = parser.parseInput();
+		input->setScope(globals_);
+		SemanticAnalyzer seman;
+		seman.visit(input);
+	} catch (const ProgramError &) {
+		if (input) {
+			input->release();
+		}
+		globals_->truncate(symbols);
+		texts_.pop_back();
+		return;
+	}
+	inputs_.push_back(input);
+	evaluator_.callStack().extend(globals_->frameSize());
+
+	if (optimize_) {
+		Optimizer optimizer;
+		optimizer.visit(input);
+	}
+
+	if (mode_ == Evaluator::VM) {
+		int start = compiler_.append(code_, input);
+		TRACE(TRACE_EVAL, "Repl: input %zu at %d\n", inputs_.size(), start);
+		vm_.run(code_, evaluator_.callStack(), start);
+	} else {
+		input->visitEvaluate(evaluator_);
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	printNamed(kept);
+	if (time_) {
+		CLog::write(CLog::RELEASE, "Input: %.3f ms\n", std::chrono::duration<double, std::milli>(end - begin).count());
+	}
+} /* Repl::execute */
+
+/**********************************************************************/
+/*!
+ * fn void Repl::printNamed(const std::string &text)
+ * \brief Prints the global variables that text names, once each. Only
+ * the input is looked at, not every global there is.
+ */
+void Repl::printNamed(const std::string &text)
+{
+	Value *slots = evaluator_.callStack().frame(globals_->getLevel());
+	std::vector<VarSymbol *> named;
+	Lexer lexer(text.data(), text.size());
+	for (Token tok = lexer.getNextToken(); tok.type() != T_EOF; tok = lexer.getNextToken()) {
+		if (tok.type() != T_PASC_ID) {
+			continue;
+		}
+		VarSymbol *variable = dynamic_cast<VarSymbol *>(globals_->lookup(tok.id(), true));
+		if (variable && std::find(named.begin(), named.end(), variable) == named.end()) {
+			named.push_back(variable);
+			Evaluator::printVariable(variable->spelling(), variable->valueType(), slots[variable->slot()]);
+		}
+	}
+} /* Repl::printNamed */
+
+/**********************************************************************/
+/*!
+ * fn void Repl::run(FILE *in)
+ * \brief Reads in line by line, with a prompt if it is a terminal, and
+ * executes each input once it is complete. At the end of in, runs what
+ * is left and prints the memory.
+ */
+void Repl::run(FILE *in)
+{
+	bool prompt = isatty(fileno(in));
+	std::string pending;
+	char line[4096];
+
+	for (;;) {
+		if (prompt) {
+			fputs(pending.empty() ? "pascal> " : "   ...> ", stdout);
+			fflush(stdout);
+		}
+		if (!fgets(line, sizeof(line), in)) {
+			break;
+		}
+		pending += line;
+		if (complete(pending.data(), pending.size())) {
+			execute(pending.data(), pending.size());
+			pending.clear();
+		}
+	}
+	if (prompt) {
+		fputs("\n", stdout);
+	}
+	if (pending.find_first_not_of(" \t\r\n") != std::string::npos) {
+		execute(pending.data(), pending.size()); /* What is left has to parse as it is */
+	}
+
+	evaluator_.printMemory(globals_);
+} /* Repl::run */
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+#include "interpreter.hpp"
+#include "vm.hpp"
+
+/*!
+ * \file repl.hpp
+ * \brief Running a program one input at a time.
+ */
+
+/**********************************************************************/
+/**
+ * A Repl class.
+ * Reads declarations and statements without a PROGRAM around them and
+ * runs each input as soon as it is complete. The global scope and the
+ * activation record of the program live as long as the Repl: an input
+ * is lexed, parsed, analysed, optimized and compiled on its own, adds
+ * its variables and procedures to the global scope, and can use those
+ * of every input before it. In VM mode the inputs are appended to one
+ * Bytecode by one Compiler, and the VM starts at the new code.
+ * So the work done for an input does not depend on how many came before.
+ * An input that does not parse or analyse is reported and dropped, with
+ * the globals it defined; an error while it runs still aborts.
+ * After an input the globals it names are printed, and the whole memory
+ * at the end, as after a program.
+ */
+class Repl
+{
+	public:
+		Repl(Evaluator::Mode mode = Evaluator::VM, bool optimize = true, bool time = false);
+		~Repl();
+
+		void run(FILE *in);
+		void execute(const char *text, size_t size);
+		static bool complete(const char *text, size_t size);
+	private:
+		void printNamed(const std::string &text);
+
+		Evaluator::Mode mode_;
+		bool optimize_;
+		bool time_;
+		ScopedSymbolTable *globals_;
+		Compiler compiler_;
+		Bytecode *code_;             /*!< Of all inputs so far, in VM mode */
+		::VM vm_;
+		Evaluator evaluator_;        /*!< Holds the activation record of the globals */
+		std::deque<std::string> texts_; /*!< Of all inputs: the tokens of their trees point into them */
+		std::vector<Program *> inputs_; /*!< Kept for the procedures they declare */
+}; /* Repl */
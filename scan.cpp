@@ -0,0 +1,254 @@
+#include <cstring>
+
+#include "scan.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+/*!
+ * \file scan.cpp
+ */
+
+/**********************************************************************/
+/**********************************************************************/
+/*                        Scalar versions                             */
+/**********************************************************************/
+/**********************************************************************/
+static inline bool isSpaceChar(unsigned char c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline bool isAlnumChar(unsigned char c)
+{
+	return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+}
+
+static inline bool isDigitChar(unsigned char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/**********************************************************************/
+static const char *scalarSpace(const char *p, const char *end)
+{
+	while (p < end && isSpaceChar(*p)) {
+		p++;
+	}
+	return p;
+} /* scalarSpace */
+
+/**********************************************************************/
+static const char *scalarAlnum(const char *p, const char *end)
+{
+	while (p < end && isAlnumChar(*p)) {
+		p++;
+	}
+	return p;
+} /* scalarAlnum */
+
+/**********************************************************************/
+static const char *scalarDigits(const char *p, const char *end)
+{
+	while (p < end && isDigitChar(*p)) {
+		p++;
+	}
+	return p;
+} /* scalarDigits */
+
+/**********************************************************************/
+static const char *scalarFind(const char *p, const char *end, char c)
+{
+	const void *found = memchr(p, c, end - p);
+	return found ? static_cast<const char *>(found) : end;
+} /* scalarFind */
+
+#ifdef SCAN_X86
+/**********************************************************************/
+/**********************************************************************/
+/*                         SSE2 versions                              */
+/**********************************************************************/
+/**********************************************************************/
+/*
+ * Unsigned range test: lo <= x <= hi, byte per byte.
+ */
+__attribute__((target("sse2")))
+static inline __m128i inRange16(__m128i x, char lo, char hi)
+{
+	__m128i geLo = _mm_cmpeq_epi8(_mm_max_epu8(x, _mm_set1_epi8(lo)), x);
+	__m128i leHi = _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(hi)), x);
+	return _mm_and_si128(geLo, leHi);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i space16(__m128i x)
+{
+	return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), inRange16(x, '\t', '\r'));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i alnum16(__m128i x)
+{
+	__m128i folded = _mm_or_si128(x, _mm_set1_epi8(0x20));
+	return _mm_or_si128(inRange16(x, '0', '9'), inRange16(folded, 'a', 'z'));
+}
+
+/*
+ * Runs the class test over 16 bytes at a time; the first byte outside
+ * the class ends the run.
+ */
+#define SSE2_SCANNER(fname, classify, tail)                                          \
+__attribute__((target("sse2")))                                                      \
+static const char *fname(const char *p, const char *end)                             \
+{                                                                                    \
+	while (end - p >= 16) {                                                      \
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));   \
+		unsigned mask = ~(unsigned)_mm_movemask_epi8(classify) & 0xFFFF;     \
+		if (mask) {                                                          \
+			return p + __builtin_ctz(mask);                              \
+		}                                                                    \
+		p += 16;                                                             \
+	}                                                                            \
+	return tail(p, end);                                                         \
+}
+
+SSE2_SCANNER(sse2Space,  space16(x),             scalarSpace)
+SSE2_SCANNER(sse2Alnum,  alnum16(x),             scalarAlnum)
+SSE2_SCANNER(sse2Digits, inRange16(x, '0', '9'), scalarDigits)
+
+/**********************************************************************/
+__attribute__((target("sse2")))
+static const char *sse2Find(const char *p, const char *end, char c)
+{
+	__m128i needle = _mm_set1_epi8(c);
+	while (end - p >= 16) {
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, needle));
+		if (mask) {
+			return p + __builtin_ctz(mask);
+		}
+		p += 16;
+	}
+	return scalarFind(p, end, c);
+} /* sse2Find */
+
+/**********************************************************************/
+/**********************************************************************/
+/*                         AVX2 versions                              */
+/**********************************************************************/
+/**********************************************************************/
+__attribute__((target("avx2")))
+static inline __m256i inRange32(__m256i x, char lo, char hi)
+{
+	__m256i geLo = _mm256_cmpeq_epi8(_mm256_max_epu8(x, _mm256_set1_epi8(lo)), x);
+	__m256i leHi = _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(hi)), x);
+	return _mm256_and_si256(geLo, leHi);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i space32(__m256i x)
+{
+	return _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), inRange32(x, '\t', '\r'));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i alnum32(__m256i x)
+{
+	__m256i folded = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+	return _mm256_or_si256(inRange32(x, '0', '9'), inRange32(folded, 'a', 'z'));
+}
+
+#define AVX2_SCANNER(fname, classify, tail)                                          \
+__attribute__((target("avx2")))                                                      \
+static const char *fname(const char *p, const char *end)                             \
+{                                                                                    \
+	while (end - p >= 32) {                                                      \
+		__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); \
+		unsigned mask = ~(unsigned)_mm256_movemask_epi8(classify);           \
+		if (mask) {                                                          \
+			return p + __builtin_ctz(mask);                              \
+		}                                                                    \
+		p += 32;                                                             \
+	}                                                                            \
+	return tail(p, end);                                                         \
+}
+
+AVX2_SCANNER(avx2Space,  space32(x),             sse2Space)
+AVX2_SCANNER(avx2Alnum,  alnum32(x),             sse2Alnum)
+AVX2_SCANNER(avx2Digits, inRange32(x, '0', '9'), sse2Digits)
+
+/**********************************************************************/
+__attribute__((target("avx2")))
+static const char *avx2Find(const char *p, const char *end, char c)
+{
+	__m256i needle = _mm256_set1_epi8(c);
+	while (end - p >= 32) {
+		__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+		unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, needle));
+		if (mask) {
+			return p + __builtin_ctz(mask);
+		}
+		p += 32;
+	}
+	return sse2Find(p, end, c);
+} /* avx2Find */
+#endif /* SCAN_X86 */
+
+/**********************************************************************/
+/**********************************************************************/
+/*                          Dispatch                                  */
+/**********************************************************************/
+/**********************************************************************/
+static const ScanOps scalarOps = { "scalar", scalarSpace, scalarAlnum, scalarDigits, scalarFind };
+#ifdef SCAN_X86
+static const ScanOps sse2Ops   = { "sse2",   sse2Space,   sse2Alnum,   sse2Digits,   sse2Find   };
+static const ScanOps avx2Ops   = { "avx2",   avx2Space,   avx2Alnum,   avx2Digits,   avx2Find   };
+#endif
+
+/**********************************************************************/
+/*!
+ * \brief Picks the widest scanners the CPU runs.
+ */
+static const ScanOps *selectScanOps()
+{
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return &avx2Ops;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return &sse2Ops;
+	}
+#endif
+	return &scalarOps;
+} /* selectScanOps */
+
+const ScanOps *scanOps = selectScanOps();
+
+/**********************************************************************/
+/*!
+ * fn bool setScanOps(const char *name)
+ * \brief Forces the scanners of one instruction set ("scalar", "sse2"
+ * or "avx2"), to compare them.
+ * \return false if name is unknown or the CPU does not support it
+ */
+bool setScanOps(const char *name)
+{
+	if (!strcmp(name, "scalar")) {
+		scanOps = &scalarOps;
+		return true;
+	}
+#ifdef SCAN_X86
+	if (!strcmp(name, "sse2") && __builtin_cpu_supports("sse2")) {
+		scanOps = &sse2Ops;
+		return true;
+	}
+	if (!strcmp(name, "avx2") && __builtin_cpu_supports("avx2")) {
+		scanOps = &avx2Ops;
+		return true;
+	}
+#endif
+	return false;
+} /* setScanOps */
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+
+/*!
+ * \file scan.hpp
+ * \brief Character class scanners for the Lexer.
+ *
+ * Each scanner returns the first position in [p, end) that does not
+ * belong to its run (or end). The SSE2 and AVX2 versions look at 16 or
+ * 32 bytes per step; the one to use is picked once, at startup, from
+ * what the CPU supports. Vector loads never go past end, so a source
+ * mapped right up to the end of a page is safe to scan.
+ */
+
+/**
+ * A ScanOps struct.
+ * The scanners of one instruction set.
+ */
+struct ScanOps
+{
+	const char *name;
+	const char *(*space)(const char *p, const char *end);          /*!< Skip isspace() characters */
+	const char *(*alnum)(const char *p, const char *end);          /*!< Skip [0-9A-Za-z]         */
+	const char *(*digits)(const char *p, const char *end);         /*!< Skip [0-9]               */
+	const char *(*find)(const char *p, const char *end, char c);   /*!< Find c                   */
+}; /* ScanOps */
+
+extern const ScanOps *scanOps;
+
+inline const char *scanSpace(const char *p, const char *end)  { return scanOps->space(p, end); }
+inline const char *scanAlnum(const char *p, const char *end)  { return scanOps->alnum(p, end); }
+inline const char *scanDigits(const char *p, const char *end) { return scanOps->digits(p, end); }
+inline const char *scanFind(const char *p, const char *end, char c) { return scanOps->find(p, end, c); }
+
+bool setScanOps(const char *name);
@@ -0,0 +1,72 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "source.hpp"
+
+/*!
+ * \file source.cpp
+ */
+
+/**********************************************************************/
+/*!
+ * fn bool SourceFile::open(const char *path)
+ * \brief Maps the file at path.
+ * \return false if it can not be read
+ */
+bool SourceFile::open(const char *path)
+{
+	close();
+
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		size_ = st.st_size;
+		if (size_ == 0) {
+			data_ = "";
+			::close(fd);
+			return true;
+		}
+
+		void *p = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			madvise(p, size_, MADV_SEQUENTIAL);
+			data_ = static_cast<const char *>(p);
+			mapped_ = true;
+			::close(fd);
+			return true;
+		}
+	}
+
+	/* Not a regular file, or mmap refused it */
+	char chunk[64 * 1024];
+	ssize_t n;
+	while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+		buffer_.append(chunk, n);
+	}
+	::close(fd);
+	if (n < 0) {
+		return false;
+	}
+
+	data_ = buffer_.data();
+	size_ = buffer_.size();
+	return true;
+} /* SourceFile::open */
+
+/**********************************************************************/
+void SourceFile::close()
+{
+	if (mapped_) {
+		munmap(const_cast<char *>(data_), size_);
+	}
+	data_ = NULL;
+	size_ = 0;
+	mapped_ = false;
+	buffer_.clear();
+} /* SourceFile::close */
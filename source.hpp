@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+/*!
+ * \file source.hpp
+ * \brief Read-only access to the text of a program file.
+ */
+
+/**
+ * A SourceFile class.
+ * Maps a file read-only into memory so the Lexer can scan it in place.
+ * Files that cannot be mapped (pipes, terminals) are read into a buffer.
+ * The text stays valid, and unchanged, until the SourceFile is destroyed.
+ */
+class SourceFile
+{
+	public:
+		SourceFile() : data_(NULL), size_(0), mapped_(false) {}
+		~SourceFile() { close(); }
+
+		bool open(const char *path);
+		void close();
+
+		const char *data() { return data_; }
+		size_t size()      { return size_; }
+	private:
+		SourceFile(const SourceFile &);
+		SourceFile &operator=(const SourceFile &);
+
+		const char *data_;
+		size_t size_;
+		bool mapped_;
+		std::string buffer_; /*!< Holds the text when it could not be mapped */
+}; /* SourceFile */
@@ -3,13 +3,17 @@
 #include <cassert>
 #include <string.h>
 
-#include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <atomic>
+#include <chrono>
 
 #include "clog.hpp"
 #include "interpreter.hpp"
 #include "token.hpp"
+#include "scan.hpp"
+#include "trace.hpp"
+#include "error.hpp"
 
 /*
  *  \file token.cpp
@@ -26,7 +30,7 @@
  * \var static CLog::m_bInitialised
  * \brief A variable about visibility of prints
  */
-bool CLog::m_bInitialised = true;
+std::atomic<bool> CLog::m_bInitialised(true);
 
 /**********************************************************************/
 /**
@@ -34,8 +38,11 @@ bool CLog::m_bInitialised = true;
  * \brief A variable about visibility of prints
  * If RELEASE, prints marked with DEBUG will not be displayed.
  * If DEBUG, all prints will be displayed.
+ * The level of every thread without one of its own, see
+ * CLog::setThreadLevel(). Atomic, since every thread reads it on every
+ * write.
  */
-int CLog::m_nLevel = CLog::RELEASE;
+std::atomic<int> CLog::m_nLevel(CLog::RELEASE);
 
 /*********************************************/
 /*********************************************/
@@ -87,6 +94,12 @@ std::string getTokenTypeLabel(const TokenType &type)
 		case T_COLON  : return "T_COLON";
 		case T_COMMA  : return "T_COMMA";
 		case T_SEMI   : return "T_SEMI";
+		case T_EQUAL        : return "T_EQUAL";
+		case T_NOT_EQUAL    : return "T_NOT_EQUAL";
+		case T_LESS         : return "T_LESS";
+		case T_LESS_EQUAL   : return "T_LESS_EQUAL";
+		case T_GREATER      : return "T_GREATER";
+		case T_GREATER_EQUAL: return "T_GREATER_EQUAL";
 
 		case T_PASC_BEGIN_RESERV  : return "T_PASC_BEGIN_RESERV";
 		case T_PASC_END_RESERV    : return "T_PASC_END_RESERV";
@@ -99,6 +112,14 @@ std::string getTokenTypeLabel(const TokenType &type)
 		case T_PASC_PROGRAM_RESERV: return "T_PASC_PROGRAM_RESERV";
 		case T_PASC_ID     	  : return "T_PASC_ID";
 		case T_PASC_PROCEDURE	  : return "T_PASC_PROCEDURE";
+		case T_PASC_IF_RESERV     : return "T_PASC_IF_RESERV";
+		case T_PASC_THEN_RESERV   : return "T_PASC_THEN_RESERV";
+		case T_PASC_ELSE_RESERV   : return "T_PASC_ELSE_RESERV";
+		case T_PASC_WHILE_RESERV  : return "T_PASC_WHILE_RESERV";
+		case T_PASC_DO_RESERV     : return "T_PASC_DO_RESERV";
+		case T_PASC_FOR_RESERV    : return "T_PASC_FOR_RESERV";
+		case T_PASC_TO_RESERV     : return "T_PASC_TO_RESERV";
+		case T_PASC_DOWNTO_RESERV : return "T_PASC_DOWNTO_RESERV";
 
 		case T_MAX    : return "T_MAX";
 		default:
@@ -117,7 +138,7 @@ std::string getTokenTypeLabel(const TokenType &type)
 std::string Token::representation()
 {
 	std::ostringstream stringStream;
-	stringStream << "Token(" << getTokenTypeLabel(type_) << ", " << value_ << ")";
+	stringStream << "Token(" << getTokenTypeLabel(type()) << ", " << value() << ")";
 	std::string msg = stringStream.str();
 	return msg;
 } /* Token::representation */
@@ -154,6 +175,28 @@ bool Token::isOperatorSecondPrecedence()
 	return false;
 } /* Token::isOperatorSecondPrecedence */
 
+/**********************************************************************/
+/*!
+ *  \brief Checks if Token is a relational operator
+ *  \return True if token is one of = <> < <= > >=
+ */
+bool Token::isRelationalOperator()
+{
+	switch(this->type())
+	{
+		case T_EQUAL:
+		case T_NOT_EQUAL:
+		case T_LESS:
+		case T_LESS_EQUAL:
+		case T_GREATER:
+		case T_GREATER_EQUAL:
+			return true;
+		default:
+			return false;
+	}
+	return false;
+} /* Token::isRelationalOperator */
+
 /**********************************************************************/
 /*!
  *  \brief Checks if Token is operator
@@ -193,15 +236,29 @@ bool Token::isOperatorFirstPrecedence()
 /*****************************************************/
 /*!
  *  \fn void Lexer::raiseError()
- *  \brief Raises assertion when getTokenTypeLabel()
- *  is not updated!
+ *  \brief Reports a character no token starts with and stops, see
+ *  programError()
  */
 void Lexer::raiseError()
 {
-	std::cout << "Invalid Syntax!!" << std::endl;
-	assert(false);
+	CLog::write(CLog::RELEASE, "Invalid Syntax!!\n");
+	programError();
 } /* Lexer::raiseError */
 
+/**********************************************************************/
+/*!
+ *  \fn void Lexer::_checkLength(size_t start)
+ *  \brief Reports a token from start to pos_ too long for
+ *  Token::length() and stops, see programError()
+ */
+void Lexer::_checkLength(size_t start)
+{
+	if (pos_ - start > Token::MAX_LENGTH) {
+		CLog::write(CLog::RELEASE, "Error: a token of %zu characters is longer than %d!\n", pos_ - start, (int)Token::MAX_LENGTH);
+		programError();
+	}
+} /* Lexer::_checkLength */
+
 /**********************************************************************/
 /*!
  * fn void Lexer::advance()
@@ -210,7 +267,7 @@ void Lexer::raiseError()
 void Lexer::advance()
 {
 	pos_++;
-	if (pos_ > text_.length() - 1) {
+	if (pos_ >= length_) {
 		currentChar_ = '\0'; // indicates EOF
 	} else {
 		currentChar_ = text_[pos_];
@@ -225,11 +282,11 @@ void Lexer::advance()
 char Lexer::peek()
 {
 	size_t peekPos = pos_ + 1;
-	if (peekPos > text_.size() - 1) {
-		CLog::write(CLog::DEBUG, "peek()\n");
+	if (peekPos >= length_) {
+		TRACE(TRACE_LEXER, "peek()\n");
 		return '\0';
 	} else {
-		CLog::write(CLog::DEBUG, "peek text_[pos] %c\n", text_[peekPos]);
+		TRACE(TRACE_LEXER, "peek text_[pos] %c\n", text_[peekPos]);
 		return text_[peekPos];
 	}
 } /* Lexer::peek */
@@ -241,59 +298,164 @@ char Lexer::peek()
  */
 void Lexer::skipComment()
 {
-	while (currentChar_ != '}') {
-		advance();
+	const char *end = text_ + length_;
+	const char *close = scanFind(text_ + pos_, end, '}');
+	if (close == end) {
+		_jump(length_); // unterminated comment: runs to the end of the text
+		return;
 	}
-	advance(); // the closing curly brace
+	_jump(close - text_ + 1); // past the closing curly brace
 } /* Lexer::skipComment */
 
+/**********************************************************************/
+/*!
+ * fn void Lexer::_jump(size_t pos)
+ * \brief Moves to pos, found by one of the scanners, in a single step
+ */
+void Lexer::_jump(size_t pos)
+{
+	pos_ = pos;
+	currentChar_ = pos_ < length_ ? text_[pos_] : '\0';
+} /* Lexer::_jump */
+
+/**********************************************************************/
+/*
+ * Keyword recognition.
+ * The keywords of keywords.def go into a table indexed by a perfect
+ * hash of (length, first, middle and last character). The multiplier of
+ * the hash is searched for at compile time, so an identifier costs one
+ * hash and at most one comparison. Letters are folded to lower case
+ * with | 0x20, which leaves digits alone.
+ */
+namespace {
+
+struct Keyword
+{
+	const char *name;
+	uint8_t     length;
+	uint8_t     type;
+}; /* Keyword */
+
+constexpr Keyword keywordList[] = {
+#define KEYWORD(name, type) { #name, sizeof(#name) - 1, type },
+#include "keywords.def"
+#undef KEYWORD
+};
+
+constexpr size_t KEYWORD_COUNT      = sizeof(keywordList) / sizeof(keywordList[0]);
+constexpr unsigned KEYWORD_HASH_BITS = 6;
+constexpr size_t KEYWORD_TABLE_SIZE = 1u << KEYWORD_HASH_BITS;
+static_assert(KEYWORD_TABLE_SIZE >= 2 * KEYWORD_COUNT, "Too many keywords: raise KEYWORD_HASH_BITS");
+
+constexpr uint32_t keywordHash(uint32_t seed, const char *text, size_t length)
+{
+	uint32_t key = (uint32_t)length
+		     ^ (uint32_t)(text[0] | 0x20) << 8
+		     ^ (uint32_t)(text[length / 2] | 0x20) << 16
+		     ^ (uint32_t)(text[length - 1] | 0x20) << 24;
+	return (key * seed) >> (32 - KEYWORD_HASH_BITS);
+} /* keywordHash */
+
+constexpr bool isPerfect(uint32_t seed)
+{
+	uint64_t used = 0;
+	for (size_t i = 0; i < KEYWORD_COUNT; i++) {
+		uint64_t bit = uint64_t(1) << keywordHash(seed, keywordList[i].name, keywordList[i].length);
+		if (used & bit) {
+			return false;
+		}
+		used |= bit;
+	}
+	return true;
+} /* isPerfect */
+
+constexpr uint32_t findSeed()
+{
+	for (uint32_t seed = 0x9E3779B1u; seed < 0x9E3779B1u + 200000; seed += 2) {
+		if (isPerfect(seed)) {
+			return seed;
+		}
+	}
+	return 0;
+} /* findSeed */
+
+constexpr uint32_t KEYWORD_SEED = findSeed();
+static_assert(KEYWORD_SEED != 0, "No perfect hash for keywords.def: raise KEYWORD_HASH_BITS");
+
+struct KeywordTable
+{
+	Keyword entries[KEYWORD_TABLE_SIZE];
+}; /* KeywordTable */
+
+constexpr KeywordTable buildKeywordTable()
+{
+	KeywordTable table = {};
+	for (size_t i = 0; i < KEYWORD_COUNT; i++) {
+		table.entries[keywordHash(KEYWORD_SEED, keywordList[i].name, keywordList[i].length)] = keywordList[i];
+	}
+	return table;
+} /* buildKeywordTable */
+
+constexpr KeywordTable keywordTable = buildKeywordTable();
+
+} /* namespace */
+
+/**********************************************************************/
+/*!
+ *  \fn const char *getKeywordName(const TokenType &type)
+ *  \brief The upper case spelling of a keyword, whatever case the
+ *  source used for it.
+ *  \return NULL if type is not a keyword
+ */
+const char *getKeywordName(const TokenType &type)
+{
+	for (size_t i = 0; i < KEYWORD_COUNT; i++) {
+		if (keywordList[i].type == type) {
+			return keywordList[i].name;
+		}
+	}
+	return NULL;
+} /* getKeywordName */
+
 /**********************************************************************/
 /*!
  * fn void Lexer::_getReservedKeywords()
- * \brief
+ * \brief Tells a reserved keyword from an identifier, ignoring case.
+ * \param text The word in the source buffer, not '\0' terminated
  */
-Token Lexer::_getReservedKeyword(const std::string &result)
+Token Lexer::_getReservedKeyword(const char *text, size_t length)
 {
-	CLog::write(CLog::DEBUG, "_getReservedKeyword() %s\n", result.c_str());
-	if (!strcmp(result.c_str(), "BEGIN")) {
-		return Token(T_PASC_BEGIN_RESERV, result);
-	} else if (!strcmp(result.c_str(), "END")) {
-		return Token(T_PASC_END_RESERV, result);
-	} else if (!strcmp(result.c_str(), "PROGRAM")) {
-		return Token(T_PASC_PROGRAM_RESERV, result);
-	} else if (!strcmp(result.c_str(), "VAR")) {
-		return Token(T_PASC_VAR_RESERV, result);
-	} else if (!strcmp(result.c_str(), "DIV")) {
-		return Token(T_PASC_INT_DIV_RESERV, result);
-	} else if (!strcmp(result.c_str(), "INTEGER")) {
-		return Token(T_PASC_INTEGER_RESERV, result);
-	} else if (!strcmp(result.c_str(), "REAL")) {
-		return Token(T_PASC_REAL_RESERV, result);
-	} else if (!strcmp(result.c_str(), "PROCEDURE")) {
-		return Token(T_PASC_PROCEDURE, result);
+	TRACE(TRACE_LEXER, "_getReservedKeyword() %.*s\n", (int)length, text);
+	const Keyword &keyword = keywordTable.entries[keywordHash(KEYWORD_SEED, text, length)];
+
+	if (keyword.length == length) {
+		size_t i = 0;
+		while (i < length && (text[i] | 0x20) == (keyword.name[i] | 0x20)) {
+			i++;
+		}
+		if (i == length) {
+			return Token((TokenType)keyword.type, text, length);
+		}
 	}
 
 	//If result is not a reserved keyword, then it's a variable or a mistake :)
-	return Token(T_PASC_ID, result); 
+	return Token(T_PASC_ID, text, length, InternTable::intern(text, length));
 } /* Lexer::_getReservedKeyword */
 
 /**********************************************************************/
 /*!
  * fn void Lexer::_id()
  * \brief Handles identifiers and reserved keywords
- * \return Token
+ * \return Token, a view of the word in text_
  */
 Token Lexer::_id()
 {
-	std::string result = "";
+	size_t start = pos_;
 
-	while (!isblank(currentChar_) && isalnum(currentChar_)) {
-		result.append(1, currentChar_);
-		advance();
-	}
-	CLog::write(CLog::DEBUG, "_id() --> %s\n", result.c_str());
-	Token tok = _getReservedKeyword(result); 
-	return tok;
+	_jump(scanAlnum(text_ + pos_, text_ + length_) - text_);
+	_checkLength(start);
+	TRACE(TRACE_LEXER, "_id() --> %.*s\n", (int)(pos_ - start), &text_[start]);
+	return _getReservedKeyword(&text_[start], pos_ - start);
 } /* Lexer::_id */
 
 /**********************************************************************/
@@ -302,37 +464,27 @@ Token Lexer::_id()
  */
 void Lexer::skipWhiteSpace()
 {
-	while (currentChar_ != '\0' && isspace(currentChar_)) {
-		advance();
-	}
+	_jump(scanSpace(text_ + pos_, text_ + length_) - text_);
 } /* Lexer::skipWhiteSpace */
 
 /**********************************************************************/
 /*!
  * fn void Lexer::number()
  * \brief Return a multidigit integer or float consumed from the input.
- * \return The number in string format
+ * \return The number as a view of text_
  */
 Token Lexer::number()
 {
-	std::string result = "";
-	while (currentChar_ != '\0' && isdigit(currentChar_)) {
-		result += currentChar_;
-		advance();
-	}
+	size_t start = pos_;
+	_jump(scanDigits(text_ + pos_, text_ + length_) - text_);
 	if (currentChar_ == '.') {
-		result += currentChar_;
 		advance();
-
-		while ( currentChar_ != '\0' &&
-			isdigit(currentChar_)) {
-			result += currentChar_;
-			advance();
-		}
-		
-		return Token(T_REAL, result);
+		_jump(scanDigits(text_ + pos_, text_ + length_) - text_);
+		_checkLength(start);
+		return Token(T_REAL, &text_[start], pos_ - start);
 	} else {
-		return Token(T_INTEGER, result);
+		_checkLength(start);
+		return Token(T_INTEGER, &text_[start], pos_ - start);
 	}
 	return Token();
 } /* Lexer::number */
@@ -348,28 +500,25 @@ Token Lexer::number()
  */
 Token Lexer::getNextToken()
 {
-	CLog::write(CLog::DEBUG, "Lexer::getNextToken\n\n");
+	TRACE(TRACE_LEXER, "Lexer::getNextToken\n\n");
 	while (currentChar_ != '\0') {
-		CLog::write(CLog::DEBUG, "%c\n", currentChar_);
+		TRACE(TRACE_LEXER, "%c\n", currentChar_);
 		if (currentChar_ == '{') {
 			advance();
 			skipComment();
+			continue;
 		}
 		if (isalpha(currentChar_)) {
 			return _id();
 		}
 		if (currentChar_ == ':' && peek() == '=') {
-			advance();
-			advance();
-			return Token(T_PASC_ASSIGN, ":=");
+			return _punctuation(T_PASC_ASSIGN, 2);
 		}
 		if (currentChar_ == ';') {
-			advance();
-			return Token(T_SEMI, ";");
+			return _punctuation(T_SEMI, 1);
 		}
 		if (currentChar_ == '.') {
-			advance();
-			return Token(T_PASC_DOT_RESERV, ".");
+			return _punctuation(T_PASC_DOT_RESERV, 1);
 		}
 		if (isspace(currentChar_)) {
 			skipWhiteSpace();
@@ -379,119 +528,110 @@ Token Lexer::getNextToken()
 			return number();
 		}
 		if (currentChar_ == ':') {
-			advance();
-			return Token(T_COLON, ":");
+			return _punctuation(T_COLON, 1);
 		}
 		if (currentChar_ == ',') {
-			advance();
-			return Token(T_COMMA, ",");
+			return _punctuation(T_COMMA, 1);
 		}
 		if (currentChar_ == '+') {
-			advance();
-			return Token(T_PLUS, "+");
+			return _punctuation(T_PLUS, 1);
 		}
 		if (currentChar_ == '-') {
-			advance();
-			return Token(T_MINUS, "-");
+			return _punctuation(T_MINUS, 1);
 		}
 		if (currentChar_ == '*') {
-			advance();
-			return Token(T_MUL, "*");
+			return _punctuation(T_MUL, 1);
 		}
 		if (currentChar_ == '/') {
-			advance();
-			return Token(T_DIV, "/");
+			return _punctuation(T_DIV, 1);
 		}
 		if (currentChar_ == '(') {
-			advance();
-			return Token(T_LPAREN, "(");
+			return _punctuation(T_LPAREN, 1);
+		}
+		if (currentChar_ == '=') {
+			return _punctuation(T_EQUAL, 1);
+		}
+		if (currentChar_ == '<') {
+			if (peek() == '=') {
+				return _punctuation(T_LESS_EQUAL, 2);
+			}
+			if (peek() == '>') {
+				return _punctuation(T_NOT_EQUAL, 2);
+			}
+			return _punctuation(T_LESS, 1);
+		}
+		if (currentChar_ == '>') {
+			if (peek() == '=') {
+				return _punctuation(T_GREATER_EQUAL, 2);
+			}
+			return _punctuation(T_GREATER, 1);
 		}
 		if (currentChar_ == ')') {
-			advance();
-			return Token(T_RPAREN, ")");
+			return _punctuation(T_RPAREN, 1);
 		}
-		CLog::write(CLog::DEBUG, "getNextTOken! should not Readch!");
+		TRACE(TRACE_LEXER, "getNextTOken! should not Readch!");
 		raiseError();
 	}
-	CLog::write(CLog::DEBUG, " getNextToken: Will return EOF!");
-	return Token(T_EOF, "");
+	TRACE(TRACE_LEXER, " getNextToken: Will return EOF!");
+	return Token(T_EOF, text_ + length_, 0);
 } /* Lexer::getNextToken */
 
 /**********************************************************************/
-/**********************************************************************/
-/**********************************************************************/
-/**********************************************************************/
-/**********************************************************************/
-/**********************************************************************/
-
-
-
-
-
-
-
-
-
-static void start(std::ifstream &file)
+/*!
+ * fn Token Lexer::_punctuation(TokenType type, size_t length)
+ * \brief Consumes length characters as a token of the given type
+ * \return Token, a view of the characters in text_
+ */
+Token Lexer::_punctuation(TokenType type, size_t length)
 {
-	std::string expr;
-
-	if (file.is_open()) {
-		std::string prog { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
-		std::cout << prog << std::endl;
-		Lexer lex(prog) ;
-		CLog::write(CLog::DEBUG, "start() before parser, parse(lex)\n"); 
-		Parser parser(lex);
-		CLog::write(CLog::DEBUG, "interpret() before interpret, interpret(parser)\n"); 
-		Interpreter interpreter(parser);
-		Node *result = interpreter.interpret();
-
-		SemanticAnalyzer seman;
-		seman.visit(result);
-
-		ASTPresenter pres;
-		pres.visit(result);
+	Token tok(type, &text_[pos_], length);
+	for (size_t i = 0; i < length; i++) {
+		advance();
 	}
-} /* start */
+	return tok;
+} /* Lexer::_punctuation */
 
 /**********************************************************************/
-
 /**********************************************************************/
-static int getFileWithRandomExpression(const char *argv, std::ifstream &file)
-{
-	file.open(argv, std::ifstream::in);
-	if (!file.is_open()) {
-		assert(false);
-		return 0;
-	} 
-	return 1;
-} /* getFileWithRandomExpression */
-
 /**********************************************************************/
-
+/*                     TokenBuffer methods                            */
 /**********************************************************************/
-static int parseArgs(const int argc, char **argv, std::ifstream &file)
-{
-	for (int i = 0; i < argc; i++) {
-		//if (!strcmp(argv[i], "-f")) {
-			if (argv[i+1]) {
-				getFileWithRandomExpression(argv[i+1], file);
-				return 1;
-			}
-		//}
-	}
-	return 0;
-} /* parseArgs */
-
 /**********************************************************************/
-
 /**********************************************************************/
-int main(int argc, char **argv)
+/*!
+ * fn void TokenBuffer::fill(Lexer &lexer)
+ * \brief Lexes the whole input of lexer, up to and including T_EOF,
+ * in one pass.
+ */
+void TokenBuffer::fill(Lexer &lexer)
 {
-	std::ifstream file;
-	parseArgs(argc, argv, file);
-	start(file);
-} /* main */
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+	base_ = lexer.text();
+	kinds_.clear();
+	offsets_.clear();
+	lengths_.clear();
+	ids_.clear();
+
+	/* About one token every four characters of source */
+	size_t estimate = lexer.length() / 4 + 16;
+	kinds_.reserve(estimate);
+	offsets_.reserve(estimate);
+	lengths_.reserve(estimate);
+	ids_.reserve(estimate);
+
+	Token tok;
+	do {
+		tok = lexer.getNextToken();
+		kinds_.push_back(tok.type());
+		offsets_.push_back(tok.text() - base_);
+		lengths_.push_back(tok.length());
+		ids_.push_back(tok.id());
+	} while (tok.type() != T_EOF);
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	seconds_ = std::chrono::duration<double>(end - begin).count();
+} /* TokenBuffer::fill */
 
 /**********************************************************************/
 
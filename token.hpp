@@ -1,4 +1,10 @@
 #pragma once
+#include <string>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+#include "intern.hpp"
 
 /*!
  *  \file token.hpp
@@ -18,6 +24,12 @@ enum TokenType
 	T_COLON,
 	T_COMMA,
 	T_SEMI,         /*!< The Token type_ is SEMI ;     */
+	T_EQUAL,        /*!< =  */
+	T_NOT_EQUAL,    /*!< <> */
+	T_LESS,         /*!< <  */
+	T_LESS_EQUAL,   /*!< <= */
+	T_GREATER,      /*!< >  */
+	T_GREATER_EQUAL,/*!< >= */
 
 	T_PASC_BEGIN_RESERV,   /*!< The Token type_ is BEGIN             */
 	T_PASC_END_RESERV,     /*!< The Token type_ is END               */
@@ -30,6 +42,14 @@ enum TokenType
 	T_PASC_PROGRAM_RESERV, /*!< "PROGRAM" reserved keyword in Pascal */
 	T_PASC_ID,             /*!< "ID"  reserved keyword in Pascal     */
 	T_PASC_PROCEDURE,      /*!< "PROCEDURE" reserved keyword         */
+	T_PASC_IF_RESERV,      /*!< "IF" reserved keyword                */
+	T_PASC_THEN_RESERV,    /*!< "THEN" reserved keyword              */
+	T_PASC_ELSE_RESERV,    /*!< "ELSE" reserved keyword              */
+	T_PASC_WHILE_RESERV,   /*!< "WHILE" reserved keyword             */
+	T_PASC_DO_RESERV,      /*!< "DO" reserved keyword                */
+	T_PASC_FOR_RESERV,     /*!< "FOR" reserved keyword               */
+	T_PASC_TO_RESERV,      /*!< "TO" reserved keyword                */
+	T_PASC_DOWNTO_RESERV,  /*!< "DOWNTO" reserved keyword            */
 
 	T_MAX
 }; /* TokenType */
@@ -38,35 +58,60 @@ enum TokenType
 
 /**********************************************************************/
 
+/**
+ * A Token class.
+ * A Token is a type and a view of its text: identifiers, numbers and
+ * keywords point into the source buffer, punctuation at a string literal.
+ * Nothing is allocated per token, so the source must outlive the tokens
+ * and the AST built from them. An identifier also carries the NameId the
+ * InternTable gave it.
+ * The type and the length share a word, so a token is at most
+ * MAX_LENGTH characters long; the Lexer rejects a longer one.
+ */
 class Token
 {
 	public:
+		enum { MAX_LENGTH = (1 << 24) - 1 };
+
 		///Create a Token with default values.
-		Token() : type_(T_MAX), value_("") {}
+		Token() : type_(T_MAX), length_(0), id_(NO_NAME), text_("") {}
 		///Create a Token with given values.
-		Token(TokenType type, std::string value) : type_(type), value_(value){}
+		Token(TokenType type, const char *text) : type_(type), length_(strlen(text)), id_(NO_NAME), text_(text) {}
+		Token(TokenType type, const char *text, size_t length, NameId id = NO_NAME)
+			: type_(type), length_(length), id_(id), text_(text) {}
 
 		std::string representation();
-		std::string value() { return value_; }
+		std::string value() { return std::string(text_, length_); }
+		const char *text()  { return text_; }
+		uint32_t length()   { return length_; }
+		NameId id()         { return id_; }
 
-		TokenType type() { return type_; }
+		TokenType type() { return (TokenType)type_; }
 
 		bool isOperator();
 		bool isOperatorFirstPrecedence();
 		bool isOperatorSecondPrecedence();
+		bool isRelationalOperator();
 	private:
 
-		TokenType type_;
-		std::string value_;
+		uint32_t type_   : 8;
+		uint32_t length_ : 24;
+		NameId id_;         /*!< NO_NAME unless type_ is T_PASC_ID */
+		const char *text_;
 }; /* Token */
 
 /**********************************************************************/
 
 /**********************************************************************/
+/**
+ * A Lexer class.
+ * Scans a source buffer it does not own. The buffer must stay alive,
+ * unchanged, for as long as the tokens (and the AST) are used.
+ */
 class Lexer
 {
 	public:
-		Lexer(std::string prog) : text_(prog), pos_(0), currentChar_(text_[pos_]) {}
+		Lexer(const char *text, size_t length) : text_(text), length_(length), pos_(0), currentChar_(length ? text[0] : '\0') {}
 		void advance();
 		void skipWhiteSpace();
 		char peek();
@@ -74,18 +119,57 @@ class Lexer
 		Token getNextToken();
 		Token number();
 		void skipComment();
+
+		const char *text() { return text_; }
+		size_t length()    { return length_; }
 	private:
 		void raiseError();
-		Token _getReservedKeyword(const std::string &result);
+		void _checkLength(size_t start);
+		Token _getReservedKeyword(const char *text, size_t length);
+		Token _punctuation(TokenType type, size_t length);
+		void  _jump(size_t pos);
 
-		std::string text_;
+		const char *text_;
+		size_t length_;
 		size_t pos_;
 		char currentChar_;
 
 }; /* Lexer */
 
+/**********************************************************************/
+
+/**********************************************************************/
+/**
+ * A TokenBuffer class.
+ * Holds every token of a source, lexed ahead of parsing, as parallel
+ * arrays of kind, offset and length. Token i is rebuilt on demand as a
+ * view of the source, so the Parser can look any distance ahead.
+ */
+class TokenBuffer
+{
+	public:
+		TokenBuffer() : base_(NULL), seconds_(0) {}
+
+		void fill(Lexer &lexer);
+
+		size_t size() { return kinds_.size(); }
+		TokenType kind(size_t i) { return (TokenType)kinds_[i]; }
+		Token at(size_t i) { return Token((TokenType)kinds_[i], base_ + offsets_[i], lengths_[i], ids_[i]); }
+
+		double seconds() { return seconds_; }
+		double tokensPerSecond() { return seconds_ > 0 ? size() / seconds_ : 0; }
+	private:
+		const char *base_;
+		std::vector<uint8_t>  kinds_;
+		std::vector<uint32_t> offsets_;
+		std::vector<uint32_t> lengths_;
+		std::vector<NameId>   ids_;
+		double seconds_; /*!< Time fill() took */
+}; /* TokenBuffer */
+
 
 
 std::string getTokenTypeLabel(const TokenType &type);
+const char *getKeywordName(const TokenType &type);
 void raiseLabelError();
 
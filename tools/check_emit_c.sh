@@ -0,0 +1,60 @@
+#!/bin/sh
+# Checks the --emit-c backend against the interpreter.
+# Every program is run by the interpreter, and translated to C, built
+# with the system compiler and run; both must exit the same way and
+# print the same memory.
+#
+# usage: tools/check_emit_c.sh path/to/interpreter [program.pas ...]
+# With no programs, checks those of bench/.
+
+interpreter=$1
+if [ -z "$interpreter" ] || [ ! -x "$interpreter" ]; then
+	echo "usage: $0 path/to/interpreter [program.pas ...]"
+	exit 2
+fi
+shift
+if [ $# -eq 0 ]; then
+	set -- "$(dirname "$0")"/../bench/*.pas
+fi
+
+CC=${CC:-cc}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+failed=0
+for program in "$@"; do
+	name=$(basename "$program" .pas)
+	"$interpreter" "$program" > "$work/$name.out" 2>&1
+	status=$?
+	sed -n '/^Memory:/,$p' "$work/$name.out" > "$work/$name.expected"
+
+	if ! "$interpreter" --emit-c="$work/$name.c" "$program" > /dev/null 2>&1; then
+		if [ $status -ne 0 ]; then
+			echo "skip $program: the interpreter rejects it"
+		else
+			echo "FAIL $program: can not translate"
+			failed=1
+		fi
+		continue
+	fi
+	if ! $CC -O2 -o "$work/$name" "$work/$name.c" 2> "$work/$name.cc"; then
+		echo "FAIL $program: can not build"
+		cat "$work/$name.cc"
+		failed=1
+		continue
+	fi
+	"$work/$name" > "$work/$name.run" 2>&1
+	cstatus=$?
+	sed -n '/^Memory:/,$p' "$work/$name.run" > "$work/$name.actual"
+
+	if [ $status -ne $cstatus ]; then
+		echo "FAIL $program: exit status $cstatus, the interpreter gives $status"
+		failed=1
+	elif ! diff "$work/$name.expected" "$work/$name.actual"; then
+		echo "FAIL $program: memory differs"
+		failed=1
+	else
+		echo "ok   $program"
+	fi
+done
+exit $failed
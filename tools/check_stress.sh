@@ -0,0 +1,39 @@
+#!/bin/sh
+# Checks that interpreter runs on different threads do not disturb each
+# other. Every program is run with --stress, which runs it once and then
+# RUNS times more at once on JOBS threads, and exits with 1 if one run
+# prints anything else than the first.
+#
+# usage: tools/check_stress.sh path/to/interpreter [program.pas ...]
+# With no programs, checks those of bench/. RUNS and JOBS default to 20
+# and 8.
+
+interpreter=$1
+if [ -z "$interpreter" ] || [ ! -x "$interpreter" ]; then
+	echo "usage: $0 path/to/interpreter [program.pas ...]"
+	exit 2
+fi
+shift
+if [ $# -eq 0 ]; then
+	set -- "$(dirname "$0")"/../bench/*.pas
+fi
+
+RUNS=${RUNS:-20}
+JOBS=${JOBS:-8}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+failed=0
+for program in "$@"; do
+	name=$(basename "$program" .pas)
+	"$interpreter" --stress="$RUNS" --jobs="$JOBS" "$program" > "$work/$name.out" 2>&1
+	status=$?
+	if [ $status -ne 0 ]; then
+		echo "FAIL $program: exit status $status"
+		tail -n 5 "$work/$name.out"
+		failed=1
+	else
+		echo "ok   $program: $(grep '^Stress:' "$work/$name.out")"
+	fi
+done
+exit $failed
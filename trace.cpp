@@ -0,0 +1,62 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+
+#include "trace.hpp"
+#include "clog.hpp"
+
+/*!
+ * \file trace.cpp
+ */
+
+/**********************************************************************/
+/*!
+ * fn unsigned traceMaskFromString(const char *spec)
+ * \brief Turns a comma separated list of category names into a mask.
+ * Unknown names are ignored.
+ */
+unsigned traceMaskFromString(const char *spec)
+{
+	static const struct { const char *name; unsigned mask; } names[] = {
+		{ "lexer",  TRACE_LEXER  },
+		{ "parser", TRACE_PARSER },
+		{ "sema",   TRACE_SEMA   },
+		{ "eval",   TRACE_EVAL   },
+		{ "all",    TRACE_ALL    },
+	};
+
+	unsigned mask = 0;
+	while (spec && *spec) {
+		size_t length = strcspn(spec, ",");
+		for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+			if (strlen(names[i].name) == length && !strncmp(names[i].name, spec, length)) {
+				mask |= names[i].mask;
+			}
+		}
+		spec += length;
+		if (*spec == ',') {
+			spec++;
+		}
+	}
+	return mask;
+} /* traceMaskFromString */
+
+/**********************************************************************/
+/**
+ * \var unsigned traceMask
+ * \brief The enabled TraceCategory bits, read from PASCAL_TRACE at startup
+ */
+unsigned traceMask = traceMaskFromString(getenv("PASCAL_TRACE"));
+
+/**********************************************************************/
+/*!
+ * fn void traceWrite(const char *szFormat, ...)
+ * \brief Prints a trace message through CLog
+ */
+void traceWrite(const char *szFormat, ...)
+{
+	va_list args;
+	va_start(args, szFormat);
+	CLog::vwrite(CLog::RELEASE, szFormat, args);
+	va_end(args);
+} /* traceWrite */
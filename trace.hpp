@@ -0,0 +1,41 @@
+#pragma once
+
+/*!
+ * \file trace.hpp
+ * \brief Debug tracing by subsystem.
+ *
+ * TRACE(category, format, ...) prints like printf when category is
+ * enabled. Categories are picked at runtime from the PASCAL_TRACE
+ * environment variable, e.g. PASCAL_TRACE=lexer,parser or
+ * PASCAL_TRACE=all. A disabled category costs one test of a global
+ * mask and its arguments are not evaluated.
+ *
+ * Unless the build defines PASCAL_TRACE (cmake -DENABLE_TRACE=ON),
+ * TRACE expands to nothing at all.
+ */
+
+enum TraceCategory
+{
+	TRACE_LEXER  = 1 << 0,	/*!< Lexer and TokenBuffer          */
+	TRACE_PARSER = 1 << 1,	/*!< Parser productions             */
+	TRACE_SEMA   = 1 << 2,	/*!< SemanticAnalyzer               */
+	TRACE_EVAL   = 1 << 3,	/*!< Evaluator, Compiler and VM     */
+
+	TRACE_ALL    = TRACE_LEXER | TRACE_PARSER | TRACE_SEMA | TRACE_EVAL
+}; /* TraceCategory */
+
+extern unsigned traceMask;
+
+unsigned traceMaskFromString(const char *spec);
+void traceWrite(const char *szFormat, ...) __attribute__((format(printf, 1, 2)));
+
+#ifdef PASCAL_TRACE
+#define TRACE(category, ...)                                       \
+	do {                                                       \
+		if (__builtin_expect(traceMask & (category), 0)) { \
+			traceWrite(__VA_ARGS__);                   \
+		}                                                  \
+	} while (0)
+#else
+#define TRACE(category, ...) do { } while (0)
+#endif
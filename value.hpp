@@ -0,0 +1,138 @@
+#pragma once
+#include <cstdint>
+
+/*!
+ * \file value.hpp
+ * \brief The runtime value of an expression and the arithmetic kernels
+ * that combine values.
+ */
+
+/*!
+ *  \enum SymbolType
+ *  \brief The static type of a variable or an expression
+ */
+enum SymbolType {
+	INTEGER,
+	REAL,
+	BOOLEAN, /*!< A comparison. Only conditions have this type */
+	NONE
+};
+
+/**
+ * A Value union.
+ * An INTEGER or a REAL. The SemanticAnalyzer knows the type of every
+ * expression and variable, so the value carries no tag: whoever reads it
+ * already knows which member is live. A BOOLEAN is the integer 0 or 1.
+ * A value initialised Value, Value(), is the integer 0.
+ */
+union Value
+{
+	int64_t i;
+	double  r;
+
+	static Value integer(int64_t v) { Value x; x.i = v; return x; }
+	static Value real(double v)     { Value x; x.r = v; return x; }
+}; /* Value */
+
+/*!
+ *  \enum Kernel
+ *  \brief An arithmetic operation or a comparison on operands of known types.
+ *  _II takes two INTEGERs, _RR two REALs. _IR and _RI take one of each
+ *  and convert the INTEGER side. The kernel of every BinOp and UnaryOp is
+ *  chosen once, by the SemanticAnalyzer. Comparisons give a BOOLEAN.
+ */
+enum Kernel
+{
+	K_ADD_II, K_SUB_II, K_MUL_II, K_DIV_II, K_INT_DIV_II,
+	K_EQ_II,  K_NE_II,  K_LT_II,  K_LE_II,  K_GT_II, K_GE_II,
+	K_ADD_RR, K_SUB_RR, K_MUL_RR, K_DIV_RR,
+	K_EQ_RR,  K_NE_RR,  K_LT_RR,  K_LE_RR,  K_GT_RR, K_GE_RR,
+	K_ADD_IR, K_SUB_IR, K_MUL_IR, K_DIV_IR,
+	K_EQ_IR,  K_NE_IR,  K_LT_IR,  K_LE_IR,  K_GT_IR, K_GE_IR,
+	K_ADD_RI, K_SUB_RI, K_MUL_RI, K_DIV_RI,
+	K_EQ_RI,  K_NE_RI,  K_LT_RI,  K_LE_RI,  K_GT_RI, K_GE_RI,
+	K_NEG_I,  K_NEG_R,
+	K_NONE    /*!< unary plus: the operand as is */
+}; /* Kernel */
+
+[[noreturn]] void divisionByZero();
+
+/**********************************************************************/
+/*!
+ * \brief Whether kernel k compares its operands
+ */
+inline bool isComparison(Kernel k)
+{
+	return (k >= K_EQ_II && k <= K_GE_II) || (k >= K_EQ_RR && k <= K_GE_RR) ||
+	       (k >= K_EQ_IR && k <= K_GE_IR) || (k >= K_EQ_RI && k <= K_GE_RI);
+} /* isComparison */
+
+/**********************************************************************/
+/*!
+ * \brief Applies kernel k to a and b (b is ignored by the unary ones).
+ * INTEGER results wrap around on overflow instead of being undefined.
+ * DIV truncates toward zero; an INTEGER DIV by zero is a runtime error.
+ */
+inline Value applyKernel(Kernel k, Value a, Value b)
+{
+	switch (k)
+	{
+		case K_ADD_II: return Value::integer((int64_t)((uint64_t)a.i + (uint64_t)b.i));
+		case K_SUB_II: return Value::integer((int64_t)((uint64_t)a.i - (uint64_t)b.i));
+		case K_MUL_II: return Value::integer((int64_t)((uint64_t)a.i * (uint64_t)b.i));
+		case K_DIV_II: return Value::real((double)a.i / (double)b.i);
+		case K_INT_DIV_II:
+			if (b.i == 0) {
+				divisionByZero();
+			}
+			if (b.i == -1) {
+				return Value::integer((int64_t)(0 - (uint64_t)a.i));
+			}
+			return Value::integer(a.i / b.i);
+
+		case K_EQ_II: return Value::integer(a.i == b.i);
+		case K_NE_II: return Value::integer(a.i != b.i);
+		case K_LT_II: return Value::integer(a.i <  b.i);
+		case K_LE_II: return Value::integer(a.i <= b.i);
+		case K_GT_II: return Value::integer(a.i >  b.i);
+		case K_GE_II: return Value::integer(a.i >= b.i);
+
+		case K_ADD_RR: return Value::real(a.r + b.r);
+		case K_SUB_RR: return Value::real(a.r - b.r);
+		case K_MUL_RR: return Value::real(a.r * b.r);
+		case K_DIV_RR: return Value::real(a.r / b.r);
+		case K_EQ_RR:  return Value::integer(a.r == b.r);
+		case K_NE_RR:  return Value::integer(a.r != b.r);
+		case K_LT_RR:  return Value::integer(a.r <  b.r);
+		case K_LE_RR:  return Value::integer(a.r <= b.r);
+		case K_GT_RR:  return Value::integer(a.r >  b.r);
+		case K_GE_RR:  return Value::integer(a.r >= b.r);
+
+		case K_ADD_IR: return Value::real((double)a.i + b.r);
+		case K_SUB_IR: return Value::real((double)a.i - b.r);
+		case K_MUL_IR: return Value::real((double)a.i * b.r);
+		case K_DIV_IR: return Value::real((double)a.i / b.r);
+		case K_EQ_IR:  return Value::integer((double)a.i == b.r);
+		case K_NE_IR:  return Value::integer((double)a.i != b.r);
+		case K_LT_IR:  return Value::integer((double)a.i <  b.r);
+		case K_LE_IR:  return Value::integer((double)a.i <= b.r);
+		case K_GT_IR:  return Value::integer((double)a.i >  b.r);
+		case K_GE_IR:  return Value::integer((double)a.i >= b.r);
+
+		case K_ADD_RI: return Value::real(a.r + (double)b.i);
+		case K_SUB_RI: return Value::real(a.r - (double)b.i);
+		case K_MUL_RI: return Value::real(a.r * (double)b.i);
+		case K_DIV_RI: return Value::real(a.r / (double)b.i);
+		case K_EQ_RI:  return Value::integer(a.r == (double)b.i);
+		case K_NE_RI:  return Value::integer(a.r != (double)b.i);
+		case K_LT_RI:  return Value::integer(a.r <  (double)b.i);
+		case K_LE_RI:  return Value::integer(a.r <= (double)b.i);
+		case K_GT_RI:  return Value::integer(a.r >  (double)b.i);
+		case K_GE_RI:  return Value::integer(a.r >= (double)b.i);
+
+		case K_NEG_I: return Value::integer((int64_t)(0 - (uint64_t)a.i));
+		case K_NEG_R: return Value::real(-a.r);
+		case K_NONE:  return a;
+	}
+	return a;
+} /* applyKernel */
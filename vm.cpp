@@ -0,0 +1,1087 @@
+#include <cassert>
+#include <cstdlib>
+
+#include "vm.hpp"
+#include "interpreter.hpp"
+#include "clog.hpp"
+#include "trace.hpp"
+
+/*!
+ * \file vm.cpp
+ */
+
+/**********************************************************************/
+/*!
+ *  \fn const char *getOpCodeLabel(int op)
+ *  \brief Gets the string label of an OpCode
+ */
+const char *getOpCodeLabel(int op)
+{
+	switch (op)
+	{
+		case OP_CONST  : return "CONST";
+		case OP_LOAD   : return "LOAD";
+		case OP_STORE  : return "STORE";
+		case OP_INC_I  : return "INC_I";
+		case OP_ADD_I  : return "ADD_I";
+		case OP_SUB_I  : return "SUB_I";
+		case OP_MUL_I  : return "MUL_I";
+		case OP_DIV_I  : return "DIV_I";
+		case OP_NEG_I  : return "NEG_I";
+		case OP_ADD_R  : return "ADD_R";
+		case OP_SUB_R  : return "SUB_R";
+		case OP_MUL_R  : return "MUL_R";
+		case OP_DIV_R  : return "DIV_R";
+		case OP_NEG_R  : return "NEG_R";
+		case OP_I2R    : return "I2R";
+		case OP_EQ_I   : return "EQ_I";
+		case OP_NE_I   : return "NE_I";
+		case OP_LT_I   : return "LT_I";
+		case OP_LE_I   : return "LE_I";
+		case OP_GT_I   : return "GT_I";
+		case OP_GE_I   : return "GE_I";
+		case OP_EQ_R   : return "EQ_R";
+		case OP_NE_R   : return "NE_R";
+		case OP_LT_R   : return "LT_R";
+		case OP_LE_R   : return "LE_R";
+		case OP_GT_R   : return "GT_R";
+		case OP_GE_R   : return "GE_R";
+		case OP_JUMP   : return "JUMP";
+		case OP_JUMP_FALSE: return "JUMP_FALSE";
+		case OP_JUMP_EQ_I: return "JUMP_EQ_I";
+		case OP_JUMP_NE_I: return "JUMP_NE_I";
+		case OP_JUMP_LT_I: return "JUMP_LT_I";
+		case OP_JUMP_LE_I: return "JUMP_LE_I";
+		case OP_JUMP_GT_I: return "JUMP_GT_I";
+		case OP_JUMP_GE_I: return "JUMP_GE_I";
+		case OP_FOR_UP : return "FOR_UP";
+		case OP_NEXT_UP: return "NEXT_UP";
+		case OP_FOR_DOWN : return "FOR_DOWN";
+		case OP_NEXT_DOWN: return "NEXT_DOWN";
+		case OP_CALL   : return "CALL";
+		case OP_RET    : return "RET";
+		case OP_NATIVE : return "NATIVE";
+		case OP_HALT   : return "HALT";
+		default:
+			break;
+	}
+	return "???";
+} /* getOpCodeLabel */
+
+/**********************************************************************/
+/*!
+ *  \brief Number of operand words that follow an opcode
+ */
+static int operandCount(int op)
+{
+	switch (op)
+	{
+		case OP_CONST:
+		case OP_JUMP:
+		case OP_JUMP_FALSE:
+		case OP_JUMP_EQ_I:
+		case OP_JUMP_NE_I:
+		case OP_JUMP_LT_I:
+		case OP_JUMP_LE_I:
+		case OP_JUMP_GT_I:
+		case OP_JUMP_GE_I:
+		case OP_NATIVE:
+			return 1;
+		case OP_LOAD:
+		case OP_STORE:
+			return 2;
+		case OP_INC_I:
+		case OP_FOR_UP:
+		case OP_NEXT_UP:
+		case OP_FOR_DOWN:
+		case OP_NEXT_DOWN:
+			return 3;
+		case OP_CALL:
+			return 4;
+		default:
+			return 0;
+	}
+	return 0;
+} /* operandCount */
+
+/**********************************************************************/
+/*!
+ *  \brief Net effect of an opcode on the operand stack depth
+ */
+static int stackEffect(int op)
+{
+	switch (op)
+	{
+		case OP_CONST:
+		case OP_LOAD:
+			return 1;
+		case OP_STORE:
+		case OP_ADD_I:
+		case OP_SUB_I:
+		case OP_MUL_I:
+		case OP_DIV_I:
+		case OP_ADD_R:
+		case OP_SUB_R:
+		case OP_MUL_R:
+		case OP_DIV_R:
+		case OP_EQ_I:
+		case OP_NE_I:
+		case OP_LT_I:
+		case OP_LE_I:
+		case OP_GT_I:
+		case OP_GE_I:
+		case OP_EQ_R:
+		case OP_NE_R:
+		case OP_LT_R:
+		case OP_LE_R:
+		case OP_GT_R:
+		case OP_GE_R:
+		case OP_JUMP_FALSE:
+		case OP_FOR_UP:
+		case OP_NEXT_UP:
+		case OP_FOR_DOWN:
+		case OP_NEXT_DOWN:
+			return -1;
+		case OP_JUMP_EQ_I:
+		case OP_JUMP_NE_I:
+		case OP_JUMP_LT_I:
+		case OP_JUMP_LE_I:
+		case OP_JUMP_GT_I:
+		case OP_JUMP_GE_I:
+			return -2;
+		default:
+			return 0;
+	}
+	return 0;
+} /* stackEffect */
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                     Bytecode methods                               */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*!
+ * fn void Bytecode::disassemble()
+ * \brief Prints the instruction stream in a readable form
+ */
+void Bytecode::disassemble()
+{
+	CLog::write(CLog::RELEASE, "Bytecode: %u words, %u constants, stack %d\n",
+			code_.size(), constants_.size(), maxStack_);
+	size_t pc = 0;
+	while (pc < code_.size()) {
+		int op = code_[pc];
+		if (op == OP_CONST && constantTypes_[code_[pc + 1]] == INTEGER) {
+			CLog::write(CLog::RELEASE, "%5u %-8s %d (%lld)\n", pc, getOpCodeLabel(op), code_[pc + 1], (long long)constants_[code_[pc + 1]].i);
+		} else if (op == OP_CONST) {
+			CLog::write(CLog::RELEASE, "%5u %-8s %d (%g)\n", pc, getOpCodeLabel(op), code_[pc + 1], constants_[code_[pc + 1]].r);
+		} else if (operandCount(op) == 1) {
+			CLog::write(CLog::RELEASE, "%5u %-8s %d\n", pc, getOpCodeLabel(op), code_[pc + 1]);
+		} else if (operandCount(op) == 2) {
+			CLog::write(CLog::RELEASE, "%5u %-8s %d %d\n", pc, getOpCodeLabel(op), code_[pc + 1], code_[pc + 2]);
+		} else if (operandCount(op) == 3) {
+			CLog::write(CLog::RELEASE, "%5u %-8s %d %d %d\n", pc, getOpCodeLabel(op), code_[pc + 1], code_[pc + 2], code_[pc + 3]);
+		} else if (operandCount(op) == 4) {
+			CLog::write(CLog::RELEASE, "%5u %-8s %d %d %d %d\n", pc, getOpCodeLabel(op),
+					code_[pc + 1], code_[pc + 2], code_[pc + 3], code_[pc + 4]);
+		} else {
+			CLog::write(CLog::RELEASE, "%5u %s\n", pc, getOpCodeLabel(op));
+		}
+		pc += 1 + operandCount(op);
+	}
+} /* Bytecode::disassemble */
+
+/**********************************************************************/
+/*!
+ * fn bool Bytecode::verify()
+ * \brief Checks that the code is well formed: known opcodes with all
+ * their operands, constants, jump targets and procedure entries within
+ * range, variable addresses that are not negative, and an OP_HALT at
+ * the end. OP_NATIVE is refused, as the functions it calls do not
+ * outlive their Jit. This guards the VM against a damaged file, such as
+ * a stale entry of a BytecodeCache; it is no sandbox.
+ */
+bool Bytecode::verify()
+{
+	int size = code_.size();
+	if (size == 0 || code_[size - 1] != OP_HALT || maxStack_ < 0 || frameSize_ < 0) {
+		return false;
+	}
+	for (size_t i = 0; i < globals_.size(); i++) {
+		if (globals_[i].slot < 0 || globals_[i].slot >= frameSize_) {
+			return false;
+		}
+	}
+	int pc = 0;
+	while (pc < size) {
+		int op = code_[pc];
+		if (op < 0 || op >= OP_MAX || op == OP_NATIVE || pc + operandCount(op) >= size) {
+			return false;
+		}
+		const int *arg = &code_[pc + 1];
+		switch (op)
+		{
+			case OP_CONST:
+				if (arg[0] < 0 || arg[0] >= (int)constants_.size()) {
+					return false;
+				}
+				break;
+			case OP_JUMP:
+			case OP_JUMP_FALSE:
+			case OP_JUMP_EQ_I:
+			case OP_JUMP_NE_I:
+			case OP_JUMP_LT_I:
+			case OP_JUMP_LE_I:
+			case OP_JUMP_GT_I:
+			case OP_JUMP_GE_I:
+				if (arg[0] < 0 || arg[0] >= size) {
+					return false;
+				}
+				break;
+			case OP_LOAD:
+			case OP_STORE:
+				if (arg[0] < 1 || arg[1] < 0) {
+					return false;
+				}
+				break;
+			case OP_INC_I:
+				if (arg[0] < 1 || arg[1] < 0 || arg[2] < 0 || arg[2] >= (int)constants_.size()) {
+					return false;
+				}
+				break;
+			case OP_FOR_UP:
+			case OP_NEXT_UP:
+			case OP_FOR_DOWN:
+			case OP_NEXT_DOWN:
+				if (arg[0] < 1 || arg[1] < 0 || arg[2] < 0 || arg[2] >= size) {
+					return false;
+				}
+				break;
+			case OP_CALL:
+				if (arg[0] < 0 || arg[0] >= size || arg[1] < 2 || arg[2] < 0 || arg[3] < 0 || arg[3] > arg[2]) {
+					return false;
+				}
+				break;
+			default:
+				break;
+		}
+		pc += 1 + operandCount(op);
+	}
+	return true;
+} /* Bytecode::verify */
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                     Compiler methods                               */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*!
+ * fn Bytecode *Compiler::compile(Node *node)
+ * \brief Compiles the tree rooted at node into a new Bytecode
+ * \return The Bytecode. The caller owns it.
+ */
+Bytecode *Compiler::compile(Node *node)
+{
+	code_ = new Bytecode();
+	depth_ = 0;
+	recent_ = 0;
+	entries_.clear();
+	constantIndex_.clear();
+
+	node->visitCompiler(*this);
+	emit(OP_HALT);
+
+	if (jit_) {
+		if (!jit_->finish()) {
+			CLog::write(CLog::RELEASE, "JIT: no executable memory, running bytecode only\n");
+			delete code_;
+			jit_ = NULL;
+			return compile(node);
+		}
+		code_->natives() = jit_->functions();
+	}
+
+	Bytecode *result = code_;
+	code_ = NULL;
+	return result;
+} /* Compiler::compile */
+
+/**********************************************************************/
+/*!
+ * fn int Compiler::append(Bytecode *code, Node *node)
+ * \brief Compiles the tree rooted at node onto the end of code, which
+ * the last compile() or append() of this Compiler made, and ends it
+ * with an OP_HALT. Only node is compiled; the code before it is kept
+ * as it is. Native code is not appended.
+ * \return The address to start the VM at to run node
+ */
+int Compiler::append(Bytecode *code, Node *node)
+{
+	assert(!jit_);
+	code_ = code;
+	depth_ = 0;
+	int start = here();
+
+	node->visitCompiler(*this);
+	emit(OP_HALT);
+
+	code_ = NULL;
+	return start;
+} /* Compiler::append */
+
+/**********************************************************************/
+/*!
+ * fn void Compiler::start()
+ * \brief Notes that an instruction starts here, for the merges
+ */
+void Compiler::start()
+{
+	for (int i = WINDOW - 1; i > 0; i--) {
+		starts_[i] = starts_[i - 1];
+	}
+	starts_[0] = code_->code().size();
+	if (recent_ < WINDOW) {
+		recent_++;
+	}
+} /* Compiler::start */
+
+/**********************************************************************/
+/*!
+ * fn int Compiler::last(int n)
+ * \brief The opcode of the instruction n before the next, -1 if it can
+ * not be merged
+ */
+int Compiler::last(int n)
+{
+	return n < recent_ ? code_->code()[starts_[n]] : -1;
+} /* Compiler::last */
+
+/**********************************************************************/
+/*!
+ * fn bool Compiler::fuseBranch(int address)
+ * \brief Emits OP_JUMP_FALSE after an INTEGER comparison as one compare
+ * and branch, on the opposite comparison
+ * \return false if the last instruction is not such a comparison
+ */
+bool Compiler::fuseBranch(int address)
+{
+	int compare = last(0);
+	OpCode branch;
+	switch (compare)
+	{
+		case OP_EQ_I: branch = OP_JUMP_NE_I; break;
+		case OP_NE_I: branch = OP_JUMP_EQ_I; break;
+		case OP_LT_I: branch = OP_JUMP_GE_I; break;
+		case OP_LE_I: branch = OP_JUMP_GT_I; break;
+		case OP_GT_I: branch = OP_JUMP_LE_I; break;
+		case OP_GE_I: branch = OP_JUMP_LT_I; break;
+		default:
+			return false;
+	}
+	code_->code().pop_back();
+	depth_ -= stackEffect(compare);
+	recent_ = 0;
+	emit(branch, address);
+	return true;
+} /* Compiler::fuseBranch */
+
+/**********************************************************************/
+/*!
+ * fn bool Compiler::fuseIncrement(int level, int slot)
+ * \brief Emits the OP_STORE of x := x + c, or x := x - c, with c an
+ * INTEGER constant, as one OP_INC_I in place of all four instructions
+ * \return false if the last three are not the rest of it
+ */
+bool Compiler::fuseIncrement(int level, int slot)
+{
+	int op = last(0);
+	if ((op != OP_ADD_I && op != OP_SUB_I) || last(1) != OP_CONST || last(2) != OP_LOAD) {
+		return false;
+	}
+	std::vector<int> &code = code_->code();
+	int load = starts_[2];
+	if (code[load + 1] != level || code[load + 2] != slot) {
+		return false;
+	}
+
+	int constant = code[starts_[1] + 1];
+	if (op == OP_SUB_I) {
+		Value step = code_->constants()[constant];
+		constant = addConstant(Value::integer((int64_t)(0 - (uint64_t)step.i)), INTEGER);
+	}
+	code.resize(load);
+	depth_ -= stackEffect(OP_LOAD);
+	recent_ = 0;
+	emit(OP_INC_I, level, slot, constant);
+	return true;
+} /* Compiler::fuseIncrement */
+
+/**********************************************************************/
+void Compiler::emit(OpCode op)
+{
+	assert(operandCount(op) == 0);
+	start();
+	code_->code().push_back(op);
+	depth_ += stackEffect(op);
+	code_->noteStackDepth(depth_);
+} /* Compiler::emit */
+
+/**********************************************************************/
+void Compiler::emit(OpCode op, int arg)
+{
+	assert(operandCount(op) == 1);
+	if (op == OP_JUMP_FALSE && fuseBranch(arg)) {
+		return;
+	}
+	start();
+	code_->code().push_back(op);
+	code_->code().push_back(arg);
+	depth_ += stackEffect(op);
+	code_->noteStackDepth(depth_);
+} /* Compiler::emit */
+
+/**********************************************************************/
+void Compiler::emit(OpCode op, int arg1, int arg2)
+{
+	assert(operandCount(op) == 2);
+	if (op == OP_STORE && fuseIncrement(arg1, arg2)) {
+		return;
+	}
+	start();
+	code_->code().push_back(op);
+	code_->code().push_back(arg1);
+	code_->code().push_back(arg2);
+	depth_ += stackEffect(op);
+	code_->noteStackDepth(depth_);
+} /* Compiler::emit */
+
+/**********************************************************************/
+void Compiler::emit(OpCode op, int arg1, int arg2, int arg3)
+{
+	assert(operandCount(op) == 3);
+	start();
+	code_->code().push_back(op);
+	code_->code().push_back(arg1);
+	code_->code().push_back(arg2);
+	code_->code().push_back(arg3);
+	depth_ += stackEffect(op);
+	code_->noteStackDepth(depth_);
+} /* Compiler::emit */
+
+/**********************************************************************/
+/*!
+ * fn void Compiler::emitCall(ProcedureDecl *procedure, int nargs)
+ * \brief Calls procedure with the nargs arguments on top of the stack.
+ * A procedure is always compiled before any call to it can be.
+ */
+void Compiler::emitCall(ProcedureDecl *procedure, int nargs)
+{
+	ScopedSymbolTable *scope = procedure->getScope();
+	assert(entries_.count(procedure));
+	start();
+	std::vector<int> &code = code_->code();
+	code.push_back(OP_CALL);
+	code.push_back(entries_[procedure]);
+	code.push_back(scope->getLevel());
+	code.push_back(scope->frameSize());
+	code.push_back(nargs);
+	depth_ -= nargs;
+} /* Compiler::emitCall */
+
+/**********************************************************************/
+int Compiler::addConstant(Value value, SymbolType type)
+{
+	std::pair<int, int64_t> key(type, value.i);
+	std::map<std::pair<int, int64_t>, int>::iterator it = constantIndex_.find(key);
+	if (it != constantIndex_.end()) {
+		return it->second;
+	}
+	std::vector<Value> &constants = code_->constants();
+	code_->constantTypes().push_back(type);
+	constants.push_back(value);
+	constantIndex_[key] = constants.size() - 1;
+	return constants.size() - 1;
+} /* Compiler::addConstant */
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                        VM methods                                  */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*!
+ * fn Value VM::run(const Bytecode *code, CallStack &callStack, int start)
+ * \brief Runs code from the instruction at start. Each instruction ends
+ * by jumping to the code of the next through labels, a table in OpCode
+ * order, so every instruction has a branch of its own for the CPU to
+ * predict.
+ * The activation record of the program must already be on callStack.
+ * \return The value left on top of the stack, 0 if it is empty
+ */
+Value VM::run(const Bytecode *bytecode, CallStack &callStack, int start)
+{
+	static void *const labels[] = {
+		&&op_CONST, &&op_LOAD, &&op_STORE, &&op_INC_I,
+		&&op_ADD_I, &&op_SUB_I, &&op_MUL_I, &&op_DIV_I, &&op_NEG_I,
+		&&op_ADD_R, &&op_SUB_R, &&op_MUL_R, &&op_DIV_R, &&op_NEG_R, &&op_I2R,
+		&&op_EQ_I, &&op_NE_I, &&op_LT_I, &&op_LE_I, &&op_GT_I, &&op_GE_I,
+		&&op_EQ_R, &&op_NE_R, &&op_LT_R, &&op_LE_R, &&op_GT_R, &&op_GE_R,
+		&&op_JUMP, &&op_JUMP_FALSE,
+		&&op_JUMP_EQ_I, &&op_JUMP_NE_I, &&op_JUMP_LT_I, &&op_JUMP_LE_I, &&op_JUMP_GT_I, &&op_JUMP_GE_I,
+		&&op_FOR_UP, &&op_NEXT_UP, &&op_FOR_DOWN, &&op_NEXT_DOWN,
+		&&op_CALL, &&op_RET, &&op_NATIVE, &&op_HALT,
+	};
+	static_assert(sizeof(labels) / sizeof(labels[0]) == OP_MAX, "labels must list every OpCode, in order");
+
+	size_t maxStack = bytecode->maxStack();
+	stack_.assign(maxStack + 1, Value());
+
+	const int *code      = &bytecode->code()[0];
+	const Value *consts  = bytecode->constants().empty() ? NULL : &bytecode->constants()[0];
+	const NativeCode *natives = bytecode->natives().empty() ? NULL : &bytecode->natives()[0];
+	Value **display      = callStack.display();
+	Value *sp            = &stack_[0]; /* points at the top element */
+	const int *pc        = code + start;
+	Value b;
+
+#define DISPATCH() goto *labels[*pc++]
+
+	DISPATCH();
+
+op_CONST:
+	*++sp = consts[*pc++];
+	DISPATCH();
+op_LOAD:
+	*++sp = display[pc[0]][pc[1]];
+	pc += 2;
+	DISPATCH();
+op_STORE:
+	display[pc[0]][pc[1]] = *sp--;
+	pc += 2;
+	DISPATCH();
+op_INC_I:
+{
+	Value *variable = &display[pc[0]][pc[1]];
+	*variable = applyKernel(K_ADD_II, *variable, consts[pc[2]]);
+	pc += 3;
+	DISPATCH();
+}
+op_ADD_I:
+	b = *sp--;
+	*sp = applyKernel(K_ADD_II, *sp, b);
+	DISPATCH();
+op_SUB_I:
+	b = *sp--;
+	*sp = applyKernel(K_SUB_II, *sp, b);
+	DISPATCH();
+op_MUL_I:
+	b = *sp--;
+	*sp = applyKernel(K_MUL_II, *sp, b);
+	DISPATCH();
+op_DIV_I:
+	b = *sp--;
+	*sp = applyKernel(K_INT_DIV_II, *sp, b);
+	DISPATCH();
+op_NEG_I:
+	*sp = applyKernel(K_NEG_I, *sp, *sp);
+	DISPATCH();
+op_ADD_R:
+	b = *sp--;
+	sp->r += b.r;
+	DISPATCH();
+op_SUB_R:
+	b = *sp--;
+	sp->r -= b.r;
+	DISPATCH();
+op_MUL_R:
+	b = *sp--;
+	sp->r *= b.r;
+	DISPATCH();
+op_DIV_R:
+	b = *sp--;
+	sp->r /= b.r;
+	DISPATCH();
+op_NEG_R:
+	sp->r = -sp->r;
+	DISPATCH();
+op_I2R:
+	sp->r = (double)sp->i;
+	DISPATCH();
+op_EQ_I:
+	b = *sp--;
+	sp->i = sp->i == b.i;
+	DISPATCH();
+op_NE_I:
+	b = *sp--;
+	sp->i = sp->i != b.i;
+	DISPATCH();
+op_LT_I:
+	b = *sp--;
+	sp->i = sp->i < b.i;
+	DISPATCH();
+op_LE_I:
+	b = *sp--;
+	sp->i = sp->i <= b.i;
+	DISPATCH();
+op_GT_I:
+	b = *sp--;
+	sp->i = sp->i > b.i;
+	DISPATCH();
+op_GE_I:
+	b = *sp--;
+	sp->i = sp->i >= b.i;
+	DISPATCH();
+op_EQ_R:
+	b = *sp--;
+	sp->i = sp->r == b.r;
+	DISPATCH();
+op_NE_R:
+	b = *sp--;
+	sp->i = sp->r != b.r;
+	DISPATCH();
+op_LT_R:
+	b = *sp--;
+	sp->i = sp->r < b.r;
+	DISPATCH();
+op_LE_R:
+	b = *sp--;
+	sp->i = sp->r <= b.r;
+	DISPATCH();
+op_GT_R:
+	b = *sp--;
+	sp->i = sp->r > b.r;
+	DISPATCH();
+op_GE_R:
+	b = *sp--;
+	sp->i = sp->r >= b.r;
+	DISPATCH();
+op_JUMP:
+	pc = code + pc[0];
+	DISPATCH();
+op_JUMP_FALSE:
+	pc = (sp--)->i ? pc + 1 : code + pc[0];
+	DISPATCH();
+op_JUMP_EQ_I:
+	sp -= 2;
+	pc = sp[1].i == sp[2].i ? code + pc[0] : pc + 1;
+	DISPATCH();
+op_JUMP_NE_I:
+	sp -= 2;
+	pc = sp[1].i != sp[2].i ? code + pc[0] : pc + 1;
+	DISPATCH();
+op_JUMP_LT_I:
+	sp -= 2;
+	pc = sp[1].i < sp[2].i ? code + pc[0] : pc + 1;
+	DISPATCH();
+op_JUMP_LE_I:
+	sp -= 2;
+	pc = sp[1].i <= sp[2].i ? code + pc[0] : pc + 1;
+	DISPATCH();
+op_JUMP_GT_I:
+	sp -= 2;
+	pc = sp[1].i > sp[2].i ? code + pc[0] : pc + 1;
+	DISPATCH();
+op_JUMP_GE_I:
+	sp -= 2;
+	pc = sp[1].i >= sp[2].i ? code + pc[0] : pc + 1;
+	DISPATCH();
+op_FOR_UP:
+	if (sp[-1].i > sp->i) {
+		sp -= 2;
+		pc = code + pc[2];
+	} else {
+		display[pc[0]][pc[1]] = sp[-1];
+		sp[-1] = *sp;
+		sp--;
+		pc += 3;
+	}
+	DISPATCH();
+op_NEXT_UP:
+{
+	Value *counter = &display[pc[0]][pc[1]];
+	if (counter->i < sp->i) {
+		counter->i++;
+		pc = code + pc[2];
+	} else {
+		sp--;
+		pc += 3;
+	}
+	DISPATCH();
+}
+op_FOR_DOWN:
+	if (sp[-1].i < sp->i) {
+		sp -= 2;
+		pc = code + pc[2];
+	} else {
+		display[pc[0]][pc[1]] = sp[-1];
+		sp[-1] = *sp;
+		sp--;
+		pc += 3;
+	}
+	DISPATCH();
+op_NEXT_DOWN:
+{
+	Value *counter = &display[pc[0]][pc[1]];
+	if (counter->i > sp->i) {
+		counter->i--;
+		pc = code + pc[2];
+	} else {
+		sp--;
+		pc += 3;
+	}
+	DISPATCH();
+}
+op_CALL:
+{
+	int nargs = pc[3];
+	Value *slots = callStack.next(pc[2]);
+	sp -= nargs;
+	for (int i = 0; i < nargs; i++) {
+		slots[i] = sp[i + 1];
+	}
+	/* The bounds of the FOR loops around the call stay on the
+	 * stack under the body, which may need maxStack more */
+	size_t depth = sp - &stack_[0];
+	if (depth + maxStack >= stack_.size()) {
+		stack_.resize(2 * stack_.size() + maxStack);
+		sp = &stack_[0] + depth;
+	}
+	callStack.push(pc[1], pc[2], nargs, pc + 4 - code);
+	display = callStack.display();
+	pc = code + pc[0];
+	DISPATCH();
+}
+op_RET:
+	pc = code + callStack.pop();
+	DISPATCH();
+op_NATIVE:
+	if (natives[*pc++](display)) {
+		divisionByZero();
+	}
+	DISPATCH();
+op_HALT:
+	return sp == &stack_[0] ? Value() : *sp;
+
+#undef DISPATCH
+} /* VM::run */
+
+/**********************************************************************/
+/*!
+ * fn Value Evaluator::visit(Program *program)
+ * \brief Runs the program either on the VM or by walking the tree
+ */
+Value Evaluator::visit(Program *program)
+{
+	if (mode_ == VM) {
+		Bytecode *code = compile(program);
+		Value result = run(code);
+		delete code;
+		return result;
+	}
+
+	ScopedSymbolTable *globals = program->getScope();
+	callStack_.push(globals->getLevel(), globals->frameSize());
+	TRACE(TRACE_EVAL, "Evaluator: tree, %d globals\n", globals->frameSize());
+	Value result = program->visitEvaluate(*this);
+	printMemory(globals);
+	callStack_.pop();
+	return result;
+} /* Evaluator::visit */
+
+/**********************************************************************/
+/*!
+ * fn Bytecode *Evaluator::compile(Program *program)
+ * \brief Compiles program for run(), with the Jit of the Evaluator if it
+ * has one
+ * \return The Bytecode. The caller owns it.
+ */
+Bytecode *Evaluator::compile(Program *program)
+{
+	Compiler compiler(jit_);
+	Bytecode *code = compiler.compile(program);
+
+	ScopedSymbolTable *globals = program->getScope();
+	std::vector<VarSymbol *> &variables = globals->variables();
+	code->setFrameSize(globals->frameSize());
+	for (size_t i = 0; i < variables.size(); i++) {
+		GlobalVariable global;
+		global.name = variables[i]->spelling();
+		global.type = variables[i]->valueType();
+		global.slot = variables[i]->slot();
+		code->globals().push_back(global);
+	}
+	return code;
+} /* Evaluator::compile */
+
+/**********************************************************************/
+/*!
+ * fn Value Evaluator::run(Bytecode *code)
+ * \brief Runs code on the VM, in a new activation record of the program,
+ * and prints its globals. code need not come from compile(): a
+ * BytecodeCache loads it without a Program.
+ */
+Value Evaluator::run(Bytecode *code)
+{
+	callStack_.push(1, code->frameSize());
+	TRACE(TRACE_EVAL, "Evaluator: vm, %d globals\n", code->frameSize());
+	if (disassemble_) {
+		code->disassemble();
+	}
+
+	::VM vm;
+	Value result = vm.run(code, callStack_);
+
+	printMemory(code);
+	callStack_.pop();
+	return result;
+} /* Evaluator::run */
+
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+/*                   Node::visitCompiler methods                      */
+/**********************************************************************/
+/**********************************************************************/
+/**********************************************************************/
+void Program::visitCompiler(Compiler &compiler)
+{
+	getBlock()->visitCompiler(compiler);
+} /* Program::visitCompiler */
+
+/**********************************************************************/
+void Block::visitCompiler(Compiler &compiler)
+{
+	Block::iterator it;
+	for (it = this->begin(); it != this->end(); it++) {
+		(*it)->visitCompiler(compiler);
+	}
+	getCompound()->visitCompiler(compiler);
+} /* Block::visitCompiler */
+
+/**********************************************************************/
+void VarDecl::visitCompiler(Compiler &compiler)
+{
+	return;
+} /* VarDecl::visitCompiler */
+
+/**********************************************************************/
+void Type::visitCompiler(Compiler &compiler)
+{
+	return;
+} /* Type::visitCompiler */
+
+/**********************************************************************/
+/*!
+ * fn void Compound::visitCompiler(Compiler &compiler)
+ * \brief Each run of statements the Jit of the compiler translates is
+ * one OP_NATIVE; the statements between runs are compiled to bytecode.
+ */
+void Compound::visitCompiler(Compiler &compiler)
+{
+	Jit *jit = compiler.getJit();
+	size_t i = 0;
+	while (i < size()) {
+		size_t compiled = 0;
+		int native = jit ? jit->compile(begin() + i, size() - i, &compiled) : -1;
+		if (native >= 0) {
+			compiler.emit(OP_NATIVE, native);
+			i += compiled;
+		} else {
+			children_[i]->visitCompiler(compiler);
+			i++;
+		}
+	}
+} /* Compound::visitCompiler */
+
+/**********************************************************************/
+void NoOp::visitCompiler(Compiler &compiler)
+{
+	return;
+} /* NoOp::visitCompiler */
+
+/**********************************************************************/
+void Assign::visitCompiler(Compiler &compiler)
+{
+	getRhs()->visitCompiler(compiler);
+	if (toReal()) {
+		compiler.emit(OP_I2R);
+	}
+	compiler.emit(OP_STORE, getLhs()->level(), getLhs()->slot());
+} /* Assign::visitCompiler */
+
+/**********************************************************************/
+void Var::visitCompiler(Compiler &compiler)
+{
+	compiler.emit(OP_LOAD, level(), slot());
+} /* Var::visitCompiler */
+
+/**********************************************************************/
+/*!
+ * fn void BinOp::visitCompiler(Compiler &compiler)
+ * \brief One typed instruction for the kernel the SemanticAnalyzer
+ * chose, after turning the INTEGER side of a mixed pair into a REAL.
+ */
+void BinOp::visitCompiler(Compiler &compiler)
+{
+	Kernel kernel = getKernel();
+	bool lhsToReal = kernel == K_DIV_II || (kernel >= K_ADD_IR && kernel <= K_GE_IR);
+	bool rhsToReal = kernel == K_DIV_II || (kernel >= K_ADD_RI && kernel <= K_GE_RI);
+
+	getLhs()->visitCompiler(compiler);
+	if (lhsToReal) {
+		compiler.emit(OP_I2R);
+	}
+	getRhs()->visitCompiler(compiler);
+	if (rhsToReal) {
+		compiler.emit(OP_I2R);
+	}
+
+	switch (kernel)
+	{
+		case K_ADD_II: compiler.emit(OP_ADD_I); break;
+		case K_SUB_II: compiler.emit(OP_SUB_I); break;
+		case K_MUL_II: compiler.emit(OP_MUL_I); break;
+		case K_INT_DIV_II: compiler.emit(OP_DIV_I); break;
+		case K_ADD_RR: case K_ADD_IR: case K_ADD_RI: compiler.emit(OP_ADD_R); break;
+		case K_SUB_RR: case K_SUB_IR: case K_SUB_RI: compiler.emit(OP_SUB_R); break;
+		case K_MUL_RR: case K_MUL_IR: case K_MUL_RI: compiler.emit(OP_MUL_R); break;
+		case K_DIV_RR: case K_DIV_IR: case K_DIV_RI: case K_DIV_II: compiler.emit(OP_DIV_R); break;
+		case K_EQ_II: compiler.emit(OP_EQ_I); break;
+		case K_NE_II: compiler.emit(OP_NE_I); break;
+		case K_LT_II: compiler.emit(OP_LT_I); break;
+		case K_LE_II: compiler.emit(OP_LE_I); break;
+		case K_GT_II: compiler.emit(OP_GT_I); break;
+		case K_GE_II: compiler.emit(OP_GE_I); break;
+		case K_EQ_RR: case K_EQ_IR: case K_EQ_RI: compiler.emit(OP_EQ_R); break;
+		case K_NE_RR: case K_NE_IR: case K_NE_RI: compiler.emit(OP_NE_R); break;
+		case K_LT_RR: case K_LT_IR: case K_LT_RI: compiler.emit(OP_LT_R); break;
+		case K_LE_RR: case K_LE_IR: case K_LE_RI: compiler.emit(OP_LE_R); break;
+		case K_GT_RR: case K_GT_IR: case K_GT_RI: compiler.emit(OP_GT_R); break;
+		case K_GE_RR: case K_GE_IR: case K_GE_RI: compiler.emit(OP_GE_R); break;
+		default:
+			CLog::write(CLog::RELEASE, "BinOp::visitCompiler(): Unknown operator %s\n", getToken().representation().c_str());
+			assert(false);
+			break;
+	}
+} /* BinOp::visitCompiler */
+
+/**********************************************************************/
+void UnaryOp::visitCompiler(Compiler &compiler)
+{
+	getExpr()->visitCompiler(compiler);
+	if (getKernel() == K_NEG_I) {
+		compiler.emit(OP_NEG_I);
+	} else if (getKernel() == K_NEG_R) {
+		compiler.emit(OP_NEG_R);
+	}
+} /* UnaryOp::visitCompiler */
+
+/**********************************************************************/
+void Number::visitCompiler(Compiler &compiler)
+{
+	compiler.emit(OP_CONST, compiler.addConstant(value(), valueType()));
+} /* Number::visitCompiler */
+
+/**********************************************************************/
+void Param::visitCompiler(Compiler &compiler)
+{
+	return;
+} /* Param::visitCompiler */
+
+/**********************************************************************/
+/*!
+ * fn void ProcedureDecl::visitCompiler(Compiler &compiler)
+ * \brief The body is compiled where the procedure is declared, behind a
+ * jump over it, and ends with an OP_RET. Its address is known before the
+ * body is compiled, so the body can call itself.
+ */
+void ProcedureDecl::visitCompiler(Compiler &compiler)
+{
+	compiler.emit(OP_JUMP, 0);
+	int jump = compiler.here() - 1;
+
+	compiler.setEntry(this, compiler.here());
+	getBlock()->visitCompiler(compiler);
+	compiler.emit(OP_RET);
+
+	compiler.patch(jump, compiler.here());
+} /* ProcedureDecl::visitCompiler */
+
+/**********************************************************************/
+/*!
+ * fn void ProcedureCall::visitCompiler(Compiler &compiler)
+ * \brief Pushes the arguments in order and calls
+ */
+void ProcedureCall::visitCompiler(Compiler &compiler)
+{
+	for (size_t i = 0; i < size(); i++) {
+		arg(i)->visitCompiler(compiler);
+		if (toReal(i)) {
+			compiler.emit(OP_I2R);
+		}
+	}
+	compiler.emitCall(getProcedure(), size());
+} /* ProcedureCall::visitCompiler */
+
+/**********************************************************************/
+void If::visitCompiler(Compiler &compiler)
+{
+	getCondition()->visitCompiler(compiler);
+	compiler.emit(OP_JUMP_FALSE, 0);
+	int toElse = compiler.here() - 1;
+
+	getThen()->visitCompiler(compiler);
+	if (getElse()) {
+		compiler.emit(OP_JUMP, 0);
+		int toEnd = compiler.here() - 1;
+		compiler.patch(toElse, compiler.here());
+		getElse()->visitCompiler(compiler);
+		compiler.patch(toEnd, compiler.here());
+	} else {
+		compiler.patch(toElse, compiler.here());
+	}
+} /* If::visitCompiler */
+
+/**********************************************************************/
+void While::visitCompiler(Compiler &compiler)
+{
+	int head = compiler.here();
+	getCondition()->visitCompiler(compiler);
+	compiler.emit(OP_JUMP_FALSE, 0);
+	int toEnd = compiler.here() - 1;
+
+	getBody()->visitCompiler(compiler);
+	compiler.emit(OP_JUMP, head);
+	compiler.patch(toEnd, compiler.here());
+} /* While::visitCompiler */
+
+/**********************************************************************/
+/*!
+ * fn void For::visitCompiler(Compiler &compiler)
+ * \brief The counted loop. Both bounds are evaluated once, the start
+ * first. OP_FOR_UP skips a loop that runs zero times, or else moves the
+ * start into the counter, so the bound stays on top of the operand
+ * stack while the loop runs; OP_NEXT_UP steps the counter in its slot and jumps
+ * back, a single instruction per iteration on top of the body.
+ */
+void For::visitCompiler(Compiler &compiler)
+{
+	int level = getVar()->level();
+	int slot  = getVar()->slot();
+
+	getStart()->visitCompiler(compiler);
+	getBound()->visitCompiler(compiler);
+
+	compiler.emit(isDown() ? OP_FOR_DOWN : OP_FOR_UP, level, slot, 0);
+	int toEnd = compiler.here() - 1;
+	int body = compiler.here();
+
+	getBody()->visitCompiler(compiler);
+	compiler.emit(isDown() ? OP_NEXT_DOWN : OP_NEXT_UP, level, slot, body);
+	compiler.patch(toEnd, compiler.here());
+} /* For::visitCompiler */
@@ -0,0 +1,208 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <map>
+#include "value.hpp"
+#include "jit.hpp"
+
+/*!
+ * \file vm.hpp
+ * \brief Bytecode compiler and the stack based virtual machine that runs it.
+ */
+
+class Node;
+class ProcedureDecl;
+class CallStack;
+
+/*!
+ *  \enum OpCode
+ *  \brief Instructions understood by the VM.
+ *  Every instruction is one word in Bytecode::code_, optionally followed
+ *  by its operand words.
+ */
+enum OpCode
+{
+	OP_CONST,	/*!< push constants_[arg]                               */
+	OP_LOAD,	/*!< push display[level][slot]                           */
+	OP_STORE,	/*!< pop the top of the stack into display[level][slot] */
+	OP_INC_I,	/*!< add constants_[constant] to the INTEGER
+			     display[level][slot]: level, slot, constant;
+			     a superinstruction for x := x + c          */
+	OP_ADD_I,	/*!< pop b, pop a, push a + b, INTEGERs         */
+	OP_SUB_I,	/*!< pop b, pop a, push a - b, INTEGERs         */
+	OP_MUL_I,	/*!< pop b, pop a, push a * b, INTEGERs         */
+	OP_DIV_I,	/*!< pop b, pop a, push a DIV b, INTEGERs       */
+	OP_NEG_I,	/*!< negate the INTEGER on top of the stack    */
+	OP_ADD_R,	/*!< pop b, pop a, push a + b, REALs            */
+	OP_SUB_R,	/*!< pop b, pop a, push a - b, REALs            */
+	OP_MUL_R,	/*!< pop b, pop a, push a * b, REALs            */
+	OP_DIV_R,	/*!< pop b, pop a, push a / b, REALs            */
+	OP_NEG_R,	/*!< negate the REAL on top of the stack       */
+	OP_I2R,		/*!< turn the INTEGER on top into a REAL       */
+	OP_EQ_I,	/*!< pop b, pop a, push a = b, INTEGERs         */
+	OP_NE_I,	/*!< pop b, pop a, push a <> b, INTEGERs        */
+	OP_LT_I,	/*!< pop b, pop a, push a < b, INTEGERs         */
+	OP_LE_I,	/*!< pop b, pop a, push a <= b, INTEGERs        */
+	OP_GT_I,	/*!< pop b, pop a, push a > b, INTEGERs         */
+	OP_GE_I,	/*!< pop b, pop a, push a >= b, INTEGERs        */
+	OP_EQ_R,	/*!< pop b, pop a, push a = b, REALs            */
+	OP_NE_R,	/*!< pop b, pop a, push a <> b, REALs           */
+	OP_LT_R,	/*!< pop b, pop a, push a < b, REALs            */
+	OP_LE_R,	/*!< pop b, pop a, push a <= b, REALs           */
+	OP_GT_R,	/*!< pop b, pop a, push a > b, REALs            */
+	OP_GE_R,	/*!< pop b, pop a, push a >= b, REALs           */
+	OP_JUMP,	/*!< continue at address                        */
+	OP_JUMP_FALSE,	/*!< pop a BOOLEAN, continue at address if it is 0 */
+	OP_JUMP_EQ_I,	/*!< pop b, pop a, continue at address if a = b,
+			     INTEGERs; a superinstruction for a comparison
+			     and the OP_JUMP_FALSE after it            */
+	OP_JUMP_NE_I,	/*!< OP_JUMP_EQ_I if a <> b                     */
+	OP_JUMP_LT_I,	/*!< OP_JUMP_EQ_I if a < b                      */
+	OP_JUMP_LE_I,	/*!< OP_JUMP_EQ_I if a <= b                     */
+	OP_JUMP_GT_I,	/*!< OP_JUMP_EQ_I if a > b                      */
+	OP_JUMP_GE_I,	/*!< OP_JUMP_EQ_I if a >= b                     */
+	OP_FOR_UP,	/*!< FOR ... TO with the bound on top of the stack and
+			     the start under it: if start > bound, pop both
+			     and continue at address, else pop the start into
+			     display[level][slot]: level, slot, address */
+	OP_NEXT_UP,	/*!< end of a FOR ... TO body: if the counter is below
+			     the bound, add 1 to it and continue at address,
+			     else pop the bound: level, slot, address  */
+	OP_FOR_DOWN,	/*!< OP_FOR_UP for FOR ... DOWNTO              */
+	OP_NEXT_DOWN,	/*!< OP_NEXT_UP for FOR ... DOWNTO             */
+	OP_CALL,	/*!< pop nargs arguments into a new activation record
+			     of level and size, continue at entry:
+			     entry, level, size, nargs                 */
+	OP_RET,		/*!< pop the innermost activation record and continue
+			     after the OP_CALL that pushed it          */
+	OP_NATIVE,	/*!< run natives_[arg], code made by the Jit    */
+	OP_HALT,	/*!< stop execution                            */
+
+	OP_MAX
+}; /* OpCode */
+
+/**********************************************************************/
+/**
+ * A GlobalVariable struct.
+ * A variable of the program, in the activation record Bytecode runs on,
+ * as the Evaluator prints it after the run
+ */
+struct GlobalVariable
+{
+	std::string name;
+	SymbolType  type;
+	int         slot;
+}; /* GlobalVariable */
+
+/**********************************************************************/
+
+/**********************************************************************/
+/**
+ * A Bytecode class.
+ * The compiled form of a program: a linear instruction stream
+ * and its constant pool. Variables are addressed by the (level, slot)
+ * the SemanticAnalyzer gave their VarSymbol. Every arithmetic
+ * instruction works on one type; mixed operands are converted by an
+ * OP_I2R first.
+ */
+class Bytecode
+{
+	public:
+		Bytecode() : maxStack_(0), frameSize_(0) {}
+
+		std::vector<int>    &code()      { return code_; }
+		std::vector<Value>  &constants() { return constants_; }
+		std::vector<SymbolType> &constantTypes() { return constantTypes_; }
+		std::vector<NativeCode> &natives()   { return natives_; }
+		std::vector<GlobalVariable> &globals() { return globals_; }
+		const std::vector<int>   &code() const      { return code_; }
+		const std::vector<Value> &constants() const { return constants_; }
+		const std::vector<NativeCode> &natives() const { return natives_; }
+		const std::vector<GlobalVariable> &globals() const { return globals_; }
+		int  maxStack() const { return maxStack_; }
+		void noteStackDepth(int depth) { if (depth > maxStack_) maxStack_ = depth; }
+		int  frameSize() const { return frameSize_; }
+		void setFrameSize(int size) { frameSize_ = size; }
+
+		void disassemble();
+		bool verify();
+	private:
+		std::vector<int>    code_;
+		std::vector<Value>  constants_;
+		std::vector<SymbolType> constantTypes_; /*!< For the disassembly only */
+		std::vector<NativeCode> natives_;       /*!< Functions of the Jit that OP_NATIVE calls */
+		std::vector<GlobalVariable> globals_;   /*!< In slot order */
+		int maxStack_;
+		int frameSize_; /*!< Slots of the activation record of the program */
+}; /* Bytecode */
+
+/**********************************************************************/
+
+/**********************************************************************/
+/**
+ * A Compiler class.
+ * Walks a Program tree (through Node::visitCompiler) and emits Bytecode.
+ * As it emits, it merges an INTEGER comparison and the OP_JUMP_FALSE
+ * after it into one compare and branch, and x := x + c into an OP_INC_I,
+ * unless an address was taken in between with here(). Given a Jit, it turns the statements the Jit can translate into
+ * OP_NATIVE calls of native code instead.
+ * append() adds more trees to the same Bytecode, as a Repl does with
+ * each input; they can call the procedures compiled before them.
+ */
+class Compiler
+{
+	public:
+		Compiler(Jit *jit = NULL) : code_(NULL), depth_(0), recent_(0), jit_(jit) {}
+
+		Bytecode *compile(Node *node);
+		int       append(Bytecode *code, Node *node);
+
+		void emit(OpCode op);
+		void emit(OpCode op, int arg);
+		void emit(OpCode op, int arg1, int arg2);
+		void emit(OpCode op, int arg1, int arg2, int arg3);
+		void emitCall(ProcedureDecl *procedure, int nargs);
+		int  addConstant(Value value, SymbolType type);
+
+		int  here() { recent_ = 0; return code_->code().size(); } /* A jump may land there: nothing before it is merged with what follows */
+		void patch(int at, int value) { code_->code()[at] = value; }
+		void setEntry(ProcedureDecl *procedure, int entry) { entries_[procedure] = entry; }
+		Jit *getJit() { return jit_; }
+	private:
+		void start();
+		int  last(int n);
+		bool fuseBranch(int address);
+		bool fuseIncrement(int level, int slot);
+
+		Bytecode *code_;
+		int depth_;
+		enum { WINDOW = 3 };
+		int starts_[WINDOW]; /*!< Addresses of the last instructions, the newest first */
+		int recent_;         /*!< How many of starts_ can still be merged */
+		std::map<ProcedureDecl *, int> entries_; /*!< Address of the body of each procedure compiled so far */
+		std::map<std::pair<int, int64_t>, int> constantIndex_; /*!< Index of each (type, bits) in the pool */
+		Jit *jit_; /*!< NULL to compile everything to bytecode */
+}; /* Compiler */
+
+/**********************************************************************/
+
+/**********************************************************************/
+/**
+ * A VM class.
+ * Runs Bytecode over an operand stack, each instruction jumping straight
+ * to the code of the next (threaded dispatch) instead of going back
+ * through one switch. The Bytecode must be valid: what compile() makes,
+ * or what verify() accepts.
+ * Variables live in the activation records of the given CallStack.
+ * The Bytecode is only read, so VMs on different threads may run the
+ * same one, each on a CallStack of its own.
+ */
+class VM
+{
+	public:
+		Value run(const Bytecode *code, CallStack &callStack, int start = 0);
+	private:
+		std::vector<Value> stack_;
+}; /* VM */
+
+const char *getOpCodeLabel(int op);